@@ -0,0 +1,82 @@
+global ap_trampoline_start
+global ap_trampoline_params
+global ap_trampoline_end
+
+; Must match AP_TRAMPOLINE_ADDR in smp.h
+AP_TRAMPOLINE_ADDR  equ 0x8000
+
+CR0_PE              equ 1 << 0
+CR0_NW_CD           equ (1 << 29) | (1 << 30)
+CR0_PG              equ 1 << 31
+
+; Address of a label once the code is copied to AP_TRAMPOLINE_ADDR
+%define TRAMPOLINE(label) (AP_TRAMPOLINE_ADDR + (label) - ap_trampoline_start)
+
+; Start-up code of the application processors (see c_files/src/smp.c).
+;
+; A start-up IPI starts the CPU in real mode at AP_TRAMPOLINE_ADDR, with
+; cs = AP_TRAMPOLINE_ADDR >> 4 and ip = 0, caches disabled and paging off.
+; smp_init copies everything between ap_trampoline_start and
+; ap_trampoline_end there and fills in the parameters; this copy is never
+; executed in place. The code switches to protected mode with a flat
+; temporary GDT, turns on paging with the kernel page directory (the first
+; 4 MiB are identity mapped while CPUs start) and jumps to the C entry
+; point in the higher half on the stack it was given.
+section .rodata
+
+bits 16
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [TRAMPOLINE(ap_gdt_ptr)]
+
+    mov eax, cr0
+    and eax, ~CR0_NW_CD         ; enable caches
+    or eax, CR0_PE
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE(ap_protected_mode)
+
+bits 32
+ap_protected_mode:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; The bootstrap processor's CR4 (4 MiB and global pages, SSE) and CR3
+    mov eax, [TRAMPOLINE(ap_cr4)]
+    mov cr4, eax
+    mov eax, [TRAMPOLINE(ap_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, CR0_PG
+    mov cr0, eax
+
+    mov esp, [TRAMPOLINE(ap_stack)]
+    xor ebp, ebp                ; terminates frame pointer backtraces
+    mov eax, [TRAMPOLINE(ap_entry)]
+    jmp eax
+
+align 8
+ap_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF       ; 0x08: flat code, as in gdt.c
+    dq 0x00CF92000000FFFF       ; 0x10: flat data
+ap_gdt_ptr:
+    dw 3 * 8 - 1
+    dd TRAMPOLINE(ap_gdt)
+
+; struct ap_trampoline_params in smp.c
+align 4
+ap_trampoline_params:
+ap_cr3:     dd 0
+ap_cr4:     dd 0
+ap_stack:   dd 0
+ap_entry:   dd 0
+ap_trampoline_end:
+
+section .note.GNU-stack noalloc noexec nowrite progbits
@@ -0,0 +1,73 @@
+global interrupt_stubs
+
+extern interrupt_dispatch
+
+; One entry stub per vector, for the 32 CPU exceptions and the 16 PIC IRQs.
+; Each stub pushes a dummy error code if the CPU does not push one, pushes
+; its vector number and jumps to interrupt_common. Only eax, ecx and edx
+; are saved: interrupt_dispatch is ordinary C, which preserves ebx, esi,
+; edi and ebp itself. ebp is copied into the frame as well so handlers (the
+; profiler) can walk the interrupted code's frame pointers. Segment
+; registers are not touched because the kernel only ever runs with its own
+; flat selectors.
+;
+; The stack seen by interrupt_dispatch (struct interrupt_frame):
+;
+;   [esp + 32] eflags      pushed by the CPU
+;   [esp + 28] cs
+;   [esp + 24] eip
+;   [esp + 20] error code  pushed by the CPU or the stub
+;   [esp + 16] vector      pushed by the stub
+;   [esp + 12] eax
+;   [esp +  8] ecx
+;   [esp +  4] edx
+;   [esp     ] ebp         of the interrupted code
+
+INTERRUPT_NUM_STUBS equ 48
+
+; Exceptions for which the CPU pushes an error code
+%define HAS_ERROR_CODE(v) ((v) == 8 || ((v) >= 10 && (v) <= 14) || (v) == 17 || (v) == 21 || (v) == 29 || (v) == 30)
+
+section .text
+
+%assign vector 0
+%rep INTERRUPT_NUM_STUBS
+interrupt_stub_ %+ vector:
+%if HAS_ERROR_CODE(vector) == 0
+    push byte 0
+%endif
+    push byte vector
+    jmp interrupt_common
+%assign vector vector + 1
+%endrep
+
+interrupt_common:
+    push eax
+    push ecx
+    push edx
+    push ebp
+    cld                     ; the C ABI expects the direction flag clear
+
+    push esp                ; struct interrupt_frame *
+    call interrupt_dispatch
+    add esp, 8              ; the frame pointer and the ebp copy, ebp itself never changed
+
+    pop edx
+    pop ecx
+    pop eax
+    add esp, 8              ; vector and error code
+    iret
+
+
+section .rodata
+align 4
+
+; Stub addresses for idt_init, indexed by vector
+interrupt_stubs:
+%assign vector 0
+%rep INTERRUPT_NUM_STUBS
+    dd interrupt_stub_ %+ vector
+%assign vector vector + 1
+%endrep
+
+section .note.GNU-stack noalloc noexec nowrite progbits
@@ -1,24 +1,113 @@
 global loader
+global boot_page_directory
+global boot_tsc_loader
+global kernel_stack_top
 
 MAGIC_NUMBER  equ 0x1BADB002
-FLAG equ 0x0
+MEMINFO equ 1 << 1             ; ask GRUB for mem_lower/mem_upper and the memory map
+VIDEO_MODE equ 1 << 2          ; ask for the graphics mode below (fbcon.c)
+%ifdef VBE_CONSOLE
+FLAG equ MEMINFO | VIDEO_MODE
+%else
+FLAG equ MEMINFO
+%endif
 CHECKSUM equ -(MAGIC_NUMBER + FLAG)
 
-section .text
+; Must match KERNEL_VIRTUAL_BASE in paging.h and link.ld
+KERNEL_VIRTUAL_BASE equ 0xC0000000
+KERNEL_PDE_INDEX    equ KERNEL_VIRTUAL_BASE >> 22
+
+PDE_PRESENT_RW_4M   equ 0x83   ; present, writable, 4 MiB page
+CR0_PG              equ 1 << 31
+CR4_PSE             equ 1 << 4
+
+KERNEL_STACK_SIZE   equ 16384
+
+; GRUB jumps here with paging off, so this section is linked at its
+; physical address (see link.ld). eax and ebx carry the multiboot magic
+; and info pointer and must survive until kmain is called.
+section .boot progbits alloc exec nowrite align=4
 align 4
     dd MAGIC_NUMBER
     dd FLAG
     dd CHECKSUM
+%ifdef VBE_CONSOLE
+    ; Address fields, unused without flag bit 16, then the preferred mode:
+    ; linear framebuffer, 640x480 (80x30 cells of 8x16), 32 bits per pixel
+    times 5 dd 0
+    dd 0
+    dd 640
+    dd 480
+    dd 32
+%endif
 
 
 
 extern kmain
 
 loader:
+    ; First timestamp of the boot timeline (boot_trace.c). esi is free
+    ; here, eax is not.
+    mov esi, eax
+    rdtsc
+    mov [boot_tsc_loader - KERNEL_VIRTUAL_BASE], eax
+    mov [boot_tsc_loader - KERNEL_VIRTUAL_BASE + 4], edx
+    mov eax, esi
+
+    ; The page directory is linked at its virtual address
+    mov ecx, boot_page_directory - KERNEL_VIRTUAL_BASE
+    mov cr3, ecx
+
+    mov ecx, cr4
+    or ecx, CR4_PSE
+    mov cr4, ecx
+
+    mov ecx, cr0
+    or ecx, CR0_PG
+    mov cr0, ecx
+
+    ; Still running from the identity mapping; continue at the virtual address
+    lea ecx, [higher_half]
+    jmp ecx
+
+
+section .text
+
+higher_half:
+    ; GRUB leaves esp undefined, give kmain a stack inside the kernel image
+    mov esp, kernel_stack_top
+    xor ebp, ebp                ; terminates frame pointer backtraces
+
     push ebx
     push eax
     call kmain
 
 .loop:
+    hlt                         ; sleep until the next interrupt
     jmp .loop
 
+
+section .data align=4096
+
+; The first 4 MiB of physical memory, mapped both at 0 (for the few
+; instructions above that run before the jump) and at KERNEL_VIRTUAL_BASE.
+; paging_init replaces this with the full direct map.
+boot_page_directory:
+    dd PDE_PRESENT_RW_4M
+    times (KERNEL_PDE_INDEX - 1) dd 0
+    dd PDE_PRESENT_RW_4M
+    times (1024 - KERNEL_PDE_INDEX - 1) dd 0
+
+align 8
+boot_tsc_loader:
+    dq 0
+
+
+section .bss
+align 16
+
+kernel_stack:
+    resb KERNEL_STACK_SIZE
+kernel_stack_top:
+
+section .note.GNU-stack noalloc noexec nowrite progbits
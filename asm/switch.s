@@ -0,0 +1,33 @@
+global switch_to
+
+; switch_to - Save the current thread's callee-saved registers and resume
+; another thread (see c_files/src/sched.c)
+;
+; Everything a C caller expects to survive a call (ebx, esi, edi, ebp) is
+; pushed on the old stack, and the old esp is stored; the new thread's
+; stack holds the same four registers and a return address, pushed by its
+; own earlier switch_to or laid out by task_create. eax, ecx, edx and the
+; flags are caller-saved and x87/SSE state is switched lazily, so nothing
+; else needs saving.
+;
+; stack: [esp + 8] esp of the thread to resume
+;        [esp + 4] address where the current esp is stored
+;        [esp    ] return address
+switch_to:
+    mov eax, [esp + 4]
+    mov edx, [esp + 8]
+
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov [eax], esp
+
+    mov esp, edx
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+section .note.GNU-stack noalloc noexec nowrite progbits
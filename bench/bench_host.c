@@ -0,0 +1,30 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "bench_host.h"
+
+unsigned long long bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+void bench_report_header(void)
+{
+    printf("routine,variant,size,align,calls,ns_per_call,ns_per_byte,cycles_per_call\n");
+}
+
+
+void bench_report(const char *routine, const char *variant, unsigned int size,
+                  unsigned int align, unsigned long long calls,
+                  unsigned long long ns, unsigned long long cycles)
+{
+    double ns_per_call = (double)ns / calls;
+    double ns_per_byte = size ? ns_per_call / size : 0.0;
+
+    printf("%s,%s,%u,%u,%llu,%.3f,%.4f,%.1f\n", routine, variant, size, align,
+           calls, ns_per_call, ns_per_byte, (double)cycles / calls);
+    fflush(stdout);
+}
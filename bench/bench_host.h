@@ -0,0 +1,39 @@
+#ifndef INCLUDE_BENCH_HOST_H
+#define INCLUDE_BENCH_HOST_H
+
+/*
+ * Host-side helpers for libk_bench. Kept apart from the benchmark bodies so
+ * that the kernel headers and the host C library headers never meet in one
+ * translation unit (they declare the same names with different types).
+ */
+
+/** bench_now_ns:
+ *  Reads a monotonic clock.
+ *
+ *  @return Nanoseconds since an arbitrary start point
+ */
+unsigned long long bench_now_ns(void);
+
+
+/** bench_report_header:
+ *  Prints the CSV header line matching bench_report.
+ */
+void bench_report_header(void);
+
+
+/** bench_report:
+ *  Prints one CSV result line.
+ *
+ *  @param routine  The routine measured (e.g. "memcpy")
+ *  @param variant  Implementation or input variant (e.g. "erms", "base16")
+ *  @param size     Bytes processed (or produced) per call
+ *  @param align    Misalignment of the buffers in bytes
+ *  @param calls    Calls timed in the best run
+ *  @param ns       Wall time of the best run
+ *  @param cycles   TSC cycles of the best run
+ */
+void bench_report(const char *routine, const char *variant, unsigned int size,
+                  unsigned int align, unsigned long long calls,
+                  unsigned long long ns, unsigned long long cycles);
+
+#endif /* INCLUDE_BENCH_HOST_H */
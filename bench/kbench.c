@@ -0,0 +1,264 @@
+/*
+ * kbench - micro-benchmarks that run inside the kernel (see kbench.h).
+ *
+ * Built into kernel_bench.elf only, next to the normal kernel sources,
+ * so every case measures the code and the CPU state the kernel really
+ * has: paging on, interrupts on, the memory routines mem_init picked.
+ * tools/kbench.py boots the image under QEMU, reads the report from COM1
+ * and compares it with bench/kbench_baseline.txt.
+ */
+#include "kbench.h"
+#include "stdio.h"
+#include "string.h"
+#include "serial.h"
+#include "descriptor.h"
+#include "cpu.h"
+#include "io.h"
+
+#define KBENCH_BUF_SIZE         4096
+
+static unsigned char kbench_src[KBENCH_BUF_SIZE + 64] __attribute__((aligned(64)));
+static unsigned char kbench_dst[KBENCH_BUF_SIZE + 64] __attribute__((aligned(64)));
+
+/* 31 characters and a newline, so each serial_write call queues 32 bytes */
+static char kbench_serial_line[] = "kbench-pad 0123456789abcdefghij\n";
+static char kbench_puts_line[] = "kbench 0123456789abcdefghijklmnopqrstuvwxyz0123456789\n";
+
+/* Keeps results alive so the calls cannot be optimised away */
+volatile int kbench_sink;
+
+static int kbench_lfence;
+
+
+/* One benchmark case: run() performs 'calls' calls of the routine */
+struct kbench_case {
+    const char *name;
+    unsigned int calls;         /* calls per timed sample */
+    unsigned int size;
+    void (*run)(const struct kbench_case *c);
+    void (*reset)(void);        /* between samples, not timed; may be 0 */
+};
+
+
+/*
+ * rdtsc that neither starts before the code above it has finished nor
+ * lets the code below start early. lfence does that on SSE2 CPUs; older
+ * ones need the (much slower) cpuid.
+ */
+static inline unsigned long long kbench_rdtsc(void)
+{
+    unsigned int lo, hi;
+
+    if (kbench_lfence) {
+        __asm__ volatile("lfence\n\trdtsc\n\tlfence" : "=a"(lo), "=d"(hi) : : "memory");
+    } else {
+        unsigned int a, b, c, d;
+
+        cpuid(0, 0, &a, &b, &c, &d);
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+    }
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+
+static void run_empty(const struct kbench_case *c)
+{
+    (void)c;
+}
+
+static void run_putchar(const struct kbench_case *c)
+{
+    for (unsigned int i = 0; i < c->calls; i++) {
+        putchar(i + 1 == c->calls ? '\n' : 'k');
+    }
+}
+
+static void run_puts(const struct kbench_case *c)
+{
+    for (unsigned int i = 0; i < c->calls; i++) {
+        puts(kbench_puts_line);
+    }
+}
+
+static void run_serial_write(const struct kbench_case *c)
+{
+    for (unsigned int i = 0; i < c->calls; i++) {
+        serial_write(kbench_serial_line);
+    }
+}
+
+static void run_memcpy(const struct kbench_case *c)
+{
+    for (unsigned int i = 0; i < c->calls; i++) {
+        memcpy(kbench_dst, kbench_src, c->size);
+    }
+}
+
+static void run_memmove(const struct kbench_case *c)
+{
+    /* Overlapping, dest above src: the backward path */
+    for (unsigned int i = 0; i < c->calls; i++) {
+        memmove(kbench_dst + 8, kbench_dst, c->size);
+    }
+}
+
+static void run_memset(const struct kbench_case *c)
+{
+    for (unsigned int i = 0; i < c->calls; i++) {
+        memset(kbench_dst, i, c->size);
+    }
+}
+
+static void run_memcmp(const struct kbench_case *c)
+{
+    for (unsigned int i = 0; i < c->calls; i++) {
+        kbench_sink += memcmp(kbench_dst, kbench_src, c->size);
+    }
+}
+
+static void run_strlen(const struct kbench_case *c)
+{
+    for (unsigned int i = 0; i < c->calls; i++) {
+        kbench_sink += strlen((const char *)kbench_src);
+    }
+}
+
+static void run_snprintf(const struct kbench_case *c)
+{
+    char buf[64];
+
+    for (unsigned int i = 0; i < c->calls; i++) {
+        kbench_sink += snprintf(buf, sizeof(buf), "%s %u %x %p", "kbench", i, i * 4099, (void *)buf);
+    }
+}
+
+static void run_gdt_init(const struct kbench_case *c)
+{
+    for (unsigned int i = 0; i < c->calls; i++) {
+        /* %gs is flat between gdt_load and the reload: no interrupts in there */
+        unsigned int flags = irq_save();
+
+        gdt_init();
+        irq_restore(flags);
+    }
+}
+
+
+/* The transmit ring holds 4 KiB; start every sample with it empty */
+static void reset_serial(void)
+{
+    serial_flush();
+}
+
+/* memcmp has to look at every byte, strlen has to find the end */
+static void reset_buffers(void)
+{
+    memset(kbench_src, 'k', KBENCH_BUF_SIZE);
+    kbench_src[KBENCH_BUF_SIZE - 1] = '\0';
+    memcpy(kbench_dst, kbench_src, KBENCH_BUF_SIZE);
+}
+
+
+static const struct kbench_case kbench_cases[] = {
+    { "putchar",            80, 1,    run_putchar,      0 },
+    { "puts",               8,  sizeof(kbench_puts_line) - 1, run_puts, 0 },
+    { "serial_write",       64, sizeof(kbench_serial_line) - 1, run_serial_write, reset_serial },
+    { "memcpy/64",          64, 64,   run_memcpy,       0 },
+    { "memcpy/4096",        8,  4096, run_memcpy,       0 },
+    { "memmove/4096",       8,  4096, run_memmove,      0 },
+    { "memset/64",          64, 64,   run_memset,       0 },
+    { "memset/4096",        8,  4096, run_memset,       0 },
+    { "memcmp/4096",        8,  4096, run_memcmp,       reset_buffers },
+    { "strlen/4095",        8,  4095, run_strlen,       reset_buffers },
+    { "snprintf",           16, 0,    run_snprintf,     0 },
+    { "gdt_init",           16, 0,    run_gdt_init,     0 },
+};
+#define KBENCH_NUM_CASES (sizeof(kbench_cases) / sizeof(kbench_cases[0]))
+
+
+/* Insertion sort: KBENCH_SAMPLES values */
+static void kbench_sort(unsigned int *v, unsigned int n)
+{
+    for (unsigned int i = 1; i < n; i++) {
+        unsigned int x = v[i];
+        unsigned int j = i;
+
+        while (j > 0 && v[j - 1] > x) {
+            v[j] = v[j - 1];
+            j--;
+        }
+        v[j] = x;
+    }
+}
+
+
+/*
+ * Cycles of every timed sample of a case, sorted, minus 'overhead'
+ * (the cost of an empty sample).
+ */
+static void kbench_measure(const struct kbench_case *c, unsigned int overhead,
+                           unsigned int samples[KBENCH_SAMPLES])
+{
+    for (unsigned int i = 0; i < KBENCH_WARMUP + KBENCH_SAMPLES; i++) {
+        unsigned long long start, end;
+        unsigned int cycles;
+
+        if (c->reset) {
+            c->reset();
+        }
+        start = kbench_rdtsc();
+        c->run(c);
+        end = kbench_rdtsc();
+
+        cycles = (unsigned int)(end - start);
+        if (i >= KBENCH_WARMUP) {
+            samples[i - KBENCH_WARMUP] = cycles > overhead ? cycles - overhead : 0;
+        }
+    }
+    kbench_sort(samples, KBENCH_SAMPLES);
+}
+
+
+static void kbench_exit(unsigned char code)
+{
+    serial_flush();
+    outb(KBENCH_EXIT_PORT, code);
+    /* Still here: not QEMU, or no isa-debug-exit device */
+    for (;;) {
+        __asm__ volatile("cli\n\thlt");
+    }
+}
+
+
+void kbench_main(void)
+{
+    static const struct kbench_case empty = { "empty", 1, 0, run_empty, 0 };
+    unsigned int samples[KBENCH_SAMPLES];
+    unsigned int overhead;
+    unsigned int a, b, c, d;
+    char line[128];
+
+    if (cpu_has_cpuid()) {
+        cpuid(1, 0, &a, &b, &c, &d);
+        kbench_lfence = (d & CPUID_1_EDX_SSE2) != 0;
+    }
+    reset_buffers();
+
+    kbench_measure(&empty, 0, samples);
+    overhead = samples[0];
+    snprintf(line, sizeof(line), "\nkbench begin cases=%u samples=%u overhead=%u mem=%d\n",
+             (unsigned int)KBENCH_NUM_CASES, KBENCH_SAMPLES, overhead, mem_get_impl());
+    serial_write(line);
+
+    for (unsigned int i = 0; i < KBENCH_NUM_CASES; i++) {
+        const struct kbench_case *bc = &kbench_cases[i];
+
+        kbench_measure(bc, overhead, samples);
+        serial_flush();
+        snprintf(line, sizeof(line), "kbench %s calls=%u min=%u median=%u\n", bc->name, bc->calls,
+                 samples[0] / bc->calls, samples[KBENCH_SAMPLES / 2] / bc->calls);
+        serial_write(line);
+    }
+    serial_write("kbench end\n");
+    kbench_exit(KBENCH_EXIT_DONE);
+}
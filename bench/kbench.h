@@ -0,0 +1,29 @@
+#ifndef INCLUDE_KBENCH_H
+#define INCLUDE_KBENCH_H
+
+/*
+ * In-kernel micro-benchmarks, built into kernel_bench.elf only. kmain
+ * calls kbench_main once the kernel is up; every registered case is
+ * warmed up, timed KBENCH_SAMPLES times with a serialized rdtsc, and
+ * reported over COM1 as one line:
+ *
+ *     kbench <name> calls=<n> min=<cycles> median=<cycles>
+ *
+ * Cycles are per call, with the cost of the timing itself subtracted.
+ * QEMU is then told to exit through its isa-debug-exit device, which
+ * tools/kbench.py expects at KBENCH_EXIT_PORT.
+ */
+
+#define KBENCH_WARMUP           8           /* untimed samples before the timed ones */
+#define KBENCH_SAMPLES          31          /* timed samples per case; odd, for the median */
+#define KBENCH_EXIT_PORT        0xF4        /* -device isa-debug-exit,iobase=0xf4,iosize=4 */
+#define KBENCH_EXIT_DONE        0x00        /* QEMU exits with (value << 1) | 1, so 1 */
+
+
+/** kbench_main:
+ *  Runs every benchmark, reports the results over COM1 and exits QEMU.
+ *  Without the isa-debug-exit device it halts instead. Never returns.
+ */
+void kbench_main(void);
+
+#endif /* INCLUDE_KBENCH_H */
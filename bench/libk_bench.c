@@ -0,0 +1,281 @@
+/*
+ * libk_bench - host-native benchmarks for the kernel runtime library.
+ *
+ * c_files/src/string.c is compiled for the host (LIBK_HOSTED) and every
+ * routine is timed over a range of sizes and alignments. Results go to
+ * stdout as CSV (see bench_report_header), one line per case:
+ *
+ *     ./libk_bench            run everything
+ *     ./libk_bench memcpy     run only the cases of one routine
+ *
+ * Each case is calibrated to run for at least BENCH_MIN_NS, then repeated
+ * BENCH_RUNS times; the fastest run is reported.
+ */
+#include "string.h"
+#include "cpu.h"
+#include "bench_host.h"
+
+#define BENCH_MAX_SIZE  (1024 * 1024)
+#define BENCH_MAX_ALIGN 64
+#define BENCH_MIN_NS    2000000ULL      /* 2 ms per timed run */
+#define BENCH_RUNS      5
+
+static unsigned char bench_src[BENCH_MAX_SIZE + 2 * BENCH_MAX_ALIGN] __attribute__((aligned(64)));
+static unsigned char bench_dst[BENCH_MAX_SIZE + 2 * BENCH_MAX_ALIGN] __attribute__((aligned(64)));
+
+static const unsigned int bench_sizes[] = {
+    1, 7, 16, 64, 256, 1024, 4096, 16384, 65536, 262144, BENCH_MAX_SIZE
+};
+#define BENCH_NUM_SIZES (sizeof(bench_sizes) / sizeof(bench_sizes[0]))
+
+static const unsigned int bench_aligns[] = { 0, 1, 4 };
+#define BENCH_NUM_ALIGNS (sizeof(bench_aligns) / sizeof(bench_aligns[0]))
+
+static const char *mem_impl_names[] = {
+    [MEM_IMPL_BYTE] = "byte",
+    [MEM_IMPL_REP]  = "rep",
+    [MEM_IMPL_ERMS] = "erms",
+    [MEM_IMPL_SSE2] = "sse2",
+};
+
+/* Keeps results alive so the calls cannot be optimised away */
+volatile int bench_sink;
+
+
+/* One benchmark case: run() performs 'calls' calls of the routine */
+struct bench_case {
+    const char *routine;
+    const char *variant;
+    unsigned int size;
+    unsigned int align;
+    int value;
+    const char *format;
+    void (*run)(struct bench_case *c, unsigned long long calls);
+};
+
+
+static void run_strlen(struct bench_case *c, unsigned long long calls)
+{
+    const char *s = (const char *)bench_src + c->align;
+    while (calls--) {
+        bench_sink += strlen(s);
+    }
+}
+
+static void run_memcpy(struct bench_case *c, unsigned long long calls)
+{
+    while (calls--) {
+        memcpy(bench_dst, bench_src + c->align, c->size);
+    }
+}
+
+static void run_memmove(struct bench_case *c, unsigned long long calls)
+{
+    /* Overlapping, dest above src: the backward path */
+    while (calls--) {
+        memmove(bench_dst + c->align + 8, bench_dst, c->size);
+    }
+}
+
+static void run_memset(struct bench_case *c, unsigned long long calls)
+{
+    while (calls--) {
+        memset(bench_dst + c->align, c->value, c->size);
+    }
+}
+
+static void run_memcmp(struct bench_case *c, unsigned long long calls)
+{
+    while (calls--) {
+        bench_sink += memcmp(bench_dst, bench_src + c->align, c->size);
+    }
+}
+
+static void run_itoa(struct bench_case *c, unsigned long long calls)
+{
+    char buf[40];
+    int base = c->format[0] == 'x' ? 16 : 10;
+    while (calls--) {
+        bench_sink += itoa(c->value, buf, base)[0];
+    }
+}
+
+static void run_sprintf(struct bench_case *c, unsigned long long calls)
+{
+    char buf[256];
+    while (calls--) {
+        bench_sink += sprintf(buf, c->format, c->value, "String", 'A');
+    }
+}
+
+static void run_snprintf(struct bench_case *c, unsigned long long calls)
+{
+    char buf[32];
+    while (calls--) {
+        bench_sink += snprintf(buf, sizeof(buf), c->format, c->value, "String", 'A');
+    }
+}
+
+
+static void bench_run_case(struct bench_case *c)
+{
+    unsigned long long calls = 1;
+    unsigned long long best_ns = ~0ULL;
+    unsigned long long best_cycles = ~0ULL;
+    int i;
+
+    /* Warm up and find a call count that takes at least BENCH_MIN_NS */
+    for (;;) {
+        unsigned long long start = bench_now_ns();
+        c->run(c, calls);
+        if (bench_now_ns() - start >= BENCH_MIN_NS) {
+            break;
+        }
+        calls *= 2;
+    }
+
+    for (i = 0; i < BENCH_RUNS; i++) {
+        unsigned long long start_ns = bench_now_ns();
+        unsigned long long start_cycles = rdtsc();
+        c->run(c, calls);
+        unsigned long long cycles = rdtsc() - start_cycles;
+        unsigned long long ns = bench_now_ns() - start_ns;
+
+        if (ns < best_ns) {
+            best_ns = ns;
+        }
+        if (cycles < best_cycles) {
+            best_cycles = cycles;
+        }
+    }
+
+    bench_report(c->routine, c->variant, c->size, c->align, calls, best_ns, best_cycles);
+}
+
+
+static int bench_selected(const char *filter, const char *routine)
+{
+    return filter == 0 || strcmp(filter, routine) == 0;
+}
+
+
+static void bench_strings(const char *filter)
+{
+    struct bench_case c = { "strlen", "-", 0, 0, 0, 0, run_strlen };
+    unsigned int i, j;
+
+    if (!bench_selected(filter, c.routine)) {
+        return;
+    }
+    for (i = 0; i < BENCH_NUM_SIZES; i++) {
+        for (j = 0; j < BENCH_NUM_ALIGNS; j++) {
+            c.size = bench_sizes[i];
+            c.align = bench_aligns[j];
+            memset(bench_src, 'a', sizeof(bench_src));
+            bench_src[c.align + c.size] = '\0';
+            bench_run_case(&c);
+        }
+    }
+    memset(bench_src, 'a', sizeof(bench_src));
+}
+
+
+/* Runs c over every size and alignment */
+static void bench_sweep(struct bench_case *c)
+{
+    unsigned int i, j;
+
+    for (i = 0; i < BENCH_NUM_SIZES; i++) {
+        for (j = 0; j < BENCH_NUM_ALIGNS; j++) {
+            c->size = bench_sizes[i];
+            c->align = bench_aligns[j];
+            bench_run_case(c);
+        }
+    }
+}
+
+
+/* memcpy, memmove and memset once per usable MEM_IMPL_* */
+static void bench_memory(const char *filter)
+{
+    static struct bench_case cases[] = {
+        { "memcpy",  0, 0, 0, 0,    0, run_memcpy  },
+        { "memmove", 0, 0, 0, 0,    0, run_memmove },
+        { "memset",  0, 0, 0, 0x5A, 0, run_memset  },
+    };
+    unsigned int k;
+    int impl;
+    int initial = mem_get_impl();
+
+    for (k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+        if (!bench_selected(filter, cases[k].routine)) {
+            continue;
+        }
+        for (impl = MEM_IMPL_BYTE; impl <= MEM_IMPL_SSE2; impl++) {
+            if (mem_set_impl(impl) < 0) {
+                continue;
+            }
+            cases[k].variant = mem_impl_names[impl];
+            bench_sweep(&cases[k]);
+        }
+    }
+    mem_set_impl(initial);
+}
+
+
+/* memcmp has a single word-wide implementation; equal buffers are the worst case */
+static void bench_compare(const char *filter)
+{
+    struct bench_case c = { "memcmp", "word", 0, 0, 0, 0, run_memcmp };
+
+    if (!bench_selected(filter, c.routine)) {
+        return;
+    }
+    memset(bench_dst, 'a', sizeof(bench_dst));
+    bench_sweep(&c);
+}
+
+
+static void bench_format(const char *filter)
+{
+    static struct bench_case cases[] = {
+        { "itoa",    "base10", 1,  0, 7,          "d", run_itoa },
+        { "itoa",    "base10", 10, 0, 1234567890, "d", run_itoa },
+        { "itoa",    "base10", 10, 0, -123456789, "d", run_itoa },
+        { "itoa",    "base16", 8,  0, 0x7ABCDEF0, "x", run_itoa },
+        { "sprintf", "d",      4,  0, 1234,       "%d", run_sprintf },
+        { "sprintf", "x",      8,  0, 0x7ABCDEF0, "%x", run_sprintf },
+        { "sprintf", "literal", 48, 0, 0,
+          "OS loaded. Plain literal text with no specifiers", run_sprintf },
+        { "sprintf", "kmain",  49, 0, 1,
+          "OS loaded. Version: %d. Subsystem: %s. Code: %c", run_sprintf },
+        { "sprintf", "padded", 28, 0, -42,
+          "[%08d] [%-10s] [%5c]", run_sprintf },
+        { "snprintf", "truncated", 49, 0, 1,
+          "OS loaded. Version: %d. Subsystem: %s. Code: %c", run_snprintf },
+    };
+    unsigned int k;
+
+    for (k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+        if (bench_selected(filter, cases[k].routine)) {
+            bench_run_case(&cases[k]);
+        }
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : 0;
+
+    mem_init();
+    memset(bench_src, 'a', sizeof(bench_src));
+    memset(bench_dst, 'b', sizeof(bench_dst));
+
+    bench_report_header();
+    bench_strings(filter);
+    bench_memory(filter);
+    bench_compare(filter);
+    bench_format(filter);
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef INCLUDE_BOOT_TRACE_H
+#define INCLUDE_BOOT_TRACE_H
+
+/*
+ * Boot timeline. loader.s reads the TSC on its first instruction; kmain
+ * then calls boot_trace after each init stage, and boot_trace_print
+ * writes the whole table over COM1 once boot is done.
+ */
+
+#define BOOT_TRACE_MAX_STAGES   32          /* including the loader entry */
+
+
+/** boot_trace:
+ *  Records the TSC as the end of a stage. Stages past
+ *  BOOT_TRACE_MAX_STAGES are counted but not stored.
+ *
+ *  @param stage Name of the stage that just finished; must stay valid
+ *               (a string literal)
+ */
+void boot_trace(const char *stage);
+
+/** boot_trace_print:
+ *  Writes the timeline over COM1, one line per stage:
+ *
+ *    boot-trace: <stage> <end> <cycles> <percent>
+ *
+ *  end is in TSC cycles since loader entry, cycles is the stage's own
+ *  duration and percent its share of the total. The fields are separated
+ *  by spaces, so the lines can be read by eye or split by a script.
+ */
+void boot_trace_print(void);
+
+#endif /* INCLUDE_BOOT_TRACE_H */
@@ -0,0 +1,33 @@
+#ifndef INCLUDE_COMPILER_H
+#define INCLUDE_COMPILER_H
+
+/*
+ * Function placement, used by linker/link.ld to lay out .text:
+ *
+ *   __hot   on the interrupt, scheduling and allocation fast paths. Placed
+ *           in .text.hot, which the linker keeps together on shared cache
+ *           lines and pages.
+ *   __cold  on code that runs rarely or once: reports, fatal paths. Goes
+ *           to .text.unlikely, away from the rest.
+ *   __init  on boot-only code that runs before kmain's pmm_release_init.
+ *           .init.text is page aligned and its frames go back to the
+ *           allocator afterwards, so an __init function must not be called
+ *           (or its address taken) by anything that runs later.
+ */
+
+/*
+ * The sections are named explicitly: GCC only picks .text.hot and
+ * .text.unlikely by itself when it reorders functions (-O2), and the
+ * default -O0 build would leave everything in .text.
+ */
+#ifdef LIBK_HOSTED
+#define __hot               __attribute__((hot))
+#define __cold              __attribute__((cold))
+#define __init
+#else
+#define __hot               __attribute__((section(".text.hot"), hot))
+#define __cold              __attribute__((section(".text.unlikely"), cold))
+#define __init              __attribute__((section(".init.text"), cold))
+#endif
+
+#endif /* INCLUDE_COMPILER_H */
@@ -0,0 +1,260 @@
+#ifndef INCLUDE_CPU_H
+#define INCLUDE_CPU_H
+
+/* CPUID leaf 1, EDX feature bits */
+#define CPUID_1_EDX_PSE         (1 << 3)    /* 4 MiB pages */
+#define CPUID_1_EDX_PGE         (1 << 13)   /* Global pages */
+#define CPUID_1_EDX_SSE         (1 << 25)
+#define CPUID_1_EDX_SSE2        (1 << 26)
+
+/* CPUID leaf 7 (subleaf 0), EBX feature bits */
+#define CPUID_7_EBX_ERMS        (1 << 9)    /* Enhanced REP MOVSB/STOSB */
+
+/* EFLAGS bits */
+#define EFLAGS_IF               (1 << 9)    /* Interrupts enabled */
+#define EFLAGS_ID               (1 << 21)   /* Software can toggle it only if CPUID is supported */
+
+/* Control register bits */
+#define CR0_MP                  (1 << 1)    /* Monitor co-processor */
+#define CR0_EM                  (1 << 2)    /* x87 emulation, must be 0 for SSE */
+#define CR0_TS                  (1 << 3)    /* Task switched: next x87/SSE instruction raises #NM */
+#define CR0_PG                  (1u << 31)  /* Paging */
+#define CR4_PSE                 (1 << 4)    /* Page size extensions (4 MiB pages) */
+#define CR4_PGE                 (1 << 7)    /* Global pages survive CR3 reloads */
+#define CR4_OSFXSR              (1 << 9)    /* OS supports FXSAVE/FXRSTOR (enables SSE) */
+#define CR4_OSXMMEXCPT          (1 << 10)   /* OS handles SIMD floating point exceptions */
+
+
+/** cpu_has_cpuid:
+ *  Checks whether the CPUID instruction is available by trying to flip
+ *  EFLAGS.ID. Every 64-bit CPU has CPUID, so the check is 32-bit only.
+ *
+ *  @return 1 if CPUID is supported, 0 otherwise
+ */
+static inline int cpu_has_cpuid(void)
+{
+#if defined(__i386__)
+    unsigned int before, after;
+
+    __asm__ volatile(
+        "pushfl\n\t"
+        "pushfl\n\t"
+        "popl %0\n\t"
+        "movl %0, %1\n\t"
+        "xorl %2, %1\n\t"
+        "pushl %1\n\t"
+        "popfl\n\t"
+        "pushfl\n\t"
+        "popl %1\n\t"
+        "popfl"
+        : "=&r"(before), "=&r"(after)
+        : "i"(EFLAGS_ID)
+        : "cc");
+    return ((before ^ after) & EFLAGS_ID) != 0;
+#else
+    return 1;
+#endif
+}
+
+
+/** cpuid:
+ *  Executes CPUID for the given leaf and subleaf.
+ *
+ *  @param leaf     The value loaded into eax
+ *  @param subleaf  The value loaded into ecx
+ *  @param a,b,c,d  Receive eax, ebx, ecx and edx
+ */
+static inline void cpuid(unsigned int leaf, unsigned int subleaf,
+                         unsigned int *a, unsigned int *b,
+                         unsigned int *c, unsigned int *d)
+{
+    __asm__ volatile("cpuid"
+                     : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                     : "a"(leaf), "c"(subleaf));
+}
+
+
+/** rdtsc:
+ *  Reads the time-stamp counter.
+ *
+ *  @return The 64-bit cycle count
+ */
+static inline unsigned long long rdtsc(void)
+{
+    unsigned int lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+
+#ifndef LIBK_HOSTED
+
+static inline unsigned int read_cr0(void)
+{
+    unsigned int value;
+    __asm__ volatile("movl %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr0(unsigned int value)
+{
+    __asm__ volatile("movl %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline unsigned int read_cr3(void)
+{
+    unsigned int value;
+    __asm__ volatile("movl %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr3(unsigned int value)
+{
+    __asm__ volatile("movl %0, %%cr3" : : "r"(value) : "memory");
+}
+
+static inline unsigned int read_cr4(void)
+{
+    unsigned int value;
+    __asm__ volatile("movl %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(unsigned int value)
+{
+    __asm__ volatile("movl %0, %%cr4" : : "r"(value) : "memory");
+}
+
+
+/** invlpg:
+ *  Drops the TLB entry for the page containing addr, global or not.
+ */
+static inline void invlpg(const void *addr)
+{
+    __asm__ volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+
+/** clts:
+ *  Clears CR0.TS, so x87/SSE instructions run without raising #NM.
+ */
+static inline void clts(void)
+{
+    __asm__ volatile("clts");
+}
+
+
+/** irq_enable / irq_disable:
+ *  Set or clear the interrupt flag.
+ */
+static inline void irq_enable(void)
+{
+    __asm__ volatile("sti" : : : "memory");
+}
+
+static inline void irq_disable(void)
+{
+    __asm__ volatile("cli" : : : "memory");
+}
+
+
+/** irq_save:
+ *  Disables interrupts and returns the previous EFLAGS for irq_restore.
+ */
+static inline unsigned int irq_save(void)
+{
+    unsigned int flags;
+    __asm__ volatile("pushfl\n\tpopl %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+/** irq_restore:
+ *  Restores the interrupt flag saved by irq_save.
+ */
+static inline void irq_restore(unsigned int flags)
+{
+    __asm__ volatile("pushl %0\n\tpopfl" : : "r"(flags) : "memory", "cc");
+}
+
+
+/*
+ * Spinlocks, for data that other CPUs touch too. irq_save only keeps
+ * this CPU's interrupt handlers out; the lock keeps the other CPUs out.
+ * Hold one with interrupts off (spin_lock_irqsave), so a handler never
+ * spins on a lock its own CPU holds, and only for a few instructions.
+ */
+struct spinlock {
+    volatile unsigned int locked;
+};
+
+#define SPINLOCK_INIT { 0 }
+
+static inline void spin_lock(struct spinlock *lock)
+{
+    unsigned int old;
+
+    for (;;) {
+        __asm__ volatile("xchgl %0, %1" : "=r"(old), "+m"(lock->locked) : "0"(1) : "memory");
+        if (!old) {
+            return;
+        }
+        while (lock->locked) {
+            __asm__ volatile("pause" : : : "memory");
+        }
+    }
+}
+
+static inline void spin_unlock(struct spinlock *lock)
+{
+    /* x86 stores are not reordered with earlier loads and stores */
+    __asm__ volatile("" : : : "memory");
+    lock->locked = 0;
+}
+
+/** spin_lock_irqsave / spin_unlock_irqrestore:
+ *  irq_save and spin_lock, and the reverse.
+ */
+static inline unsigned int spin_lock_irqsave(struct spinlock *lock)
+{
+    unsigned int flags = irq_save();
+
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(struct spinlock *lock, unsigned int flags)
+{
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif /* LIBK_HOSTED */
+
+
+/** cpu_sse_enabled:
+ *  Checks whether SSE instructions may be executed right now, i.e. the
+ *  kernel has set CR4.OSFXSR (see cpu_enable_sse). A hosted build runs
+ *  under an OS that has already done this.
+ *
+ *  @return 1 if SSE is enabled, 0 otherwise
+ */
+static inline int cpu_sse_enabled(void)
+{
+#ifdef LIBK_HOSTED
+    return 1;
+#else
+    return (read_cr4() & CR4_OSFXSR) != 0;
+#endif
+}
+
+
+/** cpu_enable_sse:
+ *  Enables SSE if the CPU supports it: clears CR0.EM, sets CR0.MP and
+ *  sets CR4.OSFXSR / CR4.OSXMMEXCPT. Must run before mem_init() so the
+ *  SSE2 memory routines can be selected.
+ *
+ *  @return 1 if SSE was enabled, 0 if the CPU has no SSE
+ */
+int cpu_enable_sse(void);
+
+#endif /* INCLUDE_CPU_H */
@@ -38,22 +38,98 @@ struct gdt_ptr {
 } __attribute__((packed));
 
 /*
- * GDT_NUM_ENTRIES — total number of 8-byte descriptors in our GDT.
+ * GDT_NUM_ENTRIES — total number of 8-byte descriptors in each CPU's GDT.
  *   Index 0 : Null descriptor   (required by the CPU, must be all zeros)
  *   Index 1 : Kernel code segment  (selector = index * 8 = 0x08)
  *   Index 2 : Kernel data segment  (selector = index * 8 = 0x10)
+ *   Index 3 : Per-CPU data segment (selector = index * 8 = 0x18), loaded
+ *             into %gs; its base is the CPU's struct cpu (see percpu.h)
+ *   Index 4 : Task state segment   (selector = index * 8 = 0x20)
  *
  * Selector value = index * 8  because each descriptor is 8 bytes and
  * the lower 3 bits of a selector encode TI (bit 2) and RPL (bits 1-0).
+ * Every CPU has its own table, so the same selectors name a different
+ * per-CPU segment and TSS on each of them.
  */
-#define GDT_NUM_ENTRIES 3
+#define GDT_NUM_ENTRIES 5
 
 /* Segment selector constants — index * 8, with TI=0 (GDT) and RPL=00 (PL0) */
 #define GDT_KERNEL_CODE_SELECTOR 0x08  /* Index 1: 1 * 8 = 0x08 */
 #define GDT_KERNEL_DATA_SELECTOR 0x10  /* Index 2: 2 * 8 = 0x10 */
+#define GDT_PERCPU_SELECTOR      0x18  /* Index 3: 3 * 8 = 0x18 */
+#define GDT_TSS_SELECTOR         0x20  /* Index 4: 4 * 8 = 0x20 */
 
+/*
+ * 32-bit task state segment (Intel Manual Vol. 3A, Figure 7-2). The kernel
+ * does no hardware task switching; the CPU only reads esp0/ss0 from it
+ * when an interrupt arrives in a less privileged ring. Fields that hold a
+ * 16-bit selector are followed by 16 reserved bits.
+ */
+struct tss {
+    unsigned int prev_task;
+    unsigned int esp0;           /* Stack for interrupts from ring 3         */
+    unsigned int ss0;
+    unsigned int esp1, ss1, esp2, ss2;
+    unsigned int cr3, eip, eflags;
+    unsigned int eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    unsigned int es, cs, ss, ds, fs, gs;
+    unsigned int ldt;
+    unsigned short trap;
+    unsigned short iomap_base;   /* Offset of the I/O bitmap; >= limit: none */
+} __attribute__((packed));
+
+struct cpu;
+
+/** gdt_init:
+ *  Sets up and loads the bootstrap processor's GDT (gdt_init_cpu with
+ *  cpus[0]).
+ */
 void gdt_init(void);
 
+/** gdt_init_cpu:
+ *  Builds the GDT and TSS of one CPU, loads them and points %gs at the
+ *  CPU's struct cpu. Must run on that CPU.
+ */
+void gdt_init_cpu(struct cpu *cpu);
+
+
+/*
+ * IDT gate descriptor — 8 bytes (Intel Manual Vol. 3A, Figure 6-2).
+ *
+ *  Byte 7..6         Byte 5              Byte 4   Byte 3..2   Byte 1..0
+ * +----------------+---+---+---+------+--------+-----------+------------+
+ * | offset 31..16  | P |DPL| 0 | type |  zero  | selector  | offset 0..15|
+ * +----------------+---+---+---+------+--------+-----------+------------+
+ */
+struct idt_entry {
+    unsigned short offset_low;   /* Bits  0-15 of the handler address       */
+    unsigned short selector;     /* Code segment the handler runs in        */
+    unsigned char  zero;         /* Reserved, must be 0                     */
+    unsigned char  type_attr;    /* P, DPL and gate type                    */
+    unsigned short offset_high;  /* Bits 16-31 of the handler address       */
+} __attribute__((packed));
+
+/* IDTR pointer structure — passed to the lidt instruction, 6 bytes like gdt_ptr */
+struct idt_ptr {
+    unsigned short size;         /* sizeof(idt_entries) - 1                  */
+    unsigned int   address;      /* Linear address of idt_entry[0]          */
+} __attribute__((packed));
+
+#define IDT_NUM_ENTRIES 256
+
+/*
+ * 0x8E = 1000 1110: present, DPL 0, 32-bit interrupt gate. Interrupt
+ * gates clear IF on entry, so handlers are never nested.
+ */
+#define IDT_INTERRUPT_GATE 0x8E
+
+void idt_init(void);
+
+/** idt_load:
+ *  Loads the IDT built by idt_init on the calling CPU.
+ */
+void idt_load(void);
+
 #endif /* DESCRIPTOR_H */
 
 
@@ -0,0 +1,56 @@
+#ifndef INCLUDE_FBCON_H
+#define INCLUDE_FBCON_H
+
+#include "multiboot.h"
+
+/*
+ * Text console on a linear framebuffer. It draws the same FB_COLUMNS x
+ * FB_ROWS cells that stdio.c keeps in its shadow buffer, so putchar,
+ * puts and the scrollback work unchanged; fb_flush hands the dirty cells
+ * here instead of copying them to VGA text memory.
+ *
+ * Glyphs are the 8x8 font doubled vertically. For each colour attribute
+ * in use, a glyph cache holds all 256 possible font rows already
+ * expanded to 8 pixels, so drawing a cell is a table lookup and two
+ * 16-byte stores per pixel row.
+ */
+
+#define FBCON_CELL_WIDTH        8
+#define FBCON_CELL_HEIGHT       16          /* every font row drawn twice */
+#define FBCON_BPP               32          /* the only pixel format drawn */
+#define FBCON_ATTR_SLOTS        8           /* colour attributes cached at once, 8 KiB each */
+#define FBCON_CURSOR_HEIGHT     2           /* underline, in pixel rows */
+
+
+/** fbcon_init:
+ *  Takes over the console if the boot loader set up a 32 bpp RGB linear
+ *  framebuffer of at least FB_COLUMNS x FB_ROWS cells, and redraws the
+ *  screen from stdio's shadow buffer. Needs pmm_init (mapping the
+ *  framebuffer may need page tables).
+ *
+ *  @param mbi The multiboot info, already through phys_to_virt
+ *  @return    0 if the console now draws on the framebuffer, -1 if it
+ *             stays in VGA text mode
+ */
+int fbcon_init(struct multiboot_info *mbi);
+
+/** fbcon_active:
+ *  @return Nonzero once fbcon_init has taken over the console
+ */
+int fbcon_active(void);
+
+/** fbcon_draw_cell:
+ *  Draws a cell unless the screen already shows it.
+ *
+ *  @param col  Column, 0 to FB_COLUMNS - 1
+ *  @param row  Row of the screen, 0 to FB_ROWS - 1
+ *  @param cell character | VGA attribute << 8, as in stdio's shadow
+ */
+void fbcon_draw_cell(unsigned int col, unsigned int row, unsigned short cell);
+
+/** fbcon_set_cursor:
+ *  Moves the underline cursor. A row of FB_ROWS or more hides it.
+ */
+void fbcon_set_cursor(unsigned int col, unsigned int row);
+
+#endif /* INCLUDE_FBCON_H */
@@ -0,0 +1,18 @@
+#ifndef INCLUDE_FONT_H
+#define INCLUDE_FONT_H
+
+/*
+ * 8x8 bitmap font for printable ASCII (font8x8_basic, public domain,
+ * drawn after the IBM PC BIOS font). One byte per row, top row first;
+ * bit 0 is the leftmost pixel.
+ */
+
+#define FONT_WIDTH              8
+#define FONT_HEIGHT             8
+#define FONT_FIRST_CHAR         0x20
+#define FONT_LAST_CHAR          0x7E
+#define FONT_NUM_GLYPHS         (FONT_LAST_CHAR - FONT_FIRST_CHAR + 1)
+
+extern const unsigned char font8x8[FONT_NUM_GLYPHS][FONT_HEIGHT];
+
+#endif /* INCLUDE_FONT_H */
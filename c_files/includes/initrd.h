@@ -0,0 +1,57 @@
+#ifndef INCLUDE_INITRD_H
+#define INCLUDE_INITRD_H
+
+#include "multiboot.h"
+
+/*
+ * Read-only files from an archive that GRUB loads as the first module
+ * (menu.lst: module /boot/initrd.tar). initrd_init indexes the archive
+ * once into a hash table of path -> (pointer, size); lookups then return
+ * pointers into the module itself, so reading a file copies nothing.
+ * The archive may be a ustar tar or a "newc" cpio (070701).
+ */
+
+#define INITRD_MAX_FILES        256
+#define INITRD_HASH_SLOTS       512         /* power of two, 2x INITRD_MAX_FILES */
+
+
+/** initrd_init:
+ *  Finds the first multiboot module and indexes the files in it. Only
+ *  regular files are kept; directories and links are skipped, and files
+ *  past INITRD_MAX_FILES are dropped. Needs pmm_init (the module stays
+ *  reserved) and must run before smp_init, which may overwrite the
+ *  module list.
+ *
+ *  @param mbi The multiboot info, already through phys_to_virt
+ *  @return    The number of files indexed, or -1 if there is no module or
+ *             it is not an archive
+ */
+int initrd_init(struct multiboot_info *mbi);
+
+/** initrd_open:
+ *  Looks up a file by path. A leading "/" or "./" is ignored, so "/etc/motd"
+ *  and "etc/motd" name the same file.
+ *
+ *  @param path The path of the file
+ *  @param size Set to the file size if the file exists; may be 0
+ *  @return     The file's bytes inside the module (not NUL-terminated), or
+ *              0 if there is no such file
+ */
+const void *initrd_open(const char *path, unsigned int *size);
+
+/** initrd_file_count:
+ *  @return The number of files initrd_init indexed
+ */
+unsigned int initrd_file_count(void);
+
+/** initrd_file_name:
+ *  Gives the path of the index-th file, in archive order, for listing.
+ *
+ *  @param index 0 to initrd_file_count() - 1
+ *  @param len   Set to the length of the path, which is not
+ *               NUL-terminated
+ *  @return      The path, or 0 if index is out of range
+ */
+const char *initrd_file_name(unsigned int index, unsigned int *len);
+
+#endif /* INCLUDE_INITRD_H */
@@ -0,0 +1,95 @@
+#ifndef INCLUDE_INTERRUPT_H
+#define INCLUDE_INTERRUPT_H
+
+/* Vectors 0-31 are CPU exceptions, the PIC IRQs are remapped right after them */
+#define INTERRUPT_NUM_EXCEPTIONS    32
+#define IRQ_BASE_VECTOR             0x20
+#define IRQ_VECTOR(irq)             (IRQ_BASE_VECTOR + (irq))
+#define INTERRUPT_NUM_VECTORS       48      /* vectors with an entry stub, see asm/interrupt.s */
+#define INTERRUPT_BACKTRACE_DEPTH   16      /* callers printed for an unhandled exception */
+
+/* CPU exceptions */
+#define EXCEPTION_DIVIDE_ERROR      0
+#define EXCEPTION_DEBUG             1
+#define EXCEPTION_NMI               2
+#define EXCEPTION_BREAKPOINT        3
+#define EXCEPTION_INVALID_OPCODE    6
+#define EXCEPTION_DEVICE_NOT_AVAIL  7
+#define EXCEPTION_DOUBLE_FAULT      8
+#define EXCEPTION_GENERAL_PROTECTION 13
+#define EXCEPTION_PAGE_FAULT        14
+#define EXCEPTION_SIMD_FP           19
+
+/* Legacy IRQ lines */
+#define IRQ_TIMER                   0
+#define IRQ_KEYBOARD                1
+#define IRQ_COM2                    3
+#define IRQ_COM1                    4
+
+
+/*
+ * What the entry stub leaves on the stack. Only the caller-saved registers
+ * are saved (ebp is a copy, for backtraces); the rest still hold the
+ * interrupted code's values.
+ */
+struct interrupt_frame {
+    unsigned int ebp;
+    unsigned int edx;
+    unsigned int ecx;
+    unsigned int eax;
+    unsigned int vector;
+    unsigned int error_code;        /* 0 unless the CPU pushed one */
+    unsigned int eip;
+    unsigned int cs;
+    unsigned int eflags;
+};
+
+typedef void (*interrupt_handler_t)(struct interrupt_frame *frame);
+
+struct interrupt_stats {
+    unsigned int count;             /* times the vector was taken */
+    unsigned int max_cycles;        /* most expensive single dispatch */
+    unsigned long long cycles;      /* TSC cycles spent in dispatch, handler included */
+};
+
+
+/** interrupt_init:
+ *  Loads the IDT (idt_init) and remaps the PIC to IRQ_BASE_VECTOR, with all
+ *  IRQs masked. Interrupts stay disabled until the caller runs irq_enable.
+ */
+void interrupt_init(void);
+
+/** interrupt_register:
+ *  Installs the handler for a vector, replacing any previous one. For an
+ *  IRQ vector this also unmasks the line at the PIC. Handlers run with
+ *  interrupts disabled and must not use SSE registers (see
+ *  mem_simd_disabled in string.h); the PIC EOI is done for them.
+ *
+ *  @param vector  0 to INTERRUPT_NUM_VECTORS - 1
+ *  @param handler The function to call, or 0 to remove the handler (and
+ *                 mask the IRQ)
+ */
+void interrupt_register(unsigned int vector, interrupt_handler_t handler);
+
+/** interrupt_dispatch:
+ *  Called by the entry stubs in asm/interrupt.s.
+ */
+void interrupt_dispatch(struct interrupt_frame *frame);
+
+/** interrupt_stats:
+ *  Copies the count and cycle counters of one vector.
+ */
+void interrupt_stats(unsigned int vector, struct interrupt_stats *stats);
+
+/** interrupt_spurious_count:
+ *  The number of spurious IRQs (on IRQ 7 without a handler, or IRQ 15)
+ *  that were dropped without reaching a handler.
+ */
+unsigned int interrupt_spurious_count(void);
+
+/** interrupt_print_stats:
+ *  Writes count, total and average cycles of every vector that was taken.
+ */
+void interrupt_print_stats(void);
+
+#endif /* INCLUDE_INTERRUPT_H */
@@ -0,0 +1,126 @@
+#ifndef INCLUDE_IO_H
+#define INCLUDE_IO_H
+
+/*
+ * x86 port I/O. Everything here is static inline so a port access compiles
+ * to the bare in/out instruction, with the port in dx (or an immediate)
+ * and no call, stack reload or ret around it.
+ */
+
+/* Unused port the BIOS POST code goes to; writing it takes ~1 us */
+#define IO_WAIT_PORT    0x80
+
+
+/** outb:
+ *  Write a byte to an I/O port.
+ *
+ *  @param  port The address of the I/O port
+ *  @param  data The byte to write
+ */
+static inline void outb(unsigned short port, unsigned char data)
+{
+    __asm__ volatile("outb %0, %1" : : "a"(data), "Nd"(port));
+}
+
+/** inb:
+ *  Read a byte from an I/O port.
+ *
+ *  @param  port The address of the I/O port
+ *  @return      The read byte
+ */
+static inline unsigned char inb(unsigned short port)
+{
+    unsigned char data;
+    __asm__ volatile("inb %1, %0" : "=a"(data) : "Nd"(port));
+    return data;
+}
+
+/** outw:
+ *  Write a 16-bit word to an I/O port. For index/data register pairs such
+ *  as the VGA CRTC, the low byte goes to port and the high byte to port + 1.
+ */
+static inline void outw(unsigned short port, unsigned short data)
+{
+    __asm__ volatile("outw %0, %1" : : "a"(data), "Nd"(port));
+}
+
+/** inw:
+ *  Read a 16-bit word from an I/O port.
+ */
+static inline unsigned short inw(unsigned short port)
+{
+    unsigned short data;
+    __asm__ volatile("inw %1, %0" : "=a"(data) : "Nd"(port));
+    return data;
+}
+
+/** outl:
+ *  Write a 32-bit double word to an I/O port.
+ */
+static inline void outl(unsigned short port, unsigned int data)
+{
+    __asm__ volatile("outl %0, %1" : : "a"(data), "Nd"(port));
+}
+
+/** inl:
+ *  Read a 32-bit double word from an I/O port.
+ */
+static inline unsigned int inl(unsigned short port)
+{
+    unsigned int data;
+    __asm__ volatile("inl %1, %0" : "=a"(data) : "Nd"(port));
+    return data;
+}
+
+/** io_wait:
+ *  Waits roughly one microsecond by writing to an unused port. Old
+ *  devices such as the 8259 PIC need this between consecutive commands.
+ */
+static inline void io_wait(void)
+{
+    outb(IO_WAIT_PORT, 0);
+}
+
+
+/*
+ * Bulk string I/O: one rep ins/outs moves a whole buffer between memory
+ * and a port (ATA/ATAPI data registers, UART FIFOs) without a loop.
+ */
+
+/** outsb:
+ *  Write count bytes from buf to an I/O port.
+ */
+static inline void outsb(unsigned short port, const void *buf, unsigned int count)
+{
+    unsigned long n = count;
+    __asm__ volatile("rep outsb" : "+S"(buf), "+c"(n) : "d"(port) : "memory");
+}
+
+/** insb:
+ *  Read count bytes from an I/O port into buf.
+ */
+static inline void insb(unsigned short port, void *buf, unsigned int count)
+{
+    unsigned long n = count;
+    __asm__ volatile("rep insb" : "+D"(buf), "+c"(n) : "d"(port) : "memory");
+}
+
+/** outsw:
+ *  Write count 16-bit words from buf to an I/O port.
+ */
+static inline void outsw(unsigned short port, const void *buf, unsigned int count)
+{
+    unsigned long n = count;
+    __asm__ volatile("rep outsw" : "+S"(buf), "+c"(n) : "d"(port) : "memory");
+}
+
+/** insw:
+ *  Read count 16-bit words from an I/O port into buf.
+ */
+static inline void insw(unsigned short port, void *buf, unsigned int count)
+{
+    unsigned long n = count;
+    __asm__ volatile("rep insw" : "+D"(buf), "+c"(n) : "d"(port) : "memory");
+}
+
+#endif /* INCLUDE_IO_H */
@@ -0,0 +1,85 @@
+#ifndef INCLUDE_JUMP_LABEL_H
+#define INCLUDE_JUMP_LABEL_H
+
+/*
+ * Static keys: branches that are patched in the code instead of tested at
+ * run time. Each static_branch() site is a 5-byte nop, so the "on" path
+ * costs nothing. Turning the key off rewrites the nop into a jmp around
+ * the guarded code. Every site records (nop address, jump target, key) in
+ * the __jump_table section, collected by linker/link.ld.
+ */
+
+struct static_key {
+    int enabled;
+};
+
+/* One __jump_table entry, emitted by static_branch */
+struct jump_entry {
+    unsigned int code;          /* address of the 5-byte nop/jmp; 0 once released */
+    unsigned int target;        /* where the jmp goes while the key is off */
+    struct static_key *key;
+};
+
+#define STATIC_KEY_INIT_ON  { 1 }
+#define STATIC_KEY_INIT_OFF { 0 }
+
+
+/** static_branch:
+ *  Evaluates to 1 while key is enabled and 0 otherwise, without reading
+ *  the key. A macro rather than an inline function so the key address
+ *  stays a link-time constant even at -O0.
+ *
+ *  @param key  Address of a static struct static_key
+ */
+#define static_branch(key)                                                  \
+    ({                                                                      \
+        __label__ l_off, l_done;                                            \
+        int on_ = 1;                                                        \
+        __asm__ goto("1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"            \
+                     ".pushsection __jump_table, \"aw\"\n\t"                \
+                     ".balign 4\n\t"                                        \
+                     ".long 1b, %l[l_off], %c0\n\t"                         \
+                     ".popsection"                                          \
+                     : : "i"(key) : : l_off);                               \
+        goto l_done;                                                        \
+    l_off:                                                                  \
+        on_ = 0;                                                            \
+    l_done:                                                                 \
+        on_;                                                                \
+    })
+
+
+/** jump_label_init:
+ *  Patches every static_branch site to match its key's initial state.
+ *  Until this runs, all branches behave as enabled.
+ */
+void jump_label_init(void);
+
+
+/** jump_label_release:
+ *  Forgets every static_branch site in [start, end), so no later
+ *  static_key_enable or static_key_disable patches code that is gone.
+ *  For pmm_release_init, before it gives .init.text away.
+ *
+ *  @param start  First address of the released code
+ *  @param end    Address just past it
+ */
+void jump_label_release(unsigned int start, unsigned int end);
+
+
+/** static_key_enable:
+ *  Turns key on and patches its sites to the nop.
+ *
+ *  @param key  The key
+ */
+void static_key_enable(struct static_key *key);
+
+
+/** static_key_disable:
+ *  Turns key off and patches its sites to jump over the guarded code.
+ *
+ *  @param key  The key
+ */
+void static_key_disable(struct static_key *key);
+
+#endif /* INCLUDE_JUMP_LABEL_H */
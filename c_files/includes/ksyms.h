@@ -0,0 +1,61 @@
+#ifndef INCLUDE_KSYMS_H
+#define INCLUDE_KSYMS_H
+
+/*
+ * In-kernel symbol table, so addresses can be printed as func+0x1c on the
+ * target. The table lives in a reserved, zero-filled section (.ksyms) of
+ * KSYMS_MAX_SIZE bytes; after linking, tools/ksyms.py writes the code
+ * symbols of kernel.elf into it. Until then every lookup fails and
+ * addresses print as plain hex.
+ *
+ * Layout, little-endian:
+ *   struct ksyms_header
+ *   unsigned int   addrs[count]       ascending start addresses
+ *   unsigned short names[count]       offset into the string pool, or
+ *                                     KSYMS_NO_NAME for a gap between
+ *                                     functions
+ *   char           pool[names_size]   NUL-terminated names; a name that
+ *                                     is the tail of another one shares
+ *                                     its bytes
+ * A symbol runs from its address to the next entry's.
+ */
+
+#define KSYMS_MAX_SIZE          16384
+#define KSYMS_MAGIC             0x4D59534B  /* "KSYM" */
+#define KSYMS_NO_NAME           0xFFFF
+
+struct ksyms_header {
+    unsigned int magic;
+    unsigned int count;
+    unsigned int names_size;
+};
+
+
+/** ksyms_lookup:
+ *  Finds the function containing an address, by binary search.
+ *
+ *  @param addr   Any address
+ *  @param offset Set to addr minus the start of the function; may be 0
+ *  @return       The function's name, or 0 if addr is in no known function
+ */
+const char *ksyms_lookup(unsigned int addr, unsigned int *offset);
+
+/** ksyms_snprint:
+ *  Formats an address as "func+0x1c", or as "0x..." if it is not in a
+ *  known function.
+ *
+ *  @return The number of characters written, as snprintf
+ */
+int ksyms_snprint(char *buf, unsigned int size, unsigned int addr);
+
+/** ksyms_backtrace:
+ *  Logs eip and the return addresses found by following the frame
+ *  pointer chain from ebp, one "  #n func+0x1c" line each (log_printf).
+ *
+ *  @param eip       Where the code was, the first line
+ *  @param ebp       Its frame pointer
+ *  @param max_depth Return addresses to print at most
+ */
+void ksyms_backtrace(unsigned int eip, unsigned int ebp, unsigned int max_depth);
+
+#endif /* INCLUDE_KSYMS_H */
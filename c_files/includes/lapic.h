@@ -0,0 +1,47 @@
+#ifndef INCLUDE_LAPIC_H
+#define INCLUDE_LAPIC_H
+
+/* Default physical address of the local APIC registers (MADT/MP tables may move it) */
+#define LAPIC_DEFAULT_BASE      0xFEE00000
+
+/* Register offsets */
+#define LAPIC_REG_ID            0x020
+#define LAPIC_REG_VERSION       0x030
+#define LAPIC_REG_ICR_LOW       0x300
+#define LAPIC_REG_ICR_HIGH      0x310
+
+/* Interrupt command register bits */
+#define LAPIC_ICR_INIT          0x00000500  /* Delivery mode INIT */
+#define LAPIC_ICR_STARTUP       0x00000600  /* Delivery mode start-up, vector = page number */
+#define LAPIC_ICR_PENDING       0x00001000  /* Delivery status: send pending */
+#define LAPIC_ICR_ASSERT        0x00004000
+#define LAPIC_ICR_LEVEL         0x00008000  /* Level triggered (INIT de-assert) */
+
+
+/** lapic_init:
+ *  Maps the local APIC registers (uncached). The APIC is left software
+ *  disabled: the kernel takes its interrupts from the PIC and only needs
+ *  the APIC to read IDs and send the start-up IPIs, which works either way.
+ *
+ *  @param phys Physical address of the registers
+ *  @return 0 on success, -1 if they could not be mapped
+ */
+int lapic_init(unsigned int phys);
+
+/** lapic_id:
+ *  @return The APIC ID of the calling CPU
+ */
+unsigned int lapic_id(void);
+
+/** lapic_send_init / lapic_send_startup:
+ *  Send an INIT IPI (assert, then de-assert for older CPUs), or a start-up
+ *  IPI that makes the target begin in real mode at page << 12. Both wait
+ *  until the APIC has delivered the message.
+ *
+ *  @param apic_id Destination CPU
+ *  @param page    Physical page number of the start-up code, below 0x100
+ */
+void lapic_send_init(unsigned int apic_id);
+void lapic_send_startup(unsigned int apic_id, unsigned int page);
+
+#endif /* INCLUDE_LAPIC_H */
@@ -1,11 +1,14 @@
 #ifndef INCLUDE_LOG_H
 #define INCLUDE_LOG_H
 
+#include "jump_label.h"
+
 
 /* Log output devices */
-#define LOG_FB      0       /* Framebuffer */
+#define LOG_FB      0       /* Framebuffer, on virtual console FB_CONSOLE_LOG */
 #define LOG_SERIAL  1       /* Serial port (COM1) */
 #define LOG_ALL     2       /* Both framebuffer and serial */
+#define LOG_BINARY  3       /* Binary records in memory, see log_dump_records */
 
 
 /* Log severity levels */
@@ -13,26 +16,61 @@
 #define LOG_LEVEL_INFO      1
 #define LOG_LEVEL_WARNING   2
 #define LOG_LEVEL_ERROR     3
+#define LOG_NUM_LEVELS      4
+#define LOG_RECORD_NO_LEVEL 0xFF    /* Record level of log_printf output */
+
+
+/*
+ * LOG_COMPILE_LEVEL:
+ *  log_debug..log_error calls below this level compile to nothing (the
+ *  arguments are still type-checked). Set from CMake.
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL   LOG_LEVEL_DEBUG
+#endif
+
+
+/* Binary record ring (LOG_BINARY) */
+#define LOG_RING_WORDS          4096        /* 16 KiB of records */
+#define LOG_RECORD_MAX_WORDS    32          /* Longest record, header included */
+#define LOG_DUMP_MAGIC          0x474F4C4B  /* "KLOG" in memory order */
 
 
 /** log_init:
  *  Initializes the logging system. Sets up the serial port if needed.
  *
- *  @param device  The output device (LOG_FB, LOG_SERIAL, LOG_ALL)
+ *  @param device  The output device (LOG_FB, LOG_SERIAL, LOG_ALL, LOG_BINARY)
  */
 void log_init(int device);
 
 
 /** log_set_device:
- *  Changes the current log output device.
+ *  Changes the current log output device: switches the "fb" and "com1"
+ *  log sinks on or off to match (see log_sink.h).
  *
- *  @param device  The output device (LOG_FB, LOG_SERIAL, LOG_ALL)
+ *  @param device  The output device (LOG_FB, LOG_SERIAL, LOG_ALL, LOG_BINARY)
  */
 void log_set_device(int device);
 
 
+/** log_set_level:
+ *  Sets the minimum level that is logged at run time. Messages below it
+ *  return before their arguments are looked at; at call sites the check
+ *  is a patched static branch (see log_level_keys).
+ *
+ *  @param level  LOG_LEVEL_DEBUG .. LOG_LEVEL_ERROR
+ */
+void log_set_level(int level);
+
+
+/** log_get_level:
+ *  @return The minimum level currently logged
+ */
+int log_get_level(void);
+
+
 /** log_putchar:
- *  Writes a single character to the current log device(s).
+ *  Queues a single character on the enabled log sinks.
  *
  *  @param c  The character to write
  */
@@ -40,7 +78,7 @@ void log_putchar(char c);
 
 
 /** log_puts:
- *  Writes a null-terminated string to the current log device(s).
+ *  Queues a null-terminated string on the enabled log sinks.
  *
  *  @param buf  The null-terminated string
  */
@@ -49,7 +87,8 @@ void log_puts(char *buf);
 
 /** log_printf:
  *  A printf-like function that formats a string and writes it to the
- *  current log device(s). Supports %d, %x, %s, %c, %%.
+ *  current log device(s). Accepts the same conversions as sprintf
+ *  (see string.h).
  *
  *  @param format  The format string
  *  @param ...     The arguments to format
@@ -58,13 +97,38 @@ void log_puts(char *buf);
 int log_printf(char *format, ...);
 
 
+/*
+ * log_level_keys:
+ *  One static key per level, on while that level is logged. The
+ *  log_debug..log_error macros below test it with a patched nop/jmp, so a
+ *  disabled call site costs a single jump. The functions themselves, e.g.
+ *  (log_debug)(...), check the level again for callers that bypass the
+ *  macros.
+ */
+extern struct static_key log_level_keys[LOG_NUM_LEVELS];
+
+#define LOG_AT(level, fn, ...)                                              \
+    do {                                                                    \
+        if (static_branch(&log_level_keys[level])) {                        \
+            (fn)(__VA_ARGS__);                                              \
+        }                                                                   \
+    } while (0)
+
+#define LOG_COMPILED_OUT(fn, ...)                                           \
+    do {                                                                    \
+        if (0) {                                                            \
+            (fn)(__VA_ARGS__);                                              \
+        }                                                                   \
+    } while (0)
+
+
 /** log_debug:
  *  Logs a message at DEBUG level.
  *
  *  @param format  The format string
  *  @param ...     The arguments to format
  */
-void log_debug(char *format, ...);
+void (log_debug)(char *format, ...);
 
 
 /** log_info:
@@ -73,7 +137,7 @@ void log_debug(char *format, ...);
  *  @param format  The format string
  *  @param ...     The arguments to format
  */
-void log_info(char *format, ...);
+void (log_info)(char *format, ...);
 
 
 /** log_warning:
@@ -82,7 +146,7 @@ void log_info(char *format, ...);
  *  @param format  The format string
  *  @param ...     The arguments to format
  */
-void log_warning(char *format, ...);
+void (log_warning)(char *format, ...);
 
 
 /** log_error:
@@ -91,7 +155,41 @@ void log_warning(char *format, ...);
  *  @param format  The format string
  *  @param ...     The arguments to format
  */
-void log_error(char *format, ...);
+void (log_error)(char *format, ...);
+
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define log_debug(...)   LOG_AT(LOG_LEVEL_DEBUG, log_debug, __VA_ARGS__)
+#else
+#define log_debug(...)   LOG_COMPILED_OUT(log_debug, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define log_info(...)    LOG_AT(LOG_LEVEL_INFO, log_info, __VA_ARGS__)
+#else
+#define log_info(...)    LOG_COMPILED_OUT(log_info, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARNING
+#define log_warning(...) LOG_AT(LOG_LEVEL_WARNING, log_warning, __VA_ARGS__)
+#else
+#define log_warning(...) LOG_COMPILED_OUT(log_warning, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+#define log_error(...)   LOG_AT(LOG_LEVEL_ERROR, log_error, __VA_ARGS__)
+#else
+#define log_error(...)   LOG_COMPILED_OUT(log_error, __VA_ARGS__)
+#endif
+
+
+/** log_dump_records:
+ *  Sends every binary record collected in LOG_BINARY mode to COM1 and
+ *  empties the ring. The dump is three 32-bit words (LOG_DUMP_MAGIC,
+ *  number of record words, records overwritten) followed by the records;
+ *  tools/klog_decode.py turns it back into text using kernel.elf.
+ */
+void log_dump_records(void);
 
 
 #endif /* INCLUDE_LOG_H */
@@ -0,0 +1,147 @@
+#ifndef INCLUDE_LOG_SINK_H
+#define INCLUDE_LOG_SINK_H
+
+#include "cpu.h"
+
+/*
+ * Log sinks: every device text output goes to has its own byte queue.
+ * A log call copies the message into the queue of each enabled sink and
+ * returns; the klogd thread (log_start_thread) hands the queued bytes to
+ * the devices, each as fast as it takes them, so a slow UART no longer
+ * holds the framebuffer back. Until klogd runs, and on the fatal path
+ * (log_flush), writers drain the queues themselves. Any CPU may log;
+ * klogd and the devices are only driven from the bootstrap processor.
+ *
+ * The built-in sinks are "fb" (virtual console FB_CONSOLE_LOG), "com1" to
+ * "com4" and "mem", a ring that only keeps the latest output for
+ * log_sink_read. See log.md.
+ */
+
+/* What a write does when the sink's queue has no room for it */
+#define LOG_SINK_BLOCK          0   /* drain the sink until it fits */
+#define LOG_SINK_DROP_OLDEST    1   /* discard whole lines from the front */
+#define LOG_SINK_DROP_NEWEST    2   /* discard the message being written */
+
+#define LOG_MAX_SINKS           8
+#define LOG_SINK_QUEUE_SIZE     4096        /* per device sink, power of two */
+#define LOG_MEM_RING_SIZE       16384       /* the "mem" sink, power of two */
+
+struct log_iovec {
+    const void *base;
+    unsigned int len;
+};
+
+struct log_sink;
+
+/*
+ * Hands bytes to the device without waiting, and returns how many it took;
+ * 0 if it is busy. A sink without one (the memory ring) only ever queues.
+ */
+typedef unsigned int (*log_sink_write_t)(struct log_sink *sink, const void *buf, unsigned int len);
+
+/*
+ * head and tail run freely and are masked on access, as in the serial
+ * transmit ring: writers move head, the drain side moves tail, both with
+ * lock held and interrupts off. queue holds size bytes.
+ */
+struct log_sink {
+    struct spinlock lock;
+    const char *name;
+    log_sink_write_t write;
+    void (*wait)(struct log_sink *sink);    /* until write takes more; may be 0 */
+    void *ctx;
+    unsigned int policy;
+    unsigned int enabled;
+    volatile unsigned int head;
+    volatile unsigned int tail;
+    volatile unsigned int draining;
+    unsigned int size;
+    unsigned char *queue;
+    unsigned int dropped;       /* bytes lost to either drop policy */
+    unsigned int blocked;       /* writes that had to drain first */
+};
+
+
+/** log_sink_register:
+ *  Adds a sink to the registry. The caller fills in name, write, ctx,
+ *  policy, size and queue (size a power of two); the counters start at 0.
+ *
+ *  @param sink  The sink, which must stay valid
+ *  @return      0, or -1 if LOG_MAX_SINKS are registered
+ */
+int log_sink_register(struct log_sink *sink);
+
+/** log_sink_find:
+ *  @param name  "fb", "com1" .. "com4", "mem", or a registered name
+ *  @return      The sink, or 0
+ */
+struct log_sink *log_sink_find(const char *name);
+
+/** log_sink_enable:
+ *  Switches a sink on or off. A disabled sink keeps what it has queued
+ *  and still drains it.
+ *
+ *  @param sink     The sink
+ *  @param enabled  1 to receive log output, 0 to stop
+ */
+void log_sink_enable(struct log_sink *sink, int enabled);
+
+/** log_sink_set_policy:
+ *  @param sink    The sink
+ *  @param policy  LOG_SINK_BLOCK, LOG_SINK_DROP_OLDEST or LOG_SINK_DROP_NEWEST
+ */
+void log_sink_set_policy(struct log_sink *sink, unsigned int policy);
+
+/** log_sink_writev:
+ *  Queues the pieces as one message: either all of them land in the
+ *  sink's queue, back to back, or (LOG_SINK_DROP_NEWEST) none does.
+ *  Costs a copy; the device sees the bytes when the sink is drained.
+ *
+ *  @param sink  The sink
+ *  @param iov   The pieces, in order
+ *  @param n     Number of pieces
+ *  @return      The number of bytes queued
+ */
+unsigned int log_sink_writev(struct log_sink *sink, const struct log_iovec *iov, unsigned int n);
+
+/** log_sinks_writev:
+ *  log_sink_writev to every enabled sink, then wakes klogd (or, before it
+ *  runs, drains the sinks right away).
+ */
+void log_sinks_writev(const struct log_iovec *iov, unsigned int n);
+
+/** log_sink_drain:
+ *  Hands as much of the sink's queue to its device as it takes now.
+ *  Does nothing if another caller is in the middle of draining it.
+ *
+ *  @param sink  The sink
+ *  @return      The number of bytes the device took
+ */
+unsigned int log_sink_drain(struct log_sink *sink);
+
+/** log_sink_read:
+ *  Copies the oldest queued bytes of a sink without a device (the
+ *  memory ring) and removes them from it.
+ *
+ *  @param sink  The sink
+ *  @param buf   Where to copy the bytes
+ *  @param size  Size of buf
+ *  @return      The number of bytes copied
+ */
+unsigned int log_sink_read(struct log_sink *sink, void *buf, unsigned int size);
+
+/** log_flush:
+ *  Drains every sink with a device until its queue is empty, waiting for
+ *  the devices. Meant for the fatal exception path: it works with
+ *  interrupts off and takes a sink over even from a drain it interrupted,
+ *  which never resumes.
+ */
+void log_flush(void);
+
+/** log_start_thread:
+ *  Starts klogd, the thread that drains the sinks from now on. Call once,
+ *  after sched_init.
+ */
+void log_start_thread(void);
+
+#endif /* INCLUDE_LOG_SINK_H */
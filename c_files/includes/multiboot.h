@@ -0,0 +1,93 @@
+#ifndef INCLUDE_MULTIBOOT_H
+#define INCLUDE_MULTIBOOT_H
+
+/*
+ * Multiboot (version 0.6.96) boot information, as GRUB leaves it in memory
+ * and passes it to kmain in ebx. Which fields are valid is given by the
+ * bits in 'flags'; the layout below is fixed by the specification.
+ */
+
+/* Value in eax when the kernel was loaded by a multiboot loader */
+#define MULTIBOOT_BOOTLOADER_MAGIC      0x2BADB002
+
+/* multiboot_info.flags */
+#define MULTIBOOT_INFO_MEMORY           (1 << 0)    /* mem_lower / mem_upper */
+#define MULTIBOOT_INFO_BOOTDEV          (1 << 1)
+#define MULTIBOOT_INFO_CMDLINE          (1 << 2)
+#define MULTIBOOT_INFO_MODS             (1 << 3)    /* mods_count / mods_addr */
+#define MULTIBOOT_INFO_MEM_MAP          (1 << 6)    /* mmap_length / mmap_addr */
+#define MULTIBOOT_INFO_BOOT_LOADER_NAME (1 << 9)
+#define MULTIBOOT_INFO_VBE_INFO         (1 << 11)
+#define MULTIBOOT_INFO_FRAMEBUFFER_INFO (1 << 12)
+
+/* multiboot_mmap_entry.type */
+#define MULTIBOOT_MEMORY_AVAILABLE      1
+#define MULTIBOOT_MEMORY_RESERVED       2
+#define MULTIBOOT_MEMORY_ACPI_RECLAIMABLE 3
+#define MULTIBOOT_MEMORY_NVS            4
+#define MULTIBOOT_MEMORY_BADRAM         5
+
+/* multiboot_info.framebuffer_type */
+#define MULTIBOOT_FRAMEBUFFER_TYPE_INDEXED  0
+#define MULTIBOOT_FRAMEBUFFER_TYPE_RGB      1
+#define MULTIBOOT_FRAMEBUFFER_TYPE_EGA_TEXT 2
+
+
+struct multiboot_info {
+    unsigned int flags;
+
+    unsigned int mem_lower;         /* KiB below 1 MiB */
+    unsigned int mem_upper;         /* KiB from 1 MiB up to the first hole */
+
+    unsigned int boot_device;
+    unsigned int cmdline;
+
+    unsigned int mods_count;
+    unsigned int mods_addr;         /* array of struct multiboot_module */
+
+    unsigned int syms[4];           /* a.out or ELF section header table */
+
+    unsigned int mmap_length;       /* size of the memory map in bytes */
+    unsigned int mmap_addr;         /* first struct multiboot_mmap_entry */
+
+    unsigned int drives_length;
+    unsigned int drives_addr;
+    unsigned int config_table;
+    unsigned int boot_loader_name;
+    unsigned int apm_table;
+
+    unsigned int vbe_control_info;
+    unsigned int vbe_mode_info;
+    unsigned short vbe_mode;
+    unsigned short vbe_interface_seg;
+    unsigned short vbe_interface_off;
+    unsigned short vbe_interface_len;
+
+    unsigned long long framebuffer_addr;
+    unsigned int framebuffer_pitch;
+    unsigned int framebuffer_width;
+    unsigned int framebuffer_height;
+    unsigned char framebuffer_bpp;
+    unsigned char framebuffer_type;
+    unsigned char color_info[6];
+} __attribute__((packed));
+
+/*
+ * One memory map entry. 'size' does not count itself, so the next entry
+ * starts size + 4 bytes further on; it is not always sizeof the struct.
+ */
+struct multiboot_mmap_entry {
+    unsigned int size;
+    unsigned long long addr;
+    unsigned long long len;
+    unsigned int type;
+} __attribute__((packed));
+
+struct multiboot_module {
+    unsigned int mod_start;         /* first byte of the module */
+    unsigned int mod_end;           /* one past its last byte */
+    unsigned int string;            /* command line, a C string */
+    unsigned int reserved;
+} __attribute__((packed));
+
+#endif /* INCLUDE_MULTIBOOT_H */
@@ -0,0 +1,98 @@
+#ifndef INCLUDE_PAGING_H
+#define INCLUDE_PAGING_H
+
+/*
+ * Kernel virtual address space:
+ *
+ *   0x00000000 - 0xBFFFFFFF   unmapped (reserved for user space)
+ *   0xC0000000 - 0xEFFFFFFF   physical 0 - 768 MiB, 4 MiB global pages;
+ *                             the kernel image is at 0xC0100000
+ *   0xF0000000 - 0xFFFFFFFF   4 KiB mappings made with paging_map_page
+ *
+ * KERNEL_VIRTUAL_BASE must match asm/loader.s and linker/link.ld.
+ */
+#define KERNEL_VIRTUAL_BASE     0xC0000000
+#define PAGING_DIRECT_MAP_SIZE  0x30000000
+#define PAGING_MAP_AREA_START   (KERNEL_VIRTUAL_BASE + PAGING_DIRECT_MAP_SIZE)
+
+#define PAGE_SIZE               4096
+#define PAGE_LARGE_SIZE         0x400000
+#define PAGE_TABLE_ENTRIES      1024
+
+/* Page directory and page table entry bits */
+#define PAGE_PRESENT            (1 << 0)
+#define PAGE_WRITABLE           (1 << 1)
+#define PAGE_USER               (1 << 2)
+#define PAGE_WRITE_THROUGH      (1 << 3)
+#define PAGE_CACHE_DISABLE      (1 << 4)
+#define PAGE_ACCESSED           (1 << 5)
+#define PAGE_DIRTY              (1 << 6)
+#define PAGE_LARGE              (1 << 7)    /* PDE only: maps 4 MiB directly */
+#define PAGE_GLOBAL             (1 << 8)    /* kept in the TLB across CR3 loads */
+#define PAGE_FRAME_MASK         0xFFFFF000
+
+/*
+ * Physical memory below PAGING_DIRECT_MAP_SIZE is always mapped at
+ * KERNEL_VIRTUAL_BASE + its address, so converting is an add.
+ */
+#define phys_to_virt(addr)  ((void *)((unsigned int)(addr) + KERNEL_VIRTUAL_BASE))
+#define virt_to_phys(addr)  ((unsigned int)(addr) - KERNEL_VIRTUAL_BASE)
+
+
+/** paging_init:
+ *  Replaces the boot mapping set up by loader.s (the first 4 MiB, both
+ *  identity mapped and at KERNEL_VIRTUAL_BASE) with the direct map of
+ *  the first PAGING_DIRECT_MAP_SIZE bytes, global if the CPU supports it.
+ *  Anything still using a physical address must convert it first.
+ */
+void paging_init(void);
+
+/** paging_map_page:
+ *  Maps the 4 KiB page at virt to the frame at phys, allocating a page
+ *  table from the PMM if needed. Kernel addresses are mapped global.
+ *
+ *  @param virt  Page-aligned virtual address outside the direct map
+ *  @param phys  Page-aligned physical address
+ *  @param flags PAGE_WRITABLE, PAGE_USER, PAGE_CACHE_DISABLE, ...
+ *  @return      0 on success, -1 if virt lies in a 4 MiB mapping or no
+ *               frame was left for the page table
+ */
+int paging_map_page(unsigned int virt, unsigned int phys, unsigned int flags);
+
+/** paging_unmap_page:
+ *  Removes the mapping of the page at virt and invalidates its TLB entry.
+ *
+ *  @return The physical address it mapped, or 0 if it was not mapped
+ */
+unsigned int paging_unmap_page(unsigned int virt);
+
+/** paging_virt_to_phys:
+ *  Looks up the physical address virt is mapped to.
+ *
+ *  @return The physical address, or 0 if virt is not mapped
+ */
+unsigned int paging_virt_to_phys(unsigned int virt);
+
+/** paging_map_mmio:
+ *  Maps size bytes of device memory at phys into the 4 KiB mapping area,
+ *  uncached and writable, at addresses that are never handed out again.
+ *  Memory below PAGING_DIRECT_MAP_SIZE is returned from the direct map
+ *  instead.
+ *
+ *  @param phys Physical address, need not be page aligned
+ *  @param size Bytes to map
+ *  @return     The virtual address of phys, or 0 if a page table could
+ *              not be allocated or the mapping area is used up
+ */
+void *paging_map_mmio(unsigned int phys, unsigned int size);
+
+/** paging_identity_map_low:
+ *  Adds or removes an identity mapping of the first 4 MiB, for code that
+ *  runs at its physical address while turning paging on (the SMP
+ *  trampoline). Other CPUs must reload CR3 after the mapping is removed.
+ *
+ *  @param enable 1 to map, 0 to unmap
+ */
+void paging_identity_map_low(int enable);
+
+#endif /* INCLUDE_PAGING_H */
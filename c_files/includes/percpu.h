@@ -0,0 +1,46 @@
+#ifndef INCLUDE_PERCPU_H
+#define INCLUDE_PERCPU_H
+
+#include "descriptor.h"
+
+#define SMP_MAX_CPUS            8
+
+typedef void (*smp_fn_t)(void *arg);
+
+/*
+ * Everything that exists once per CPU. %gs holds a segment whose base is
+ * the CPU's own struct cpu (GDT_PERCPU_SELECTOR), so this_cpu() is one
+ * load from %gs:0 and needs no lookup of the APIC ID.
+ */
+struct cpu {
+    struct cpu *self;               /* must stay first: read by this_cpu() */
+    unsigned int id;                /* index in cpus[], 0 is the bootstrap processor */
+    unsigned int apic_id;
+    volatile unsigned int online;   /* set by the CPU itself once it runs C code */
+    void *stack_top;
+
+    /* smp_call mailbox; fn is cleared when the work is done */
+    volatile smp_fn_t work_fn;
+    void *volatile work_arg;
+
+    struct gdt_entry gdt[GDT_NUM_ENTRIES];
+    struct gdt_ptr gdt_ptr;
+    struct tss tss;
+};
+
+extern struct cpu cpus[SMP_MAX_CPUS];
+
+
+/** this_cpu:
+ *  @return The struct cpu of the CPU running the caller
+ */
+static inline struct cpu *this_cpu(void)
+{
+    struct cpu *cpu;
+
+    /* Not volatile: the value never changes on a given CPU */
+    __asm__("movl %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+#endif /* INCLUDE_PERCPU_H */
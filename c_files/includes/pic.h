@@ -0,0 +1,68 @@
+#ifndef INCLUDE_PIC_H
+#define INCLUDE_PIC_H
+
+#include "io.h"
+
+/* The two cascaded 8259A programmable interrupt controllers */
+#define PIC1_COMMAND_PORT       0x20
+#define PIC1_DATA_PORT          0x21
+#define PIC2_COMMAND_PORT       0xA0
+#define PIC2_DATA_PORT          0xA1
+
+#define PIC_ICW1_INIT_ICW4      0x11    /* Edge triggered, cascaded, ICW4 follows */
+#define PIC_ICW4_8086           0x01
+#define PIC_ICW4_AUTO_EOI       0x02    /* EOI happens in the interrupt acknowledge */
+#define PIC_OCW3_READ_ISR       0x0B
+#define PIC_EOI                 0x20    /* Non-specific end of interrupt */
+
+#define PIC_CASCADE_IRQ         2       /* Master input the slave is wired to */
+#define PIC_NUM_IRQS            16
+
+
+/** pic_init:
+ *  Remaps IRQ 0-7 to master_vector.. and IRQ 8-15 to slave_vector.., away
+ *  from the CPU exception vectors the BIOS leaves them on, and masks every
+ *  line except the cascade.
+ *
+ *  The master runs in automatic EOI mode: it ends each interrupt itself
+ *  while the CPU acknowledges it, so IRQ 0-7 need no EOI write at all.
+ *  The slave cannot be trusted with AEOI, so IRQ 8-15 take one write to
+ *  the slave only (the master's cascade input was already ended).
+ */
+void pic_init(unsigned char master_vector, unsigned char slave_vector);
+
+/** pic_mask_irq / pic_unmask_irq:
+ *  Disable or enable one IRQ line. The masks are cached, so this is a
+ *  single port write.
+ */
+void pic_mask_irq(unsigned int irq);
+void pic_unmask_irq(unsigned int irq);
+
+/** pic_is_spurious:
+ *  Checks whether an IRQ 15 was spurious (raised and withdrawn before it
+ *  was acknowledged), by reading the slave's in-service register. A
+ *  spurious interrupt must not be EOI'd. The same cannot be done for IRQ 7:
+ *  with automatic EOI the master's in-service bit is already clear.
+ *
+ *  @return 1 if the slave reports IRQ 15 not in service
+ */
+static inline int pic_is_spurious(unsigned int irq)
+{
+    if (irq != 15) {
+        return 0;
+    }
+    outb(PIC2_COMMAND_PORT, PIC_OCW3_READ_ISR);
+    return (inb(PIC2_COMMAND_PORT) & 0x80) == 0;
+}
+
+/** pic_eoi:
+ *  Ends an interrupt. Free for the master's lines, one outb for the slave's.
+ */
+static inline void pic_eoi(unsigned int irq)
+{
+    if (irq >= 8) {
+        outb(PIC2_COMMAND_PORT, PIC_EOI);
+    }
+}
+
+#endif /* INCLUDE_PIC_H */
@@ -0,0 +1,39 @@
+#ifndef INCLUDE_PIT_H
+#define INCLUDE_PIT_H
+
+#include "interrupt.h"
+
+/* 8253/8254 programmable interval timer, channel 0 drives IRQ 0 */
+#define PIT_CHANNEL0_DATA_PORT  0x40
+#define PIT_COMMAND_PORT        0x43
+
+/* Channel 0, lobyte/hibyte access, mode 2 (rate generator), binary */
+#define PIT_CHANNEL0_RATE_GENERATOR 0x34
+
+#define PIT_BASE_FREQUENCY      1193182     /* Hz */
+#define PIT_MAX_HOOKS           4
+
+
+/** pit_init:
+ *  Programs channel 0 to interrupt hz times per second (19 Hz to the base
+ *  frequency) and registers the IRQ 0 handler.
+ *
+ *  @param hz The tick frequency
+ */
+void pit_init(unsigned int hz);
+
+/** pit_add_hook:
+ *  Calls fn on every tick, from the IRQ 0 handler, with the interrupted
+ *  context in frame.
+ *
+ *  @return 0 on success, -1 if PIT_MAX_HOOKS are already registered
+ */
+int pit_add_hook(interrupt_handler_t fn);
+
+/** pit_ticks / pit_frequency:
+ *  Ticks since pit_init, and the frequency it was given.
+ */
+unsigned int pit_ticks(void);
+unsigned int pit_frequency(void);
+
+#endif /* INCLUDE_PIT_H */
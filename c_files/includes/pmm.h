@@ -0,0 +1,73 @@
+#ifndef INCLUDE_PMM_H
+#define INCLUDE_PMM_H
+
+#include "multiboot.h"
+#include "paging.h"
+
+#define PMM_FRAME_SIZE      4096
+#define PMM_FRAME_SHIFT     12
+
+/*
+ * Only memory the kernel can reach through the direct map is managed;
+ * physical memory above it (high memory) is ignored for now.
+ */
+#define PMM_MAX_FRAMES      (PAGING_DIRECT_MAP_SIZE / PMM_FRAME_SIZE)
+
+/* Everything below 1 MiB stays reserved (BIOS data, VGA memory, ROMs) */
+#define PMM_LOW_MEMORY_END  0x100000
+
+
+/** pmm_init:
+ *  Builds the free frame map from the multiboot memory map, or from
+ *  mem_upper if GRUB gave no map, then reserves the low 1 MiB, the kernel
+ *  image, the multiboot structures and any boot modules.
+ *
+ *  @param  mbi The multiboot information passed to kmain, already
+ *              converted to its direct map address
+ *  @return     0 on success, -1 if mbi has no memory information
+ */
+int pmm_init(struct multiboot_info *mbi);
+
+/** pmm_alloc_frame:
+ *  Allocates one 4 KiB frame, always the lowest free one. Constant time.
+ *  Safe from any thread, interrupt handler or CPU: the bitmap is updated
+ *  under a spinlock with interrupts off.
+ *
+ *  @return The physical address of the frame, 0 when memory is exhausted
+ *          (frame 0 is never free, it lies in the low 1 MiB). The frame is
+ *          always inside the direct map, at phys_to_virt(address).
+ */
+unsigned int pmm_alloc_frame(void);
+
+/** pmm_free_frame:
+ *  Returns a frame from pmm_alloc_frame to the allocator. Freeing a frame
+ *  that is already free is ignored.
+ *
+ *  @param addr The physical address of the frame
+ */
+void pmm_free_frame(unsigned int addr);
+
+/** pmm_reserve_region / pmm_release_region:
+ *  Marks every frame overlapping [start, end) as in use, or every frame
+ *  fully inside it as free.
+ */
+void pmm_reserve_region(unsigned long long start, unsigned long long end);
+void pmm_release_region(unsigned long long start, unsigned long long end);
+
+/** pmm_free_frames / pmm_total_frames:
+ *  The number of free frames, and of frames the memory map reported usable.
+ */
+unsigned int pmm_free_frames(void);
+unsigned int pmm_total_frames(void);
+
+/** pmm_release_init:
+ *  Returns the frames of .init.text, the boot-only __init functions (see
+ *  compiler.h), to the allocator. Their static_branch sites are dropped
+ *  from the jump table and the code is overwritten with int3 first.
+ *  Call once, after the last __init function has returned.
+ *
+ *  @return The number of bytes released, 0 if pmm_init did not succeed
+ */
+unsigned int pmm_release_init(void);
+
+#endif /* INCLUDE_PMM_H */
@@ -0,0 +1,59 @@
+#ifndef INCLUDE_PROFILE_H
+#define INCLUDE_PROFILE_H
+
+/*
+ * Sampling profiler. On every PIT tick while it runs, the interrupted eip
+ * and up to PROFILE_MAX_DEPTH return addresses (from the frame pointer
+ * chain) are appended to a preallocated buffer; profile_dump sends it over
+ * COM1 for tools/kprof.py to resolve against kernel.elf.
+ */
+
+#define PROFILE_BUFFER_WORDS    32768       /* 128 KiB: 16384 eip-only samples */
+#define PROFILE_MAX_DEPTH       8
+#define PROFILE_DUMP_MAGIC      0x464F5250  /* "PROF" in a little-endian dump */
+#define PROFILE_REPORT_SLOTS    256         /* distinct functions profile_report can count */
+
+
+/** profile_init:
+ *  Hooks the profiler into the PIT tick. Needs pit_init to have run.
+ */
+void profile_init(void);
+
+/** profile_start:
+ *  Starts sampling: one sample every interval PIT ticks.
+ *
+ *  @param interval Ticks between samples, at least 1
+ *  @param depth    Return addresses to record per sample, 0 for eip only,
+ *                  at most PROFILE_MAX_DEPTH
+ */
+void profile_start(unsigned int interval, unsigned int depth);
+
+/** profile_stop:
+ *  Stops sampling. The recorded samples stay until profile_dump.
+ */
+void profile_stop(void);
+
+/** profile_dump:
+ *  Writes the recorded samples over COM1 and empties the buffer. Samples
+ *  that did not fit since the last dump are only counted.
+ *
+ *  Dump format, little-endian 32-bit words:
+ *    PROFILE_DUMP_MAGIC, samples, dropped, sample rate in Hz
+ *    per sample: depth, eip, depth return addresses (innermost first)
+ */
+void profile_dump(void);
+
+/** profile_report:
+ *  Writes a flat profile of the recorded samples over COM1 as text,
+ *  symbolized on the target with ksyms, one line per function:
+ *
+ *    profile: <samples> <percent> <function>
+ *
+ *  Only the interrupted eip counts (self time). The samples stay for
+ *  profile_dump; for callers and flame graphs use tools/kprof.py.
+ *
+ *  @param top Number of functions to list, busiest first
+ */
+void profile_report(unsigned int top);
+
+#endif /* INCLUDE_PROFILE_H */
@@ -0,0 +1,122 @@
+#ifndef INCLUDE_SCHED_H
+#define INCLUDE_SCHED_H
+
+/*
+ * Kernel threads and a preemptive priority scheduler. Every priority has
+ * a FIFO run queue and one bit in sched_ready_mask, so picking the next
+ * thread is a single bsf whatever the number of threads. Threads of equal
+ * priority take turns every SCHED_TIMESLICE_TICKS PIT ticks; a thread of
+ * higher priority that becomes ready runs at the next interrupt.
+ */
+
+#define SCHED_NUM_PRIORITIES    32          /* one bit each in the ready mask */
+#define SCHED_PRIORITY_HIGHEST  0
+#define SCHED_PRIORITY_DEFAULT  16
+#define SCHED_PRIORITY_IDLE     (SCHED_NUM_PRIORITIES - 1)  /* only the idle thread */
+#define SCHED_TIMESLICE_TICKS   10
+
+#define TASK_STACK_SIZE         4096        /* one PMM frame */
+#define TASK_NAME_LEN           16
+#define TASK_FPU_STATE_SIZE     512         /* fxsave area */
+
+/* Task states */
+#define TASK_READY              0           /* on its run queue */
+#define TASK_RUNNING            1
+#define TASK_SLEEPING           2           /* on the sleep list until wake_tick */
+#define TASK_BLOCKED            3           /* until task_wake */
+#define TASK_DEAD               4           /* freed by the next thread to run */
+
+
+typedef void (*task_fn_t)(void *arg);
+
+struct task {
+    unsigned char fpu[TASK_FPU_STATE_SIZE] __attribute__((aligned(16)));
+    unsigned int esp;               /* saved by switch_to while not running */
+    unsigned int state;
+    unsigned int priority;
+    unsigned int slice;             /* ticks left before equal priorities get a turn */
+    unsigned int wake_tick;
+    struct task *next;              /* run queue or sleep list link */
+    void *stack;                    /* lowest address, 0 for the boot thread */
+    task_fn_t fn;
+    void *arg;
+    unsigned int id;
+    char name[TASK_NAME_LEN];
+};
+
+/*
+ * Set when a thread should be preempted. interrupt_dispatch checks it on
+ * the way out and calls sched_preempt if the interrupted code had
+ * interrupts enabled.
+ */
+extern volatile unsigned int sched_need_resched;
+
+
+/** sched_init:
+ *  Turns the calling (boot) thread into the first task, "main", at
+ *  SCHED_PRIORITY_DEFAULT, and hooks the scheduler into the PIT tick and
+ *  the #NM exception. Needs kmem_init and pit_init to have run.
+ */
+void sched_init(void);
+
+/** task_create:
+ *  Creates a thread that runs fn(arg) on its own TASK_STACK_SIZE stack,
+ *  with interrupts enabled. Returning from fn ends the thread.
+ *
+ *  @param name     Copied, at most TASK_NAME_LEN - 1 characters
+ *  @param fn       The thread function
+ *  @param arg      Passed to fn
+ *  @param priority SCHED_PRIORITY_HIGHEST to SCHED_PRIORITY_IDLE - 1
+ *  @return The new task, or 0 if memory ran out
+ */
+struct task *task_create(const char *name, task_fn_t fn, void *arg, unsigned int priority);
+
+/** task_current:
+ *  @return The running task, or 0 before sched_init
+ */
+struct task *task_current(void);
+
+/** sched_yield:
+ *  Lets another ready thread of the same or higher priority run. Returns
+ *  at once if there is none. Not for interrupt handlers, like everything
+ *  below that may switch threads.
+ */
+void sched_yield(void);
+
+/** task_sleep:
+ *  Suspends the calling thread for at least ticks PIT ticks.
+ */
+void task_sleep(unsigned int ticks);
+
+/** task_block:
+ *  Suspends the calling thread until task_wake. To wait for a condition
+ *  without missing the wakeup, test it and block with interrupts
+ *  disabled (irq_save); they are disabled again when this returns.
+ */
+void task_block(void);
+
+/** task_wake:
+ *  Makes a blocked thread ready. Safe from interrupt handlers. Does
+ *  nothing if the task is not blocked.
+ */
+void task_wake(struct task *task);
+
+/** task_exit:
+ *  Ends the calling thread. Its stack and task are freed once another
+ *  thread runs.
+ */
+void task_exit(void) __attribute__((noreturn));
+
+/** sched_idle:
+ *  Turns the calling thread into the idle thread, at SCHED_PRIORITY_IDLE,
+ *  and halts whenever no other thread is ready. kmain ends with it.
+ */
+void sched_idle(void) __attribute__((noreturn));
+
+/** sched_preempt:
+ *  Switches away from the running thread if sched_need_resched asks for
+ *  it. Called by interrupt_dispatch with interrupts disabled.
+ */
+void sched_preempt(void);
+
+#endif /* INCLUDE_SCHED_H */
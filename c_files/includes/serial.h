@@ -2,8 +2,13 @@
 #define INCLUDE_SERIAL_H
 
 #define SERIAL_COM1_BASE                0x3F8      /* COM1 base port */
+#define SERIAL_COM2_BASE                0x2F8      /* COM2 base port */
+#define SERIAL_COM3_BASE                0x3E8      /* COM3 base port */
+#define SERIAL_COM4_BASE                0x2E8      /* COM4 base port */
 
 #define SERIAL_DATA_PORT(base)          (base)         // Used to send or receive the actual characters (like 'A', 'B', 'C'). If you write a byte here, it gets transmitted.
+#define SERIAL_INTERRUPT_ENABLE_PORT(base) (base + 1) // Selects which events raise an interrupt (data received, transmitter empty, ...). Shares its address with the high divisor byte while DLAB is set.
+#define SERIAL_INTERRUPT_ID_PORT(base)  (base + 2)     // Read side of the FIFO command port. Tells the interrupt handler why the UART raised its IRQ.
 #define SERIAL_FIFO_COMMAND_PORT(base)  (base + 2)     // Controls the FIFO (First-In, First-Out) buffer. Since the CPU is much faster than the serial line, the hardware has a tiny "waiting room" (buffer) for characters. This port is used to enable or clear that waiting room.
 #define SERIAL_LINE_COMMAND_PORT(base)  (base + 3)     // Configures the serial line settings, such as baud rate (speed), number of data bits, parity, and stop bits. This is crucial for ensuring that both ends of the communication understand each other.
 #define SERIAL_MODEM_COMMAND_PORT(base) (base + 4)     // Used for "handshaking." It tells the device on the other end, "I am ready to receive data" (Ready To Transmit/Request To Send).
@@ -60,6 +65,45 @@ We don’t need to enable interrupts, because we won’t handle any received dat
 
 #define SERIAL_MODEM_CONFIG 0x03
 
+/*
+SERIAL_MODEM_CONFIG_IRQ:
+    * RTS, DTR and ao2 (OUT2). On PC hardware OUT2 gates the UART interrupt
+    * line to the PIC, so it must be set once transmit interrupts are used.
+0x0B = 00001011
+*/
+#define SERIAL_MODEM_CONFIG_IRQ 0x0B
+
+
+/*
+SERIAL_IER_THRE:
+    * Bit 1 of the Interrupt Enable Register: raise an interrupt whenever the
+    * transmit holding register (and FIFO) becomes empty.
+0x02 = 0000 0010
+*/
+#define SERIAL_IER_THRE 0x02
+
+/*
+SERIAL_IIR_NO_INTERRUPT / SERIAL_IIR_ID_MASK / SERIAL_IIR_THRE:
+    * Bit 0 of the Interrupt Identification Register is 0 while an interrupt
+    * is pending, bits 3-1 say which one. 0x02 means "transmitter empty".
+*/
+#define SERIAL_IIR_NO_INTERRUPT 0x01
+#define SERIAL_IIR_ID_MASK      0x0E
+#define SERIAL_IIR_THRE         0x02
+
+/*
+SERIAL_TX_FIFO_SIZE:
+    * A 16550A takes up to 16 bytes once the transmitter reports empty.
+    * (The "14 bytes" in SERIAL_FIFO_ENABLE_14BYTES is the receive trigger level.)
+*/
+#define SERIAL_TX_FIFO_SIZE 16
+
+/*
+SERIAL_TX_RING_SIZE:
+    * Bytes buffered in RAM per port waiting for the UART. Must be a power of two.
+*/
+#define SERIAL_TX_RING_SIZE 4096
+
 
 
 /*
@@ -111,6 +155,19 @@ void serial_configure_fifo(unsigned short com);
 void serial_configure_modem(unsigned short com);
 
 
+/** struct serial_tx_stats:
+ *  Counters reported by serial_tx_stats_com.
+ *
+ *  queued       Bytes currently waiting in the ring
+ *  full_events  Writes that found the ring full
+ *  dropped      Bytes thrown away because the ring was full
+ */
+struct serial_tx_stats {
+    unsigned int queued;
+    unsigned int full_events;
+    unsigned int dropped;
+};
+
 /** serial_is_transmit_fifo_empty_com:
  *  Checks whether the transmit FIFO queue is empty or not for the given COM
  *  port.
@@ -146,7 +203,8 @@ void serial_init(void);
 
 
 /** serial_begin_com:
- *  Initializes the given serial port with a specific baud rate.
+ *  Initializes the given serial port with a specific baud rate. A port
+ *  already switched to interrupt-driven transmit stays that way.
  *
  *  @param com        The serial port to initialize
  *  @param baud_rate  The desired baud rate (e.g., 9600, 115200)
@@ -163,7 +221,10 @@ void serial_begin(unsigned int baud_rate);
 
 
 /** serial_write_char_com:
- *  Writes a character to the given serial port.
+ *  Queues a character for the given serial port and returns without waiting
+ *  for the UART. Bytes are moved from the transmit ring into the hardware
+ *  FIFO by serial_tx_irq_handler, or by the writers themselves while
+ *  transmit interrupts are off.
  *
  *  @param com  The serial port to write to
  *  @param c    The character to write
@@ -180,7 +241,7 @@ void serial_write_char(char c);
 
 
 /** serial_write_com:
- *  Writes a null-terminated string to the given serial port.
+ *  Queues a null-terminated string for the given serial port.
  *
  *  @param com  The serial port to write to
  *  @param buf  The null-terminated string
@@ -195,4 +256,112 @@ void serial_write_com(unsigned short com, char *buf);
  */
 void serial_write(char *buf);
 
+
+/** serial_write_buf_com:
+ *  Queues len raw bytes for the given serial port. Unlike serial_write_com
+ *  the data may contain NUL bytes.
+ *
+ *  @param com  The serial port to write to
+ *  @param buf  The bytes to send
+ *  @param len  Number of bytes
+ */
+void serial_write_buf_com(unsigned short com, const void *buf, unsigned int len);
+
+
+/** serial_write_buf:
+ *  Queues len raw bytes for SERIAL_COM1_BASE.
+ *
+ *  @param buf  The bytes to send
+ *  @param len  Number of bytes
+ */
+void serial_write_buf(const void *buf, unsigned int len);
+
+
+/** serial_write_buf_blocking_com:
+ *  Like serial_write_buf_com, but when the ring fills up it waits for
+ *  room (yielding like serial_flush_com) instead of dropping bytes.
+ *
+ *  @param com  The serial port to write to
+ *  @param buf  The bytes to send
+ *  @param len  Number of bytes
+ */
+void serial_write_buf_blocking_com(unsigned short com, const void *buf, unsigned int len);
+
+
+/** serial_write_buf_nowait_com:
+ *  Queues as many of the bytes as the transmit ring has room for, and
+ *  no more: never waits and never counts a drop. Room check and copy are
+ *  one step under the ring's lock.
+ *
+ *  @param com  The serial port to write to
+ *  @param buf  The bytes to send
+ *  @param len  Number of bytes
+ *  @return     The number of bytes queued
+ */
+unsigned int serial_write_buf_nowait_com(unsigned short com, const void *buf, unsigned int len);
+
+
+/** serial_hold_com / serial_release_com:
+ *  Claim a port for a run of writes that must not be split, such as one
+ *  serial frame. serial_hold_com waits (yielding) while another thread
+ *  holds it. Holding does not stop other writers by itself; the log's
+ *  serial sinks check serial_held_com and leave their text queued until
+ *  the port is released. Not for interrupt handlers.
+ *
+ *  @param com  The serial port
+ */
+void serial_hold_com(unsigned short com);
+void serial_release_com(unsigned short com);
+
+/** serial_held_com:
+ *  @param com  The serial port
+ *  @return     1 between serial_hold_com and serial_release_com, else 0
+ */
+int serial_held_com(unsigned short com);
+
+
+/** serial_flush_com:
+ *  Waits until every queued byte of the given serial port has been
+ *  handed to the UART. With transmit interrupts on and interrupts
+ *  enabled, the caller yields to other threads (sched_yield) while it
+ *  waits; otherwise it busy-waits.
+ *
+ *  @param com  The serial port to flush
+ */
+void serial_flush_com(unsigned short com);
+
+
+/** serial_flush:
+ *  Waits until SERIAL_COM1_BASE has sent everything queued.
+ */
+void serial_flush(void);
+
+
+/** serial_tx_irq_enable_com:
+ *  Switches the given serial port to interrupt-driven transmit: enables the
+ *  THRE interrupt and OUT2. The caller must have installed
+ *  serial_tx_irq_handler for the port's IRQ first. While interrupts drive
+ *  the port, writes that find the ring full drop bytes instead of waiting.
+ *
+ *  @param com  The serial port
+ */
+void serial_tx_irq_enable_com(unsigned short com);
+
+
+/** serial_tx_irq_handler:
+ *  THRE interrupt handler body: refills the hardware FIFO from the ring.
+ *
+ *  @param com  The serial port that raised the interrupt
+ */
+void serial_tx_irq_handler(unsigned short com);
+
+
+/** serial_tx_stats_com:
+ *  Reads the transmit ring counters of the given serial port.
+ *
+ *  @param com    The serial port
+ *  @param stats  Filled with the current counters
+ */
+void serial_tx_stats_com(unsigned short com, struct serial_tx_stats *stats);
+
 #endif /* INCLUDE_SERIAL_H */
\ No newline at end of file
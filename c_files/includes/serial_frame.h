@@ -0,0 +1,76 @@
+#ifndef INCLUDE_SERIAL_FRAME_H
+#define INCLUDE_SERIAL_FRAME_H
+
+/*
+ * Framed binary transport over a serial port, for bulk data such as log
+ * rings, trace buffers and memory dumps. Every frame is
+ *
+ *   struct serial_frame_header, payload, CRC32 (little-endian)
+ *
+ * COBS-encoded, so the encoded bytes contain no 0x00, and sent between two
+ * 0x00 delimiters. A receiver (tools/serial_recv.py) can pick frames out
+ * of ordinary text, drop damaged ones by their CRC, spot lost ones by the
+ * sequence number and place each payload at its offset in the stream.
+ */
+
+#define SERIAL_FRAME_VERSION        1
+#define SERIAL_FRAME_MAX_DATA       1024    /* bytes of data per frame, before compression */
+#define SERIAL_FRAME_LZ_HASH_BITS   10      /* match finder table: 1024 16-bit positions */
+
+/* serial_send_frame / serial_send_data flags */
+#define SERIAL_FRAME_COMPRESS       0x01    /* compress when that makes the frame smaller */
+
+/* Header flags */
+#define SERIAL_FRAME_FLAG_LZ        0x01    /* payload is an LZ4 block */
+#define SERIAL_FRAME_FLAG_END       0x02    /* last frame of the stream */
+
+struct serial_frame_header {
+    unsigned char version;          /* SERIAL_FRAME_VERSION */
+    unsigned char flags;            /* SERIAL_FRAME_FLAG_* */
+    unsigned short stream;          /* chosen by the sender, names the output */
+    unsigned int seq;               /* +1 for every frame sent, on any port */
+    unsigned int offset;            /* position of the data in the stream */
+    unsigned short length;          /* data bytes before compression */
+    unsigned short reserved;
+} __attribute__((packed));
+
+
+/** serial_send_frame_com:
+ *  Sends one frame. Waits for room in the transmit ring rather than
+ *  dropping bytes. Needs kmalloc for its buffers.
+ *
+ *  @param com    The serial port
+ *  @param stream Stream ID the receiver files the data under
+ *  @param offset Position of data in the stream
+ *  @param data   At most SERIAL_FRAME_MAX_DATA bytes
+ *  @param len    Number of bytes
+ *  @param flags  SERIAL_FRAME_COMPRESS, and SERIAL_FRAME_FLAG_END for the
+ *                last frame of a stream
+ *  @return 0 on success, -1 if len is too large or no memory was left
+ */
+int serial_send_frame_com(unsigned short com, unsigned int stream, unsigned int offset,
+                          const void *data, unsigned int len, unsigned int flags);
+
+/** serial_send_frame:
+ *  serial_send_frame_com on SERIAL_COM1_BASE.
+ */
+int serial_send_frame(unsigned int stream, unsigned int offset,
+                      const void *data, unsigned int len, unsigned int flags);
+
+/** serial_send_data:
+ *  Sends len bytes of any size over SERIAL_COM1_BASE as a whole stream:
+ *  frames of SERIAL_FRAME_MAX_DATA bytes at increasing offsets, the last
+ *  one marked SERIAL_FRAME_FLAG_END. Sending the same stream again lets
+ *  the receiver fill in frames that were lost the first time.
+ *
+ *  @param flags SERIAL_FRAME_COMPRESS or 0
+ *  @return 0 on success, -1 if a frame could not be built
+ */
+int serial_send_data(unsigned int stream, const void *data, unsigned int len, unsigned int flags);
+
+/** crc32:
+ *  IEEE 802.3 CRC-32 (as zlib.crc32), continuing from crc; start with 0.
+ */
+unsigned int crc32(unsigned int crc, const void *data, unsigned int len);
+
+#endif /* INCLUDE_SERIAL_FRAME_H */
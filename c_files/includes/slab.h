@@ -0,0 +1,111 @@
+#ifndef INCLUDE_SLAB_H
+#define INCLUDE_SLAB_H
+
+/* Objects of caches created with this alignment never share a cache line */
+#define KMEM_CACHE_LINE         64
+
+/* kmalloc size classes: 8, 16, ..., 2048 bytes */
+#define KMALLOC_MIN_SHIFT       3
+#define KMALLOC_MAX_SHIFT       11
+#define KMALLOC_NUM_CLASSES     (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+#define KMALLOC_MAX_SIZE        (1 << KMALLOC_MAX_SHIFT)
+
+#define KMEM_CACHE_NAME_LEN     24
+
+
+/*
+ * A slab is one 4 KiB frame: a struct kmem_slab header, then as many
+ * objects as fit. Free objects are chained through their first word.
+ */
+struct kmem_slab;
+
+struct kmem_cache {
+    char name[KMEM_CACHE_NAME_LEN];
+    unsigned int object_size;       /* requested size rounded up to align */
+    unsigned int align;
+    unsigned int first_offset;      /* offset of object 0 in the slab */
+    unsigned int objects_per_slab;
+
+    struct kmem_slab *partial;      /* some objects free: allocations come from here */
+    struct kmem_slab *full;
+    struct kmem_slab *empty;        /* one spare slab kept back from the PMM */
+
+    /* Usage statistics, see kmem_cache_stats */
+    unsigned int slabs;
+    unsigned int active_objects;
+    unsigned int peak_objects;
+    unsigned int allocs;
+    unsigned int frees;
+    unsigned int failed;
+
+    struct kmem_cache *next;        /* all caches, for kmem_print_stats */
+};
+
+struct kmem_cache_stats {
+    unsigned int object_size;
+    unsigned int objects_per_slab;
+    unsigned int slabs;             /* frames held by the cache */
+    unsigned int active_objects;    /* objects currently allocated */
+    unsigned int peak_objects;
+    unsigned int allocs;
+    unsigned int frees;
+    unsigned int failed;            /* allocations the PMM could not back */
+};
+
+
+/** kmem_init:
+ *  Sets up the kmalloc size classes. Needs pmm_init to have run.
+ */
+void kmem_init(void);
+
+/** kmem_cache_create:
+ *  Creates a cache of fixed-size objects.
+ *
+ *  @param name   Shown by kmem_print_stats, truncated to KMEM_CACHE_NAME_LEN - 1
+ *  @param size   The object size in bytes, at most KMALLOC_MAX_SIZE
+ *  @param align  A power of two, or 0 for word alignment; KMEM_CACHE_LINE
+ *                keeps objects on separate cache lines
+ *  @return       The cache, or 0 if the arguments are invalid or memory ran out
+ */
+struct kmem_cache *kmem_cache_create(const char *name, unsigned int size, unsigned int align);
+
+/** kmem_cache_destroy:
+ *  Returns a cache's frames to the PMM and frees the cache. Every object
+ *  must have been freed first.
+ *
+ *  @return 0 on success, -1 if the cache still has objects allocated
+ */
+int kmem_cache_destroy(struct kmem_cache *cache);
+
+/** kmem_cache_alloc / kmem_cache_free:
+ *  Allocate one object from a cache, or return it. Both are constant time.
+ *  kmem_cache_alloc returns 0 when no frame is left.
+ */
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+/** kmalloc:
+ *  Allocates size bytes from the smallest size class that fits. The
+ *  memory is aligned to the class size, up to KMEM_CACHE_LINE.
+ *
+ *  @param size  1 to KMALLOC_MAX_SIZE bytes
+ *  @return      The memory, or 0 if size is 0, too large, or memory ran out
+ */
+void *kmalloc(unsigned int size);
+
+/** kfree:
+ *  Frees memory from kmalloc or any kmem_cache_alloc. kfree(0) does nothing.
+ */
+void kfree(void *ptr);
+
+/** kmem_cache_stats:
+ *  Copies a cache's usage counters.
+ */
+void kmem_cache_stats(struct kmem_cache *cache, struct kmem_cache_stats *stats);
+
+/** kmem_print_stats:
+ *  Writes one line of statistics per cache to the log.
+ */
+void kmem_print_stats(void);
+
+#endif /* INCLUDE_SLAB_H */
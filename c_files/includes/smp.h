@@ -0,0 +1,52 @@
+#ifndef INCLUDE_SMP_H
+#define INCLUDE_SMP_H
+
+#include "percpu.h"
+
+/* Real-mode start-up code page; below 1 MiB, and the PMM never hands out low memory */
+#define AP_TRAMPOLINE_ADDR      0x8000      /* must match asm/ap_trampoline.s */
+#define SMP_AP_STACK_SIZE       16384
+
+/* Firmware table signatures */
+#define ACPI_RSDP_SIGNATURE     "RSD PTR "
+#define ACPI_MADT_SIGNATURE     "APIC"
+#define MP_FLOAT_SIGNATURE      "_MP_"
+#define MP_CONFIG_SIGNATURE     "PCMP"
+
+
+/** smp_init:
+ *  Finds the processors in the ACPI MADT (or the MP table if there is no
+ *  ACPI) and starts every application processor with INIT-SIPI-SIPI.
+ *  Each one gets its own stack, GDT, TSS and %gs segment (gdt_init_cpu),
+ *  loads the IDT and waits in smp_call's mailbox loop. Needs the PMM,
+ *  the PIT and interrupts enabled. The multiboot info may sit in the
+ *  trampoline page, so anything reading it must run first.
+ *
+ *  @return The number of CPUs online, the bootstrap processor included
+ */
+unsigned int smp_init(void);
+
+/** smp_num_cpus:
+ *  @return The number of CPUs online; they are cpus[0] .. cpus[n - 1]
+ */
+unsigned int smp_num_cpus(void);
+
+/** smp_call:
+ *  Runs fn(arg) on an application processor, which returns to waiting
+ *  when fn returns. Does not wait; see smp_wait. fn runs with interrupts
+ *  disabled. It may use the PMM, the serial ports and the logger, which
+ *  take spinlocks, but not the scheduler, the slab caches or the
+ *  framebuffer, which are not safe to call from two CPUs at once.
+ *
+ *  @param cpu Index in cpus[], 1 to smp_num_cpus() - 1
+ *  @return 0 on success, -1 if the CPU is not online or still busy
+ */
+int smp_call(unsigned int cpu, smp_fn_t fn, void *arg);
+
+/** smp_wait:
+ *  Waits until the work given to cpu by smp_call has returned. Yields to
+ *  other threads meanwhile.
+ */
+void smp_wait(unsigned int cpu);
+
+#endif /* INCLUDE_SMP_H */
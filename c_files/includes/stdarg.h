@@ -0,0 +1,11 @@
+#ifndef INCLUDE_STDARG_H
+#define INCLUDE_STDARG_H
+
+/* va_list support using GCC built-ins */
+typedef __builtin_va_list va_list;
+#define va_start(ap, last) __builtin_va_start(ap, last)
+#define va_arg(ap, type)   __builtin_va_arg(ap, type)
+#define va_end(ap)         __builtin_va_end(ap)
+#define va_copy(dest, src) __builtin_va_copy(dest, src)
+
+#endif /* INCLUDE_STDARG_H */
@@ -1,6 +1,8 @@
 #ifndef INCLUDE_STDIO_H
 #define INCLUDE_STDIO_H
 
+#include "io.h"
+
 /* I/O Ports */
 #define FB_COMMAND_PORT         0x3D4
 #define FB_DATA_PORT            0x3D5
@@ -8,6 +10,8 @@
 /* I/O Port Commands */
 #define FB_HIGH_BYTE_COMMAND    14
 #define FB_LOW_BYTE_COMMAND     15
+#define FB_START_ADDRESS_HIGH_COMMAND   0x0C    /* CRTC: first cell shown, bits 15-8 */
+#define FB_START_ADDRESS_LOW_COMMAND    0x0D    /* CRTC: first cell shown, bits 7-0 */
 
 /* VGA Colors */
 #define COLOR_BLACK             0x00
@@ -32,28 +36,82 @@
 #define FB_EMPTY_CELL           0x20
 #define FB_COLUMNS              80
 #define FB_ROWS                 25
+#define FB_TEXT_MEMORY_SIZE     0x8000  /* 32 KiB of text memory at 0xB8000 */
+#define FB_TEXT_ROWS            (FB_TEXT_MEMORY_SIZE / 2 / FB_COLUMNS)  /* 204 rows */
+#define FB_TEXT_COLOR           0x0F    /* white on black, what putchar and puts write */
 
-/* Assembly Helper */
+/* Virtual consoles, one page of text memory each */
+#define FB_CONSOLES             4
+#define FB_CONSOLE_ROWS         (FB_TEXT_ROWS / FB_CONSOLES)    /* 51: the screen and 26 rows of scrollback */
+#define FB_SCROLLBACK_KEEP_ROWS ((FB_CONSOLE_ROWS - FB_ROWS) / 2)   /* history kept when scrolling wraps a page */
+#define FB_CONSOLE_MAIN         0       /* kernel and workload output, shown at boot */
+#define FB_CONSOLE_LOG          1       /* log_* output (log.c) */
+#define FB_CONSOLE_MONITOR      2       /* a debug monitor */
 
-/* outb:
-     *  Write a byte to an I/O port.
-     *
-     *  @param  port The address of the I/O port
-     *  @param  data The byte to write
-*/
-void outb(unsigned short port, unsigned char data);
-/** inb:
-     *  Read a byte from an I/O port.
+/* Framebuffer Functions */
+
+/** fb_write_cell:
+     *  Write a character cell into the shadow buffer. It reaches the screen
+     *  on the next fb_flush (putchar, puts and write flush for you).
      *
-     *  @param  port The address of the I/O port
-     *  @return      The read byte
+     *  @param  i   Byte offset of the cell (cell index * 2)
 */
-unsigned char inb(unsigned short port);
-
-/* Framebuffer Functions */
 void fb_write_cell(unsigned int i, char c, unsigned char fg, unsigned char bg);
 void fb_move_cursor(unsigned short pos);
+/** fb_flush:
+     *  Copy the dirty rows of the shadow buffer to the framebuffer and move
+     *  the hardware cursor if it changed.
+*/
+void fb_flush(void);
+/** fb_redraw:
+     *  Redraw every cell in view, for a display that lost its contents or
+     *  was just switched to (fbcon_init).
+*/
+void fb_redraw(void);
 void fb_clear(void);
+/** fb_scroll_view:
+     *  Move the displayed window through the scrollback without touching the
+     *  text. Negative rows look back, positive rows come forward; the view
+     *  stops at the oldest kept row and at the live screen. Printing with
+     *  putchar or puts returns to the live screen.
+     *
+     *  @param  rows Number of rows to move the view by
+*/
+void fb_scroll_view(int rows);
+/** fb_scroll_view_reset:
+     *  Show the live screen again.
+*/
+void fb_scroll_view_reset(void);
+
+/** fb_console_select:
+     *  Send putchar, puts, write, fb_write_cell and the cursor functions to
+     *  virtual console n, shown or not. A console is blanked the first time
+     *  it is selected or shown.
+     *
+     *  @param  n   Console, 0 to FB_CONSOLES - 1; others are ignored
+     *  @return     The console selected before
+*/
+unsigned int fb_console_select(unsigned int n);
+/** fb_console_show:
+     *  Put virtual console n on the monitor. In text mode this only moves
+     *  the CRTC start address and the cursor; nothing is redrawn.
+     *  fb_scroll_view works on the shown console.
+*/
+void fb_console_show(unsigned int n);
+/** fb_console_shown:
+     *  @return The console on the monitor
+*/
+unsigned int fb_console_shown(void);
+/** fb_console_set_color:
+     *  Set the colours putchar and puts use on the selected console
+     *  (COLOR_*; FB_TEXT_COLOR is white on black).
+*/
+void fb_console_set_color(unsigned char fg, unsigned char bg);
+/** fb_console_puts / fb_console_putchar:
+     *  puts or putchar on console n, leaving the selection as it was.
+*/
+int fb_console_puts(unsigned int n, char *buf);
+int fb_console_putchar(unsigned int n, char c);
 
 /* Cursor Functions */
 void cursor_move_home(void);
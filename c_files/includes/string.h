@@ -3,6 +3,8 @@
 #ifndef STRING_H
 #define STRING_H
 
+#include "stdarg.h"
+
 /* String Functions */
 
 // length of a string
@@ -23,16 +25,69 @@ int strncmp(const char *str1, const char *str2, unsigned int n);
 void *memset(void *dest, int val, unsigned int n);
 // copy n bytes from src to dest
 void *memcpy(void *dest, const void *src, unsigned int n);
+// copy n bytes from src to dest, the areas may overlap
+void *memmove(void *dest, const void *src, unsigned int n);
 // compare n bytes of two memory areas
 int memcmp(const void *ptr1, const void *ptr2, unsigned int n);
 
 
+/* Memory routine implementations used by memcpy, memset and memmove */
+#define MEM_IMPL_BYTE   0   /* byte loop, used before mem_init() */
+#define MEM_IMPL_REP    1   /* rep movsd / rep stosd */
+#define MEM_IMPL_ERMS   2   /* rep movsb / rep stosb on CPUs with ERMS */
+#define MEM_IMPL_SSE2   3   /* 64-byte SSE2 loops, needs SSE enabled */
+
+// pick the fastest memory routines for this CPU using CPUID, call once at boot
+void mem_init(void);
+// force an implementation (MEM_IMPL_*), returns the previous one or -1 if unusable
+int mem_set_impl(int impl);
+// the implementation currently in use
+int mem_get_impl(void);
+// nonzero while xmm registers must be left alone (interrupt handlers); SSE2 then falls back to rep
+extern volatile unsigned int mem_simd_disabled;
+
+
 // convert a string to an integer
 int atoi(const char *str);
 // convert an integer to a string
 char *itoa(int value, char *str, int base);
 
-// formatting functions using placeholder %d for integers and %s for strings
+/*
+ * Formatting. One engine (vformat) parses the format and hands the output
+ * to a sink in pieces; literal text between conversions is passed as one
+ * piece. Conversions: %c %s %d %i %u %x %X %o %p %%, flags '-' '0' '+' ' ',
+ * width and precision (numbers or '*'), length modifiers hh h l ll z.
+ * %p prints 0x followed by 8 hex digits.
+ */
+
+/* Parsed conversion specification, filled in by fmt_parse */
+#define FMT_LEFT        0x01    /* '-' */
+#define FMT_ZERO        0x02    /* '0' */
+#define FMT_PLUS        0x04    /* '+' */
+#define FMT_SPACE       0x08    /* ' ' */
+#define FMT_STAR        (-2)    /* width or precision comes from the arguments */
+#define FMT_NONE        (-1)    /* no precision given */
+
+struct fmt_spec {
+    unsigned char flags;        /* FMT_LEFT | FMT_ZERO | ... */
+    unsigned char is_long_long; /* ll: the argument is 64 bits wide */
+    char conv;                  /* conversion character, 0 at end of string */
+    int width;                  /* field width, 0 if none, or FMT_STAR */
+    int precision;              /* FMT_NONE, a number, or FMT_STAR */
+};
+
+// receives formatted output, len bytes at a time (not NUL-terminated)
+typedef void (*fmt_sink_t)(void *ctx, const char *s, unsigned int len);
+
+// parse the conversion after a '%', returns the first character after it
+const char *fmt_parse(const char *f, struct fmt_spec *spec);
+// format into a sink, returns the number of characters produced
+int vformat(fmt_sink_t sink, void *ctx, const char *format, va_list ap);
+// format into at most size bytes (always NUL-terminated if size > 0),
+// returns the length the full output would have had
+int vsnprintf(char *str, unsigned int size, const char *format, va_list ap);
+int snprintf(char *str, unsigned int size, const char *format, ...);
+// format without a size limit, prefer snprintf
 int sprintf(char *str, const char *format, ...);
 
 
@@ -0,0 +1,82 @@
+#include "boot_trace.h"
+#include "compiler.h"
+#include "serial.h"
+#include "string.h"
+#include "cpu.h"
+
+/* Written by loader.s before paging is enabled */
+extern unsigned long long boot_tsc_loader;
+
+struct boot_trace_entry {
+    const char *stage;
+    unsigned long long tsc;
+};
+
+static struct boot_trace_entry boot_trace_table[BOOT_TRACE_MAX_STAGES];
+static unsigned int boot_trace_count;
+
+
+void boot_trace(const char *stage)
+{
+    unsigned long long tsc = rdtsc();
+
+    if (boot_trace_count < BOOT_TRACE_MAX_STAGES) {
+        boot_trace_table[boot_trace_count].stage = stage;
+        boot_trace_table[boot_trace_count].tsc = tsc;
+    }
+    boot_trace_count++;
+}
+
+
+/* Tenths of a percent of part in total, without 64-bit division */
+static unsigned int boot_trace_permille(unsigned long long part, unsigned long long total)
+{
+    unsigned long long scaled;
+    unsigned int hi, lo, permille;
+
+    /* Scale both down until the divisor fits one register; part <= total keeps the quotient <= 1000 */
+    while (total >> 32) {
+        part >>= 1;
+        total >>= 1;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    scaled = part * 1000;
+    hi = (unsigned int)(scaled >> 32);
+    lo = (unsigned int)scaled;
+    __asm__("divl %2" : "=a"(permille), "+d"(hi) : "rm"((unsigned int)total), "a"(lo));
+    return permille;
+}
+
+
+void __cold boot_trace_print(void)
+{
+    unsigned int stored = boot_trace_count < BOOT_TRACE_MAX_STAGES ?
+                          boot_trace_count : BOOT_TRACE_MAX_STAGES;
+    unsigned long long total, prev = boot_tsc_loader;
+    char line[96];
+
+    total = stored ? boot_trace_table[stored - 1].tsc - boot_tsc_loader : 0;
+
+    snprintf(line, sizeof(line), "\nboot-trace: %-20s %14s %14s %6s\n",
+             "stage", "end", "cycles", "%");
+    serial_write(line);
+    for (unsigned int i = 0; i < stored; i++) {
+        unsigned long long end = boot_trace_table[i].tsc - boot_tsc_loader;
+        unsigned long long cycles = boot_trace_table[i].tsc - prev;
+        unsigned int permille = boot_trace_permille(cycles, total);
+
+        snprintf(line, sizeof(line), "boot-trace: %-20s %14llu %14llu %4u.%u\n",
+                 boot_trace_table[i].stage, end, cycles, permille / 10, permille % 10);
+        serial_write(line);
+        prev = boot_trace_table[i].tsc;
+    }
+    snprintf(line, sizeof(line), "boot-trace: %-20s %14llu\n", "total", total);
+    serial_write(line);
+    if (boot_trace_count > stored) {
+        snprintf(line, sizeof(line), "boot-trace: %u stages not recorded\n",
+                 boot_trace_count - stored);
+        serial_write(line);
+    }
+}
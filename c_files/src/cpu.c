@@ -0,0 +1,24 @@
+#include "cpu.h"
+
+int cpu_enable_sse(void)
+{
+    unsigned int a, b, c, d;
+
+    if (!cpu_has_cpuid()) {
+        return 0;
+    }
+
+    cpuid(1, 0, &a, &b, &c, &d);
+    if (!(d & CPUID_1_EDX_SSE)) {
+        return 0;
+    }
+
+    /* x87 emulation off, let wait/fwait honour CR0.TS */
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP);
+
+    /* Tell the CPU we save SSE state with fxsave and handle #XM */
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+
+    __asm__ volatile("fninit");
+    return 1;
+}
@@ -0,0 +1,212 @@
+#include "fbcon.h"
+#include "compiler.h"
+#include "font.h"
+#include "stdio.h"
+#include "paging.h"
+#include "string.h"
+#include "cpu.h"
+
+#define FBCON_CELLS             (FB_ROWS * FB_COLUMNS)
+#define FBCON_CURSOR_HIDDEN     FBCON_CELLS
+#define FBCON_BLANK_CELL        (FB_EMPTY_CELL | (FB_DEFAULT_COLOR << 8))
+
+/* The 16 text-mode colours, as 0xRRGGBB */
+static const unsigned int fbcon_vga_rgb[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF,
+};
+
+/*
+ * Glyph cache: for each cached attribute, every possible font row (one
+ * byte, bit 0 leftmost) expanded to FBCON_CELL_WIDTH pixels of its
+ * foreground and background colour. 32 bytes per row, aligned for SSE
+ * loads. Slots are reused round-robin.
+ */
+static unsigned int fbcon_glyph_rows[FBCON_ATTR_SLOTS][256][FBCON_CELL_WIDTH] __attribute__((aligned(16)));
+static unsigned short fbcon_slot_attr[FBCON_ATTR_SLOTS];   /* attribute + 1, 0 if unused */
+static unsigned int fbcon_next_slot;
+
+static int fbcon_enabled;
+static unsigned char *fbcon_base;           /* top-left pixel of the text area */
+static unsigned int fbcon_pitch;            /* bytes per pixel row */
+static unsigned int fbcon_palette[16];      /* fbcon_vga_rgb in the framebuffer's format */
+static unsigned short fbcon_screen[FBCON_CELLS];    /* the cell each position shows */
+static unsigned int fbcon_cursor = FBCON_CURSOR_HIDDEN;
+
+
+/* One colour channel, 8 bits wide, moved to where the framebuffer wants it */
+static unsigned int fbcon_channel(unsigned int value, unsigned char pos, unsigned char size)
+{
+    if (size > 8) {
+        size = 8;
+    }
+    return (value >> (8 - size)) << pos;
+}
+
+
+static const unsigned int (*fbcon_glyph_cache(unsigned char attr))[FBCON_CELL_WIDTH]
+{
+    unsigned int (*rows)[FBCON_CELL_WIDTH];
+    unsigned int fg = fbcon_palette[attr & 0x0F];
+    unsigned int bg = fbcon_palette[attr >> 4];
+    unsigned int slot;
+
+    for (slot = 0; slot < FBCON_ATTR_SLOTS; slot++) {
+        if (fbcon_slot_attr[slot] == attr + 1) {
+            return (const unsigned int (*)[FBCON_CELL_WIDTH])fbcon_glyph_rows[slot];
+        }
+    }
+
+    slot = fbcon_next_slot;
+    fbcon_next_slot = (slot + 1) % FBCON_ATTR_SLOTS;
+    rows = fbcon_glyph_rows[slot];
+    for (unsigned int bits = 0; bits < 256; bits++) {
+        for (unsigned int x = 0; x < FBCON_CELL_WIDTH; x++) {
+            rows[bits][x] = (bits >> x) & 1 ? fg : bg;
+        }
+    }
+    fbcon_slot_attr[slot] = attr + 1;
+    return (const unsigned int (*)[FBCON_CELL_WIDTH])rows;
+}
+
+
+/* Copies one 32-byte pixel row per line of the cell, two 16-byte stores each */
+__attribute__((target("sse2")))
+static void fbcon_blit_sse2(unsigned char *dst, const unsigned int *const *src)
+{
+    for (unsigned int y = 0; y < FBCON_CELL_HEIGHT; y++, dst += fbcon_pitch) {
+        __asm__ volatile(
+            "movdqa   (%1), %%xmm0\n\t"
+            "movdqa 16(%1), %%xmm1\n\t"
+            "movdqu %%xmm0,   (%0)\n\t"
+            "movdqu %%xmm1, 16(%0)"
+            :
+            : "r"(dst), "r"(src[y])
+            : "memory", "xmm0", "xmm1");
+    }
+}
+
+
+static void fbcon_blit_scalar(unsigned char *dst, const unsigned int *const *src)
+{
+    for (unsigned int y = 0; y < FBCON_CELL_HEIGHT; y++, dst += fbcon_pitch) {
+        volatile unsigned int *out = (volatile unsigned int *)dst;
+
+        for (unsigned int x = 0; x < FBCON_CELL_WIDTH; x++) {
+            out[x] = src[y][x];
+        }
+    }
+}
+
+
+static void fbcon_render(unsigned int pos, unsigned short cell)
+{
+    unsigned char c = cell & 0xFF;
+    const unsigned int (*rows)[FBCON_CELL_WIDTH] = fbcon_glyph_cache(cell >> 8);
+    const unsigned char *glyph;
+    const unsigned int *src[FBCON_CELL_HEIGHT];
+    unsigned char *dst;
+
+    if (c < FONT_FIRST_CHAR || c > FONT_LAST_CHAR) {
+        c = '?';
+    }
+    glyph = font8x8[c - FONT_FIRST_CHAR];
+    for (unsigned int y = 0; y < FBCON_CELL_HEIGHT; y++) {
+        src[y] = rows[glyph[y * FONT_HEIGHT / FBCON_CELL_HEIGHT]];
+    }
+    if (pos == fbcon_cursor) {
+        for (unsigned int y = FBCON_CELL_HEIGHT - FBCON_CURSOR_HEIGHT; y < FBCON_CELL_HEIGHT; y++) {
+            src[y] = rows[0xFF];
+        }
+    }
+
+    dst = fbcon_base + (pos / FB_COLUMNS) * FBCON_CELL_HEIGHT * fbcon_pitch +
+          (pos % FB_COLUMNS) * FBCON_CELL_WIDTH * (FBCON_BPP / 8);
+    /* Interrupt entry does not save xmm registers (see mem_simd_disabled) */
+    if (cpu_sse_enabled() && !mem_simd_disabled) {
+        fbcon_blit_sse2(dst, src);
+    } else {
+        fbcon_blit_scalar(dst, src);
+    }
+}
+
+
+int __init fbcon_init(struct multiboot_info *mbi)
+{
+    unsigned char *fb;
+    unsigned int x, y;
+
+    if (!(mbi->flags & MULTIBOOT_INFO_FRAMEBUFFER_INFO) ||
+        mbi->framebuffer_type != MULTIBOOT_FRAMEBUFFER_TYPE_RGB ||
+        mbi->framebuffer_bpp != FBCON_BPP ||
+        (mbi->framebuffer_addr >> 32) != 0 ||
+        mbi->framebuffer_width < FB_COLUMNS * FBCON_CELL_WIDTH ||
+        mbi->framebuffer_height < FB_ROWS * FBCON_CELL_HEIGHT) {
+        return -1;
+    }
+    fb = paging_map_mmio((unsigned int)mbi->framebuffer_addr,
+                         mbi->framebuffer_pitch * mbi->framebuffer_height);
+    if (!fb) {
+        return -1;
+    }
+
+    /* color_info: red position and size, then green, then blue */
+    for (unsigned int i = 0; i < 16; i++) {
+        unsigned int rgb = fbcon_vga_rgb[i];
+
+        fbcon_palette[i] = fbcon_channel((rgb >> 16) & 0xFF, mbi->color_info[0], mbi->color_info[1]) |
+                           fbcon_channel((rgb >> 8) & 0xFF, mbi->color_info[2], mbi->color_info[3]) |
+                           fbcon_channel(rgb & 0xFF, mbi->color_info[4], mbi->color_info[5]);
+    }
+
+    /* Text area centred on the screen; the rest stays black */
+    x = (mbi->framebuffer_width - FB_COLUMNS * FBCON_CELL_WIDTH) / 2;
+    y = (mbi->framebuffer_height - FB_ROWS * FBCON_CELL_HEIGHT) / 2;
+    fbcon_pitch = mbi->framebuffer_pitch;
+    fbcon_base = fb + y * fbcon_pitch + x * (FBCON_BPP / 8);
+
+    /* A black screen shows blank cells; only the rest need drawing */
+    memset(fb, 0, mbi->framebuffer_pitch * mbi->framebuffer_height);
+    for (unsigned int i = 0; i < FBCON_CELLS; i++) {
+        fbcon_screen[i] = FBCON_BLANK_CELL;
+    }
+    fbcon_enabled = 1;
+    fb_redraw();
+    return 0;
+}
+
+
+int fbcon_active(void)
+{
+    return fbcon_enabled;
+}
+
+
+void fbcon_draw_cell(unsigned int col, unsigned int row, unsigned short cell)
+{
+    unsigned int pos = row * FB_COLUMNS + col;
+
+    if (fbcon_screen[pos] == cell) {
+        return;
+    }
+    fbcon_screen[pos] = cell;
+    fbcon_render(pos, cell);
+}
+
+
+void fbcon_set_cursor(unsigned int col, unsigned int row)
+{
+    unsigned int pos = row < FB_ROWS && col < FB_COLUMNS ? row * FB_COLUMNS + col : FBCON_CURSOR_HIDDEN;
+    unsigned int old = fbcon_cursor;
+
+    if (pos == old) {
+        return;
+    }
+    fbcon_cursor = pos;
+    if (old != FBCON_CURSOR_HIDDEN) {
+        fbcon_render(old, fbcon_screen[old]);
+    }
+    if (pos != FBCON_CURSOR_HIDDEN) {
+        fbcon_render(pos, fbcon_screen[pos]);
+    }
+}
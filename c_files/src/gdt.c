@@ -1,8 +1,12 @@
 #include "descriptor.h"
+#include "percpu.h"
+#include "string.h"
 
-/* The actual GDT entries */
-static struct gdt_entry gdt[GDT_NUM_ENTRIES];
-static struct gdt_ptr   gp;
+/* Per-CPU data, GDT and TSS of every CPU; cpus[0] is the bootstrap processor */
+struct cpu cpus[SMP_MAX_CPUS];
+
+/* Top of the boot stack in asm/loader.s, the bootstrap processor's stack */
+extern unsigned char kernel_stack_top[];
 
 /* Defined in asm/gdt.s */
 extern void gdt_load(unsigned int gdt_ptr_addr);
@@ -23,8 +27,8 @@ extern void gdt_load(unsigned int gdt_ptr_addr);
  *   Bit 4    : Available (AVL)   - 0
  *   Bits 3-0 : Limit bits 19:16
  */
-static void gdt_set_entry(int index, unsigned int base, unsigned int limit,
-                           unsigned char access, unsigned char gran)
+static void gdt_set_entry(struct gdt_entry *gdt, int index, unsigned int base,
+                          unsigned int limit, unsigned char access, unsigned char gran)
 {
     /*
      * The 32-bit base address is split across three fields in the descriptor:
@@ -53,14 +57,25 @@ static void gdt_set_entry(int index, unsigned int base, unsigned int limit,
 
 void gdt_init(void)
 {
+    cpus[0].stack_top = kernel_stack_top;
+    gdt_init_cpu(&cpus[0]);
+}
+
+void gdt_init_cpu(struct cpu *cpu)
+{
+    struct gdt_entry *gdt = cpu->gdt;
+    struct gdt_ptr *gp = &cpu->gdt_ptr;
+
+    cpu->self = cpu;
+
     /*
      * GDTR 'size' field = total bytes of GDT minus 1.
      * sizeof(gdt_entry) is always 8 (the CPU-defined descriptor size).
-     * With 3 entries: (8 * 3) - 1 = 23 = 0x17.
+     * With 5 entries: (8 * 5) - 1 = 39 = 0x27.
      * The "-1" is required by the CPU — lgdt expects the last valid byte offset.
      */
-    gp.size    = (sizeof(struct gdt_entry) * GDT_NUM_ENTRIES) - 1;
-    gp.address = (unsigned int)&gdt;
+    gp->size    = (sizeof(struct gdt_entry) * GDT_NUM_ENTRIES) - 1;
+    gp->address = (unsigned int)gdt;
 
     /*
      * Entry 0 (index 0) — Null descriptor.
@@ -68,7 +83,7 @@ void gdt_init(void)
      * any segment selector that points here (selector = 0x00) will
      * cause a General Protection Fault if used to access memory.
      */
-    gdt_set_entry(0, 0, 0, 0, 0);
+    gdt_set_entry(gdt, 0, 0, 0, 0, 0);
 
     /*
      * Entry 1 (index 1) — Kernel Code Segment
@@ -93,7 +108,7 @@ void gdt_init(void)
      *     Bit 4   AVL  = 0    Available for OS use (unused)
      *     Bit 3-0 Lim  = 0xF  Upper 4 bits of 20-bit limit (0xFFFFF)
      */
-    gdt_set_entry(1, 0x00000000, 0xFFFFF, 0x9A, 0xCF);
+    gdt_set_entry(gdt, 1, 0x00000000, 0xFFFFF, 0x9A, 0xCF);
 
     /*
      * Entry 2 (index 2) — Kernel Data Segment
@@ -114,8 +129,53 @@ void gdt_init(void)
      *   Granularity byte = 0xCF  (same as code segment)
      *     G=1, D=1, L=0, AVL=0, Limit[19:16]=0xF
      */
-    gdt_set_entry(2, 0x00000000, 0xFFFFF, 0x92, 0xCF);
+    gdt_set_entry(gdt, 2, 0x00000000, 0xFFFFF, 0x92, 0xCF);
+
+    /*
+     * Entry 3 (index 3) — Per-CPU Data Segment
+     *   Selector = index * 8 = 0x18
+     *
+     *   Base  = this CPU's struct cpu, so %gs:0 is cpu->self
+     *   Limit = sizeof(struct cpu) - 1, in bytes
+     *
+     *   Access byte = 0x92  (same as the kernel data segment)
+     *
+     *   Granularity byte = 0x40  (binary: 0100 0000)
+     *     G=0 (byte granular limit), D=1, L=0, AVL=0
+     */
+    gdt_set_entry(gdt, 3, (unsigned int)cpu, sizeof(struct cpu) - 1, 0x92, 0x40);
+
+    /*
+     * Entry 4 (index 4) — Task State Segment
+     *   Selector = index * 8 = 0x20
+     *
+     *   Base  = this CPU's struct tss
+     *   Limit = sizeof(struct tss) - 1, in bytes
+     *
+     *   Access byte = 0x89  (binary: 1000 1001)
+     *     Bit 7   P    = 1    Present
+     *     Bit 6-5 DPL  = 00   Ring 0
+     *     Bit 4   S    = 0    System descriptor
+     *     Bit 3-0 Type = 1001 Available 32-bit TSS (ltr marks it busy, 1011)
+     *
+     *   Granularity byte = 0x00  (byte granular limit)
+     *
+     * The TSS only matters once code runs outside ring 0: the CPU then
+     * switches to ss0:esp0 on an interrupt. An I/O bitmap offset at the
+     * limit means there is no bitmap.
+     */
+    memset(&cpu->tss, 0, sizeof(cpu->tss));
+    cpu->tss.ss0 = GDT_KERNEL_DATA_SELECTOR;
+    cpu->tss.esp0 = (unsigned int)cpu->stack_top;
+    cpu->tss.iomap_base = sizeof(struct tss);
+    gdt_set_entry(gdt, 4, (unsigned int)&cpu->tss, sizeof(struct tss) - 1, 0x89, 0x00);
 
     /* Load the GDT and flush segment registers */
-    gdt_load((unsigned int)&gp);
+    gdt_load((unsigned int)gp);
+
+    /* gdt_load leaves every data segment flat; %gs becomes the per-CPU segment */
+    __asm__ volatile("mov %0, %%gs\n\t"
+                     "ltr %1"
+                     : : "r"(GDT_PERCPU_SELECTOR), "r"((unsigned short)GDT_TSS_SELECTOR)
+                     : "memory");
 }
@@ -0,0 +1,205 @@
+#include "descriptor.h"
+#include "compiler.h"
+#include "interrupt.h"
+#include "pic.h"
+#include "cpu.h"
+#include "log.h"
+#include "log_sink.h"
+#include "serial.h"
+#include "string.h"
+#include "sched.h"
+#include "ksyms.h"
+#include "stdio.h"
+
+/* The IDT itself — 256 gates; vectors without a stub stay not-present */
+static struct idt_entry idt[IDT_NUM_ENTRIES];
+
+/* Entry stub of every vector below INTERRUPT_NUM_VECTORS, from asm/interrupt.s */
+extern const unsigned int interrupt_stubs[INTERRUPT_NUM_VECTORS];
+
+static interrupt_handler_t interrupt_handlers[INTERRUPT_NUM_VECTORS];
+static struct interrupt_stats interrupt_counters[INTERRUPT_NUM_VECTORS];
+static unsigned int interrupt_spurious;
+
+static const char *const exception_names[INTERRUPT_NUM_EXCEPTIONS] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow", "bound range",
+    "invalid opcode", "device not available", "double fault", "coprocessor overrun",
+    "invalid TSS", "segment not present", "stack fault", "general protection",
+    "page fault", "reserved", "x87 FP error", "alignment check", "machine check",
+    "SIMD FP error", "virtualization", "control protection",
+};
+
+
+static void idt_set_gate(unsigned int vector, unsigned int handler)
+{
+    idt[vector].offset_low  = handler & 0xFFFF;
+    idt[vector].selector    = GDT_KERNEL_CODE_SELECTOR;
+    idt[vector].zero        = 0;
+    idt[vector].type_attr   = IDT_INTERRUPT_GATE;
+    idt[vector].offset_high = (handler >> 16) & 0xFFFF;
+}
+
+
+void __init idt_init(void)
+{
+    for (unsigned int vector = 0; vector < INTERRUPT_NUM_VECTORS; vector++) {
+        idt_set_gate(vector, interrupt_stubs[vector]);
+    }
+    idt_load();
+}
+
+
+void idt_load(void)
+{
+    struct idt_ptr ptr;
+
+    ptr.size = sizeof(idt) - 1;
+    ptr.address = (unsigned int)idt;
+    __asm__ volatile("lidt %0" : : "m"(ptr));
+}
+
+
+void __init interrupt_init(void)
+{
+    idt_init();
+    pic_init(IRQ_VECTOR(0), IRQ_VECTOR(8));
+}
+
+
+void interrupt_register(unsigned int vector, interrupt_handler_t handler)
+{
+    unsigned int flags;
+
+    if (vector >= INTERRUPT_NUM_VECTORS) {
+        return;
+    }
+    flags = irq_save();
+    interrupt_handlers[vector] = handler;
+    if (vector >= IRQ_BASE_VECTOR) {
+        if (handler) {
+            pic_unmask_irq(vector - IRQ_BASE_VECTOR);
+        } else {
+            pic_mask_irq(vector - IRQ_BASE_VECTOR);
+        }
+    }
+    irq_restore(flags);
+}
+
+
+/** interrupt_fatal:
+ *  An exception nobody handles: report it and stop this CPU. klogd will
+ *  not run again, so the log sinks and the serial ring are drained here,
+ *  by polling because interrupts stay off from here on.
+ */
+static void __cold interrupt_fatal(struct interrupt_frame *frame)
+{
+    unsigned int cr2 = 0;
+
+    if (frame->vector == EXCEPTION_PAGE_FAULT) {
+        __asm__ volatile("movl %%cr2, %0" : "=r"(cr2));
+    }
+    /* The report goes to the log console; bring it to the front */
+    fb_console_show(FB_CONSOLE_LOG);
+    log_printf("\nUnhandled exception %u (%s), error code %x\n",
+               frame->vector,
+               exception_names[frame->vector] ? exception_names[frame->vector] : "reserved",
+               frame->error_code);
+    log_printf("eip %p  eflags %x  eax %x  ecx %x  edx %x  cr2 %p\n",
+               (void *)frame->eip, frame->eflags, frame->eax, frame->ecx,
+               frame->edx, (void *)cr2);
+    log_printf("Backtrace:\n");
+    ksyms_backtrace(frame->eip, frame->ebp, INTERRUPT_BACKTRACE_DEPTH);
+    log_flush();
+    serial_flush();
+    for (;;) {
+        __asm__ volatile("cli\n\thlt");
+    }
+}
+
+
+void __hot interrupt_dispatch(struct interrupt_frame *frame)
+{
+    unsigned long long start = rdtsc();
+    unsigned int vector = frame->vector;
+    interrupt_handler_t handler = interrupt_handlers[vector];
+    struct interrupt_stats *stats = &interrupt_counters[vector];
+    unsigned int cycles;
+
+    mem_simd_disabled++;
+    if (vector < IRQ_BASE_VECTOR) {
+        if (!handler) {
+            interrupt_fatal(frame);
+        }
+        handler(frame);
+    } else {
+        unsigned int irq = vector - IRQ_BASE_VECTOR;
+
+        if ((!handler && irq == 7) || pic_is_spurious(irq)) {
+            interrupt_spurious++;
+            mem_simd_disabled--;
+            return;
+        }
+        if (handler) {
+            handler(frame);
+        }
+        pic_eoi(irq);
+    }
+    mem_simd_disabled--;
+
+    cycles = (unsigned int)(rdtsc() - start);
+    stats->count++;
+    stats->cycles += cycles;
+    if (cycles > stats->max_cycles) {
+        stats->max_cycles = cycles;
+    }
+
+    /* Preempt only code that could have been interrupted anyway */
+    if (sched_need_resched && (frame->eflags & EFLAGS_IF)) {
+        sched_preempt();
+    }
+}
+
+
+void interrupt_stats(unsigned int vector, struct interrupt_stats *stats)
+{
+    unsigned int flags;
+
+    if (vector >= INTERRUPT_NUM_VECTORS) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    flags = irq_save();
+    *stats = interrupt_counters[vector];
+    irq_restore(flags);
+}
+
+
+unsigned int interrupt_spurious_count(void)
+{
+    return interrupt_spurious;
+}
+
+
+void __cold interrupt_print_stats(void)
+{
+    log_printf("%-6s %10s %14s %8s %8s\n", "vector", "count", "cycles", "avg", "max");
+    for (unsigned int vector = 0; vector < INTERRUPT_NUM_VECTORS; vector++) {
+        struct interrupt_stats s;
+        unsigned int hi, lo, avg = 0;
+
+        interrupt_stats(vector, &s);
+        if (s.count == 0) {
+            continue;
+        }
+        /* 64 by 32 bit divide without libgcc; the quotient fits unless the average does not */
+        hi = (unsigned int)(s.cycles >> 32);
+        lo = (unsigned int)s.cycles;
+        if (hi < s.count) {
+            __asm__("divl %2" : "=a"(avg), "+d"(hi) : "rm"(s.count), "a"(lo));
+        } else {
+            avg = 0xFFFFFFFF;
+        }
+        log_printf("%-6u %10u %14llu %8u %8u\n", vector, s.count, s.cycles, avg, s.max_cycles);
+    }
+    log_printf("spurious %u\n", interrupt_spurious);
+}
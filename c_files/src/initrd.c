@@ -0,0 +1,279 @@
+#include "initrd.h"
+#include "compiler.h"
+#include "paging.h"
+#include "string.h"
+
+#define TAR_BLOCK_SIZE          512
+#define TAR_NAME_SIZE           100
+#define TAR_SIZE_OFFSET         124
+#define TAR_SIZE_LEN            12
+#define TAR_TYPE_OFFSET         156
+#define TAR_MAGIC_OFFSET        257
+#define TAR_PREFIX_OFFSET       345
+#define TAR_TYPE_REGULAR        '0'
+#define TAR_TYPE_REGULAR_OLD    '\0'
+
+#define CPIO_HEADER_SIZE        110
+#define CPIO_FIELD_LEN          8
+#define CPIO_FIELD_MODE         1           /* field indexes after the magic */
+#define CPIO_FIELD_FILESIZE     6
+#define CPIO_FIELD_NAMESIZE     11
+#define CPIO_MODE_TYPE_MASK     0170000
+#define CPIO_MODE_REGULAR       0100000
+#define CPIO_TRAILER            "TRAILER!!!"
+
+/* "070701", or "070702" with checksums, which have the same layout */
+#define cpio_is_newc(p) (memcmp((p), "07070", 5) == 0 && ((p)[5] == '1' || (p)[5] == '2'))
+
+struct initrd_file {
+    const char *name;               /* inside the module, not NUL-terminated */
+    unsigned int name_len;
+    const void *data;
+    unsigned int size;
+    unsigned int hash;
+};
+
+static struct initrd_file initrd_files[INITRD_MAX_FILES];
+static unsigned int initrd_count;
+static unsigned short initrd_slots[INITRD_HASH_SLOTS];    /* file index + 1, 0 if empty */
+
+
+/* FNV-1a */
+static unsigned int initrd_hash(const char *name, unsigned int len)
+{
+    unsigned int hash = 2166136261u;
+
+    for (unsigned int i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+/* Drops a leading "/" or "./", as often as they repeat */
+static const char *initrd_skip_root(const char *name, unsigned int *len)
+{
+    for (;;) {
+        if (*len >= 1 && name[0] == '/') {
+            name++;
+            (*len)--;
+        } else if (*len >= 2 && name[0] == '.' && name[1] == '/') {
+            name += 2;
+            *len -= 2;
+        } else {
+            return name;
+        }
+    }
+}
+
+
+/* Slot of the file named name, or of the empty slot where it would go */
+static unsigned short *initrd_find_slot(const char *name, unsigned int len, unsigned int hash)
+{
+    unsigned int i = hash;
+
+    for (;;) {
+        unsigned short *slot = &initrd_slots[i & (INITRD_HASH_SLOTS - 1)];
+        struct initrd_file *file;
+
+        if (!*slot) {
+            return slot;
+        }
+        file = &initrd_files[*slot - 1];
+        if (file->hash == hash && file->name_len == len && memcmp(file->name, name, len) == 0) {
+            return slot;
+        }
+        i++;
+    }
+}
+
+
+/* A later entry with the same path replaces the earlier one, as tar -x would */
+static void initrd_add(const char *name, unsigned int len, const void *data, unsigned int size)
+{
+    struct initrd_file *file;
+    unsigned short *slot;
+    unsigned int hash;
+
+    name = initrd_skip_root(name, &len);
+    if (len == 0 || (len == 1 && name[0] == '.')) {
+        return;
+    }
+    hash = initrd_hash(name, len);
+    slot = initrd_find_slot(name, len, hash);
+    if (*slot) {
+        file = &initrd_files[*slot - 1];
+    } else {
+        /* Also keeps the table at most half full, so probing always ends */
+        if (initrd_count == INITRD_MAX_FILES) {
+            return;
+        }
+        file = &initrd_files[initrd_count++];
+        *slot = initrd_count;
+    }
+    file->name = name;
+    file->name_len = len;
+    file->data = data;
+    file->size = size;
+    file->hash = hash;
+}
+
+
+/* Value of a number field, or -1 if a character is not a digit of base */
+static int initrd_parse_number(const char *field, unsigned int len, unsigned int base)
+{
+    unsigned int value = 0;
+
+    for (unsigned int i = 0; i < len; i++) {
+        char c = field[i];
+        unsigned int digit;
+
+        /* tar pads with spaces or NULs */
+        if (base == 8 && (c == ' ' || c == '\0')) {
+            if (value) {
+                break;
+            }
+            continue;
+        }
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return -1;
+        }
+        if (digit >= base) {
+            return -1;
+        }
+        value = value * base + digit;
+    }
+    return (int)value;
+}
+
+
+/* ustar: 512-byte headers, data padded to 512, ended by a zero block */
+static void initrd_index_tar(const char *start, unsigned int size)
+{
+    unsigned int pos = 0;
+
+    while (pos + TAR_BLOCK_SIZE <= size && start[pos] != '\0') {
+        const char *hdr = start + pos;
+        int file_size = initrd_parse_number(hdr + TAR_SIZE_OFFSET, TAR_SIZE_LEN, 8);
+        char type = hdr[TAR_TYPE_OFFSET];
+        unsigned int name_len = 0;
+
+        if (file_size < 0 || (unsigned int)file_size > size - pos - TAR_BLOCK_SIZE) {
+            return;
+        }
+        while (name_len < TAR_NAME_SIZE && hdr[name_len] != '\0') {
+            name_len++;
+        }
+        /* A prefix makes the path two pieces, which a lookup could not return in place */
+        if ((type == TAR_TYPE_REGULAR || type == TAR_TYPE_REGULAR_OLD) &&
+            hdr[TAR_PREFIX_OFFSET] == '\0') {
+            initrd_add(hdr, name_len, hdr + TAR_BLOCK_SIZE, file_size);
+        }
+        pos += TAR_BLOCK_SIZE + ((file_size + TAR_BLOCK_SIZE - 1) & ~(TAR_BLOCK_SIZE - 1));
+    }
+}
+
+
+/* newc: 110-byte hex header, name, data, each padded to 4 bytes; ends with TRAILER!!! */
+static void initrd_index_cpio(const char *start, unsigned int size)
+{
+    unsigned int pos = 0;
+
+    while (pos + CPIO_HEADER_SIZE <= size && cpio_is_newc(start + pos)) {
+        const char *hdr = start + pos;
+        const char *fields = hdr + 6;
+        int mode = initrd_parse_number(fields + CPIO_FIELD_MODE * CPIO_FIELD_LEN, CPIO_FIELD_LEN, 16);
+        int file_size = initrd_parse_number(fields + CPIO_FIELD_FILESIZE * CPIO_FIELD_LEN, CPIO_FIELD_LEN, 16);
+        int name_size = initrd_parse_number(fields + CPIO_FIELD_NAMESIZE * CPIO_FIELD_LEN, CPIO_FIELD_LEN, 16);
+        unsigned int data;
+
+        if (mode < 0 || file_size < 0 || name_size < 1 ||
+            (unsigned int)name_size > size - pos - CPIO_HEADER_SIZE) {
+            return;
+        }
+        data = (pos + CPIO_HEADER_SIZE + name_size + 3) & ~3u;
+        if (data > size || (unsigned int)file_size > size - data) {
+            return;
+        }
+        /* namesize counts the terminating NUL */
+        if (name_size == sizeof(CPIO_TRAILER) && memcmp(hdr + CPIO_HEADER_SIZE, CPIO_TRAILER, name_size) == 0) {
+            return;
+        }
+        if ((mode & CPIO_MODE_TYPE_MASK) == CPIO_MODE_REGULAR) {
+            initrd_add(hdr + CPIO_HEADER_SIZE, name_size - 1, start + data, file_size);
+        }
+        pos = (data + file_size + 3) & ~3u;
+    }
+}
+
+
+int __init initrd_init(struct multiboot_info *mbi)
+{
+    struct multiboot_module *mod;
+    const char *start;
+    unsigned int size;
+
+    if (!(mbi->flags & MULTIBOOT_INFO_MODS) || mbi->mods_count == 0) {
+        return -1;
+    }
+    mod = phys_to_virt(mbi->mods_addr);
+    if (mod->mod_end <= mod->mod_start) {
+        return -1;
+    }
+    size = mod->mod_end - mod->mod_start;
+    /* GRUB puts modules right after the kernel, inside the direct map */
+    start = paging_map_mmio(mod->mod_start, size);
+    if (!start) {
+        return -1;
+    }
+
+    if (size >= CPIO_HEADER_SIZE && cpio_is_newc(start)) {
+        initrd_index_cpio(start, size);
+    } else if (size >= TAR_BLOCK_SIZE && memcmp(start + TAR_MAGIC_OFFSET, "ustar", 5) == 0) {
+        initrd_index_tar(start, size);
+    } else {
+        return -1;
+    }
+    return initrd_count;
+}
+
+
+const void *initrd_open(const char *path, unsigned int *size)
+{
+    unsigned int len = strlen(path);
+    unsigned short *slot;
+    struct initrd_file *file;
+
+    path = initrd_skip_root(path, &len);
+    slot = initrd_find_slot(path, len, initrd_hash(path, len));
+    if (!*slot) {
+        return 0;
+    }
+    file = &initrd_files[*slot - 1];
+    if (size) {
+        *size = file->size;
+    }
+    return file->data;
+}
+
+
+unsigned int initrd_file_count(void)
+{
+    return initrd_count;
+}
+
+
+const char *initrd_file_name(unsigned int index, unsigned int *len)
+{
+    if (index >= initrd_count) {
+        return 0;
+    }
+    *len = initrd_files[index].name_len;
+    return initrd_files[index].name;
+}
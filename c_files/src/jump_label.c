@@ -0,0 +1,85 @@
+#include "jump_label.h"
+#include "compiler.h"
+#include "cpu.h"
+
+/* Defined in linker/link.ld around the __jump_table entries */
+extern struct jump_entry __jump_table_start[];
+extern struct jump_entry __jump_table_end[];
+
+#define JUMP_LABEL_SIZE 5
+#define JUMP_LABEL_JMP  0xE9    /* jmp rel32 */
+
+static const unsigned char jump_label_nop[JUMP_LABEL_SIZE] = { 0x0F, 0x1F, 0x44, 0x00, 0x00 };
+
+
+static void jump_label_patch(struct jump_entry *entry, int enabled)
+{
+    unsigned char *code = (unsigned char *)entry->code;
+    int rel = entry->target - (entry->code + JUMP_LABEL_SIZE);
+
+    if (enabled) {
+        for (int i = 0; i < JUMP_LABEL_SIZE; i++) {
+            code[i] = jump_label_nop[i];
+        }
+    } else {
+        code[0] = JUMP_LABEL_JMP;
+        code[1] = rel & 0xFF;
+        code[2] = (rel >> 8) & 0xFF;
+        code[3] = (rel >> 16) & 0xFF;
+        code[4] = (rel >> 24) & 0xFF;
+    }
+}
+
+
+/*
+ * Interrupts stay off so no handler runs a half-written instruction.
+ * Entries with code 0 are dead: their site was in released __init code.
+ */
+static void jump_label_update(struct static_key *key)
+{
+    unsigned int flags = irq_save();
+
+    for (struct jump_entry *entry = __jump_table_start; entry < __jump_table_end; entry++) {
+        if (entry->code && (!key || entry->key == key)) {
+            jump_label_patch(entry, entry->key->enabled);
+        }
+    }
+    irq_restore(flags);
+}
+
+
+void __init jump_label_init(void)
+{
+    jump_label_update(0);
+}
+
+
+void jump_label_release(unsigned int start, unsigned int end)
+{
+    unsigned int flags = irq_save();
+
+    for (struct jump_entry *entry = __jump_table_start; entry < __jump_table_end; entry++) {
+        if (entry->code >= start && entry->code < end) {
+            entry->code = 0;
+        }
+    }
+    irq_restore(flags);
+}
+
+
+void static_key_enable(struct static_key *key)
+{
+    if (!key->enabled) {
+        key->enabled = 1;
+        jump_label_update(key);
+    }
+}
+
+
+void static_key_disable(struct static_key *key)
+{
+    if (key->enabled) {
+        key->enabled = 0;
+        jump_label_update(key);
+    }
+}
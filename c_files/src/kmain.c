@@ -2,18 +2,127 @@
 #include "string.h"
 #include "serial.h"
 #include "descriptor.h"
+#include "interrupt.h"
+#include "cpu.h"
+#include "jump_label.h"
+#include "multiboot.h"
+#include "paging.h"
+#include "pmm.h"
+#include "slab.h"
+#include "pit.h"
+#include "profile.h"
+#include "boot_trace.h"
+#include "sched.h"
+#include "smp.h"
+#include "initrd.h"
+#include "fbcon.h"
+#include "log_sink.h"
+#ifdef KERNEL_BENCH
+#include "kbench.h"
+#endif
 
 
-void kmain()
+static void serial_com1_irq(struct interrupt_frame *frame)
+{
+    (void)frame;
+    serial_tx_irq_handler(SERIAL_COM1_BASE);
+}
+
+
+/*
+ * loader.s pushes ebx and eax, which GRUB sets to the info pointer and
+ * magic. The pointer is physical.
+ */
+void kmain(unsigned int magic, struct multiboot_info *mbi)
 {
     gdt_init();
+    boot_trace("gdt_init");
+    interrupt_init();
+    boot_trace("interrupt_init");
+    paging_init();
+    mbi = phys_to_virt(mbi);
+    boot_trace("paging_init");
+    jump_label_init();
+    boot_trace("jump_label_init");
+    cpu_enable_sse();
+    mem_init();
+    boot_trace("mem_init");
 
     serial_begin(9600);
+    interrupt_register(IRQ_VECTOR(IRQ_COM1), serial_com1_irq);
+    serial_tx_irq_enable_com(SERIAL_COM1_BASE);
+    boot_trace("serial_begin");
+    /* 1 ms ticks; the profiler samples from the tick once profile_start runs */
+    pit_init(1000);
+    profile_init();
+    irq_enable();
+    boot_trace("pit_init");
+
     fb_clear();
+    boot_trace("fb_clear");
     cursor_move_home();
+    boot_trace("cursor_move_home");
     
     char buf[128];
-    sprintf(buf, "OS loaded. Version: %d. Subsystem: %s. Code: %c", 1, "String", 'A');
+    snprintf(buf, sizeof(buf), "OS loaded. Version: %d. Subsystem: %s. Code: %c", 1, "String", 'A');
+    serial_write(buf);
+    puts(buf);
+    boot_trace("banner");
+
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || pmm_init(mbi) < 0) {
+        snprintf(buf, sizeof(buf), "\nNo multiboot memory information (magic %x)", magic);
+    } else {
+        snprintf(buf, sizeof(buf), "\nMemory: %u KiB usable, %u KiB free",
+                 pmm_total_frames() * (PMM_FRAME_SIZE / 1024),
+                 pmm_free_frames() * (PMM_FRAME_SIZE / 1024));
+    }
+    boot_trace("pmm_init");
+    /* Takes the console over from VGA text mode if GRUB set up a framebuffer */
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC) {
+        fbcon_init(mbi);
+    }
+    boot_trace("fbcon_init");
     serial_write(buf);
     puts(buf);
+
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC && initrd_init(mbi) >= 0) {
+        const char *motd;
+        unsigned int size;
+
+        snprintf(buf, sizeof(buf), "\ninitrd: %u files\n", initrd_file_count());
+        serial_write(buf);
+        motd = initrd_open("/etc/motd", &size);
+        if (motd) {
+            serial_write_buf(motd, size);
+        }
+    }
+    boot_trace("initrd_init");
+
+    /* Without a memory map the caches exist but every allocation fails */
+    kmem_init();
+    boot_trace("kmem_init");
+    sched_init();
+    boot_trace("sched_init");
+    /* Log output reaches the devices from klogd from now on */
+    log_start_thread();
+    /* Last: the AP trampoline page may hold multiboot data */
+    smp_init();
+    boot_trace("smp_init");
+
+    boot_trace_print();
+
+#ifdef KERNEL_BENCH
+    /* kernel_bench.elf: report the benchmarks over COM1 and leave QEMU */
+    kbench_main();
+#endif
+
+    /* Every __init function has run; their pages go back to the allocator */
+    snprintf(buf, sizeof(buf), "Freed %u KiB of init code\n", pmm_release_init() / 1024);
+    serial_write(buf);
+
+    /*
+     * From here on the boot thread only runs when no other thread is
+     * ready; the COM1 interrupt drains what is still queued.
+     */
+    sched_idle();
 }
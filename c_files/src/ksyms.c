@@ -0,0 +1,92 @@
+#include "ksyms.h"
+#include "compiler.h"
+#include "paging.h"
+#include "string.h"
+#include "log.h"
+
+/* Filled in after linking by tools/ksyms.py, which finds it by name */
+unsigned char ksyms_table[KSYMS_MAX_SIZE] __attribute__((section(".ksyms"), aligned(4))) = { 0 };
+
+
+const char *ksyms_lookup(unsigned int addr, unsigned int *offset)
+{
+    const struct ksyms_header *hdr = (const struct ksyms_header *)ksyms_table;
+    const unsigned int *addrs = (const unsigned int *)(hdr + 1);
+    const unsigned short *names = (const unsigned short *)(addrs + hdr->count);
+    const char *pool = (const char *)(names + hdr->count);
+    unsigned int lo = 0, hi;
+
+    if (hdr->magic != KSYMS_MAGIC || hdr->count == 0 || addr < addrs[0]) {
+        return 0;
+    }
+    /* Last entry whose address is <= addr */
+    hi = hdr->count;
+    while (hi - lo > 1) {
+        unsigned int mid = lo + (hi - lo) / 2;
+
+        if (addrs[mid] <= addr) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    if (names[lo] == KSYMS_NO_NAME) {
+        return 0;
+    }
+    if (offset) {
+        *offset = addr - addrs[lo];
+    }
+    return pool + names[lo];
+}
+
+
+int ksyms_snprint(char *buf, unsigned int size, unsigned int addr)
+{
+    unsigned int offset;
+    const char *name = ksyms_lookup(addr, &offset);
+
+    if (!name) {
+        return snprintf(buf, size, "%p", (void *)addr);
+    }
+    return snprintf(buf, size, "%s+0x%x", name, offset);
+}
+
+
+/* A frame pointer the walk may dereference: aligned and inside the direct map */
+static int ksyms_frame_ok(unsigned int fp)
+{
+    return (fp & 3) == 0 && fp >= KERNEL_VIRTUAL_BASE &&
+           fp < KERNEL_VIRTUAL_BASE + PAGING_DIRECT_MAP_SIZE - 8;
+}
+
+
+void __cold ksyms_backtrace(unsigned int eip, unsigned int ebp, unsigned int max_depth)
+{
+    char name[64];
+    unsigned int depth;
+
+    ksyms_snprint(name, sizeof(name), eip);
+    log_printf("  #0 %s\n", name);
+
+    /* Same walk as the profiler: [ebp] is the caller's ebp, [ebp + 4] the return address */
+    for (depth = 1; depth <= max_depth && ksyms_frame_ok(ebp); depth++) {
+        unsigned int *link = (unsigned int *)ebp;
+        const char *func;
+        unsigned int offset;
+
+        if (link[1] < KERNEL_VIRTUAL_BASE) {
+            break;
+        }
+        /* A call at the very end of a function returns to the next one: look up the call */
+        func = ksyms_lookup(link[1] - 1, &offset);
+        if (func) {
+            log_printf("  #%u %s+0x%x\n", depth, func, offset + 1);
+        } else {
+            log_printf("  #%u %p\n", depth, (void *)link[1]);
+        }
+        if (link[0] <= ebp) {
+            break;
+        }
+        ebp = link[0];
+    }
+}
@@ -0,0 +1,54 @@
+#include "lapic.h"
+#include "compiler.h"
+#include "paging.h"
+
+static volatile unsigned int *lapic_regs;
+
+
+static unsigned int lapic_read(unsigned int reg)
+{
+    return lapic_regs[reg / 4];
+}
+
+
+static void lapic_write(unsigned int reg, unsigned int value)
+{
+    lapic_regs[reg / 4] = value;
+}
+
+
+/* The high half holds the destination; writing the low half sends */
+static void lapic_send_ipi(unsigned int apic_id, unsigned int command)
+{
+    lapic_write(LAPIC_REG_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_REG_ICR_LOW, command);
+    while (lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING) {
+        __asm__ volatile("pause");
+    }
+}
+
+
+int __init lapic_init(unsigned int phys)
+{
+    lapic_regs = paging_map_mmio(phys, PAGE_SIZE);
+    return lapic_regs ? 0 : -1;
+}
+
+
+unsigned int lapic_id(void)
+{
+    return lapic_read(LAPIC_REG_ID) >> 24;
+}
+
+
+void lapic_send_init(unsigned int apic_id)
+{
+    lapic_send_ipi(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+    lapic_send_ipi(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+}
+
+
+void lapic_send_startup(unsigned int apic_id, unsigned int page)
+{
+    lapic_send_ipi(apic_id, LAPIC_ICR_STARTUP | (page & 0xFF));
+}
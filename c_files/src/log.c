@@ -1,115 +1,339 @@
 #include "log.h"
-#include "stdio.h"
+#include "log_sink.h"
 #include "serial.h"
 #include "string.h"
-
-/* va_list support using GCC built-ins */
-typedef __builtin_va_list va_list;
-#define va_start(ap, last) __builtin_va_start(ap, last)
-#define va_arg(ap, type)   __builtin_va_arg(ap, type)
-#define va_end(ap)         __builtin_va_end(ap)
-#define va_copy(dest, src) __builtin_va_copy(dest, src)
+#include "cpu.h"
+#include "stdarg.h"
 
 
 static int log_device = LOG_SERIAL;
+static int log_min_level = LOG_LEVEL_DEBUG;
+
+struct static_key log_level_keys[LOG_NUM_LEVELS] = {
+    STATIC_KEY_INIT_ON, STATIC_KEY_INIT_ON, STATIC_KEY_INIT_ON, STATIC_KEY_INIT_ON
+};
 
 
+/*
+ * Binary records (LOG_BINARY), kept in a ring of 32-bit words:
+ *
+ *   word 0   address of the format string (its ID in kernel.elf)
+ *   word 1   TSC, low 32 bits
+ *   word 2   TSC, high 32 bits
+ *   word 3   bits 0-7: record length in words, bits 8-15: level
+ *   word 4+  the arguments in format order: one word each for a '*' width
+ *            or precision and for every integer, pointer and character
+ *            conversion, two (low word first) for %lld and friends, and for
+ *            %s a byte count followed by the bytes, padded to words
+ *
+ * When the ring is full the oldest records are overwritten.
+ */
+#define LOG_RECORD_HEADER_WORDS 4
+
+static unsigned int log_ring[LOG_RING_WORDS];
+static unsigned int log_ring_head;      /* free-running word indices */
+static unsigned int log_ring_tail;
+static unsigned int log_ring_overwritten;
+/* Any CPU may log: writers and the dump take it with interrupts off */
+static struct spinlock log_ring_lock = SPINLOCK_INIT;
+
+
+/* serial_begin keeps COM1's transmit interrupt if kmain already turned it on */
 void log_init(int device)
 {
     log_set_device(device);
-    if (device == LOG_SERIAL || device == LOG_ALL) {
+    if (device == LOG_SERIAL || device == LOG_ALL || device == LOG_BINARY) {
         serial_begin(9600);
     }
 }
 
 
+/* LOG_BINARY turns both text sinks off: text output becomes records */
 void log_set_device(int device)
 {
     log_device = device;
+    log_sink_enable(log_sink_find("fb"), device == LOG_FB || device == LOG_ALL);
+    log_sink_enable(log_sink_find("com1"), device == LOG_SERIAL || device == LOG_ALL);
 }
 
 
-void log_putchar(char c)
+void log_set_level(int level)
 {
-    if (log_device == LOG_FB || log_device == LOG_ALL) {
-        putchar(c);
+    if (level < LOG_LEVEL_DEBUG) level = LOG_LEVEL_DEBUG;
+    if (level > LOG_LEVEL_ERROR) level = LOG_LEVEL_ERROR;
+
+    log_min_level = level;
+    for (int i = 0; i < LOG_NUM_LEVELS; i++) {
+        if (i >= level) {
+            static_key_enable(&log_level_keys[i]);
+        } else {
+            static_key_disable(&log_level_keys[i]);
+        }
     }
-    if (log_device == LOG_SERIAL || log_device == LOG_ALL) {
-        serial_write_char(c);
+}
+
+
+int log_get_level(void)
+{
+    return log_min_level;
+}
+
+
+void log_putchar(char c)
+{
+    struct log_iovec iov = { &c, 1 };
+
+    if (log_device == LOG_BINARY) {
+        log_printf("%c", c);
+        return;
     }
+    log_sinks_writev(&iov, 1);
 }
 
 
 void log_puts(char *buf)
 {
-    while (*buf) {
-        log_putchar(*buf++);
+    struct log_iovec iov = { buf, strlen(buf) };
+
+    if (log_device == LOG_BINARY) {
+        log_printf("%s", buf);
+        return;
     }
+    log_sinks_writev(&iov, 1);
 }
 
 
-/** log_vprintf:
- *  Internal variadic printf that writes formatted output to log device(s).
+/*
+ * The conversions vformat takes an argument for. It prints '%' and any
+ * other conversion as written, so the record must not store a word for them.
  */
-static int log_vprintf(char *format, va_list ap)
+static int log_conv_takes_arg(char conv)
 {
-    int count = 0;
-
-    while (*format != '\0') {
-        if (*format == '%') {
-            format++;
-            switch (*format) {
-                case 'c': {
-                    char c = (char)va_arg(ap, int);
-                    log_putchar(c);
-                    count++;
-                    break;
-                }
-                case 'd': {
-                    int d = va_arg(ap, int);
-                    char buf[12];
-                    itoa(d, buf, 10);
-                    log_puts(buf);
-                    count += strlen(buf);
-                    break;
-                }
-                case 'x': {
-                    int x = va_arg(ap, int);
-                    char buf[12];
-                    itoa(x, buf, 16);
-                    log_puts(buf);
-                    count += strlen(buf);
-                    break;
-                }
-                case 's': {
-                    char *s = va_arg(ap, char *);
-                    if (!s) s = "(null)";
-                    log_puts(s);
-                    count += strlen(s);
-                    break;
-                }
-                case '%': {
-                    log_putchar('%');
-                    count++;
-                    break;
-                }
-                default:
-                    log_putchar('%');
-                    log_putchar(*format);
-                    count += 2;
-                    break;
+    switch (conv) {
+        case 'c': case 's': case 'd': case 'i': case 'u':
+        case 'x': case 'X': case 'o': case 'p':
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+
+/** log_record_vprintf:
+ *  Stores a binary record of format and its arguments in the log ring.
+ *  Only the conversions are parsed; nothing is formatted.
+ */
+static void log_record_vprintf(int level, char *format, va_list ap)
+{
+    unsigned int words[LOG_RECORD_MAX_WORDS];
+    unsigned int n = LOG_RECORD_HEADER_WORDS;
+    unsigned long long tsc = rdtsc();
+    unsigned int flags;
+    const char *f;
+
+    for (f = format; *f != '\0';) {
+        struct fmt_spec spec;
+
+        if (*f++ != '%') {
+            continue;
+        }
+        f = fmt_parse(f, &spec);
+        /* Room for the '*' arguments and the widest value (two words) */
+        if (n + (spec.width == FMT_STAR) + (spec.precision == FMT_STAR) + 2 > LOG_RECORD_MAX_WORDS) {
+            break;
+        }
+        /* vformat takes the '*' arguments before it looks at the conversion */
+        if (spec.width == FMT_STAR) {
+            words[n++] = va_arg(ap, unsigned int);
+        }
+        if (spec.precision == FMT_STAR) {
+            words[n] = va_arg(ap, unsigned int);
+            /* A negative precision is taken as none */
+            spec.precision = (int)words[n] < 0 ? FMT_NONE : (int)words[n];
+            n++;
+        }
+        if (spec.conv == '\0') {
+            break;
+        }
+        if (!log_conv_takes_arg(spec.conv)) {
+            continue;
+        }
+
+        if (spec.conv == 's') {
+            char *str = va_arg(ap, char *);
+            unsigned int max = (LOG_RECORD_MAX_WORDS - n - 1) * 4;
+            unsigned int len = 0;
+
+            if (!str) str = "(null)";
+            /* "%.*s" may point at bytes with no NUL: never look past the precision */
+            if (spec.precision >= 0 && (unsigned int)spec.precision < max) {
+                max = spec.precision;
+            }
+            while (len < max && str[len] != '\0') {
+                len++;
+            }
+            words[n++] = len;
+            if (len > 0) {
+                words[n + (len - 1) / 4] = 0;
             }
+            memcpy(&words[n], str, len);
+            n += (len + 3) / 4;
+        } else if (spec.is_long_long && spec.conv != 'c' && spec.conv != 'p') {
+            unsigned long long v = va_arg(ap, unsigned long long);
+            words[n++] = (unsigned int)v;
+            words[n++] = (unsigned int)(v >> 32);
         } else {
-            log_putchar(*format);
-            count++;
+            words[n++] = va_arg(ap, unsigned int);
         }
-        format++;
     }
 
+    words[0] = (unsigned int)format;
+    words[1] = (unsigned int)tsc;
+    words[2] = (unsigned int)(tsc >> 32);
+    words[3] = n | ((level & 0xFF) << 8);
+
+    flags = spin_lock_irqsave(&log_ring_lock);
+    while (LOG_RING_WORDS - (log_ring_head - log_ring_tail) < n) {
+        log_ring_tail += log_ring[(log_ring_tail + 3) % LOG_RING_WORDS] & 0xFF;
+        log_ring_overwritten++;
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        log_ring[log_ring_head++ % LOG_RING_WORDS] = words[i];
+    }
+    spin_unlock_irqrestore(&log_ring_lock, flags);
+}
+
+
+void log_dump_records(void)
+{
+    unsigned int header[3];
+    unsigned int flags = spin_lock_irqsave(&log_ring_lock);
+    unsigned int tail = log_ring_tail;
+    unsigned int head = log_ring_head;
+    unsigned int count = head - tail;
+
+    header[0] = LOG_DUMP_MAGIC;
+    header[1] = count;
+    header[2] = log_ring_overwritten;
+    spin_unlock_irqrestore(&log_ring_lock, flags);
+
+    serial_write_buf_blocking_com(SERIAL_COM1_BASE, header, sizeof(header));
+
+    /*
+     * Pieces never cross the end of the ring; the blocking write waits for
+     * room instead of dropping. Records added meanwhile stay queued for the
+     * next dump.
+     */
+    while (count > 0) {
+        unsigned int offset = tail % LOG_RING_WORDS;
+        unsigned int chunk = LOG_RING_WORDS - offset;
+
+        if (chunk > count) {
+            chunk = count;
+        }
+        serial_write_buf_blocking_com(SERIAL_COM1_BASE, &log_ring[offset], chunk * 4);
+        tail += chunk;
+        count -= chunk;
+    }
+
+    /* Unless the writers have already overwritten past what was sent */
+    flags = spin_lock_irqsave(&log_ring_lock);
+    if ((int)(log_ring_tail - head) < 0) {
+        log_ring_tail = head;
+    }
+    spin_unlock_irqrestore(&log_ring_lock, flags);
+}
+
+
+/*
+ * Text output is formatted by vformat() into a small buffer that goes to
+ * the sinks a piece at a time. A message that fits is queued as a single
+ * log_sinks_writev of prefix, text and suffix, so it reaches every device
+ * in one piece.
+ */
+#define LOG_CHUNK_SIZE 128
+
+struct log_chunk {
+    const char *prefix;         /* sent in front of the first piece, then 0 */
+    unsigned int len;
+    char buf[LOG_CHUNK_SIZE];
+};
+
+static void log_chunk_flush(struct log_chunk *chunk, const char *suffix)
+{
+    struct log_iovec iov[3];
+    unsigned int n = 0;
+
+    if (chunk->prefix) {
+        iov[n].base = chunk->prefix;
+        iov[n++].len = strlen(chunk->prefix);
+        chunk->prefix = 0;
+    }
+    if (chunk->len) {
+        iov[n].base = chunk->buf;
+        iov[n++].len = chunk->len;
+        chunk->len = 0;
+    }
+    if (suffix) {
+        iov[n].base = suffix;
+        iov[n++].len = strlen(suffix);
+    }
+    if (n) {
+        log_sinks_writev(iov, n);
+    }
+}
+
+static void log_chunk_sink(void *ctx, const char *s, unsigned int len)
+{
+    struct log_chunk *chunk = (struct log_chunk *)ctx;
+
+    while (len > 0) {
+        unsigned int n = LOG_CHUNK_SIZE - chunk->len;
+
+        if (n > len) {
+            n = len;
+        }
+        memcpy(chunk->buf + chunk->len, s, n);
+        chunk->len += n;
+        s += n;
+        len -= n;
+        if (chunk->len == LOG_CHUNK_SIZE) {
+            log_chunk_flush(chunk, 0);
+        }
+    }
+}
+
+
+/** log_text_vprintf:
+ *  Formats a message and queues prefix, message and suffix (either may
+ *  be 0) on the log sinks.
+ */
+static int log_text_vprintf(const char *prefix, const char *suffix, char *format, va_list ap)
+{
+    struct log_chunk chunk;
+    int count;
+
+    chunk.prefix = prefix;
+    chunk.len = 0;
+    count = vformat(log_chunk_sink, &chunk, format, ap);
+    log_chunk_flush(&chunk, suffix);
     return count;
 }
 
 
+/** log_vprintf:
+ *  Internal variadic printf that writes formatted output to log device(s).
+ */
+static int log_vprintf(char *format, va_list ap)
+{
+    if (log_device == LOG_BINARY) {
+        log_record_vprintf(LOG_RECORD_NO_LEVEL, format, ap);
+        return 0;
+    }
+    return log_text_vprintf(0, 0, format, ap);
+}
+
+
 int log_printf(char *format, ...)
 {
     va_list ap;
@@ -120,45 +344,63 @@ int log_printf(char *format, ...)
 }
 
 
-static void log_with_level(char *prefix, char *format, va_list ap)
+static void log_with_level(int level, char *prefix, char *format, va_list ap)
 {
-    log_puts(prefix);
-    log_vprintf(format, ap);
-    log_putchar('\n');
+    if (log_device == LOG_BINARY) {
+        log_record_vprintf(level, format, ap);
+        return;
+    }
+    log_text_vprintf(prefix, "\n", format, ap);
 }
 
 
-void log_debug(char *format, ...)
+void (log_debug)(char *format, ...)
 {
     va_list ap;
+
+    if (LOG_LEVEL_DEBUG < log_min_level) {
+        return;
+    }
     va_start(ap, format);
-    log_with_level("[DEBUG]   ", format, ap);
+    log_with_level(LOG_LEVEL_DEBUG, "[DEBUG]   ", format, ap);
     va_end(ap);
 }
 
 
-void log_info(char *format, ...)
+void (log_info)(char *format, ...)
 {
     va_list ap;
+
+    if (LOG_LEVEL_INFO < log_min_level) {
+        return;
+    }
     va_start(ap, format);
-    log_with_level("[INFO]    ", format, ap);
+    log_with_level(LOG_LEVEL_INFO, "[INFO]    ", format, ap);
     va_end(ap);
 }
 
 
-void log_warning(char *format, ...)
+void (log_warning)(char *format, ...)
 {
     va_list ap;
+
+    if (LOG_LEVEL_WARNING < log_min_level) {
+        return;
+    }
     va_start(ap, format);
-    log_with_level("[WARNING] ", format, ap);
+    log_with_level(LOG_LEVEL_WARNING, "[WARNING] ", format, ap);
     va_end(ap);
 }
 
 
-void log_error(char *format, ...)
+void (log_error)(char *format, ...)
 {
     va_list ap;
+
+    if (LOG_LEVEL_ERROR < log_min_level) {
+        return;
+    }
     va_start(ap, format);
-    log_with_level("[ERROR]   ", format, ap);
+    log_with_level(LOG_LEVEL_ERROR, "[ERROR]   ", format, ap);
     va_end(ap);
 }
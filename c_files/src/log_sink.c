@@ -0,0 +1,476 @@
+#include "log_sink.h"
+#include "compiler.h"
+#include "stdio.h"
+#include "serial.h"
+#include "string.h"
+#include "sched.h"
+#include "cpu.h"
+#include "percpu.h"
+#include "pit.h"
+
+/* Klogd runs below ordinary threads: logging must not delay them */
+#define LOG_THREAD_PRIORITY     (SCHED_PRIORITY_DEFAULT + 8)
+/* A device that took nothing (a full UART ring) is tried again this much later */
+#define LOG_THREAD_RETRY_TICKS  10
+
+/* fb_console_puts wants NUL-terminated pieces */
+#define LOG_FB_CHUNK_SIZE       128
+/* log_sink_drain hands the device copies of at most this many bytes */
+#define LOG_DRAIN_CHUNK_SIZE    256
+
+/* log_flush has taken over the devices: nothing else will ever run */
+static volatile unsigned int log_flushing;
+
+
+static unsigned int log_fb_write(struct log_sink *sink, const void *buf, unsigned int len)
+{
+    const char *bytes = (const char *)buf;
+    char chunk[LOG_FB_CHUNK_SIZE];
+    unsigned int n = 0;
+
+    (void)sink;
+    for (unsigned int i = 0; i < len; i++) {
+        /* A NUL from %c would end the piece early; the console has no glyph for it */
+        if (bytes[i] != '\0') {
+            chunk[n++] = bytes[i];
+        }
+        if (n == LOG_FB_CHUNK_SIZE - 1 || (i + 1 == len && n > 0)) {
+            chunk[n] = '\0';
+            fb_console_puts(FB_CONSOLE_LOG, chunk);
+            n = 0;
+        }
+    }
+    return len;
+}
+
+
+/*
+ * Only what the transmit ring has room for: the COM interrupt does the
+ * waiting. Nothing while a frame holds the port, or the text would land
+ * inside it; klogd tries again later.
+ */
+static unsigned int log_serial_write(struct log_sink *sink, const void *buf, unsigned int len)
+{
+    unsigned short com = (unsigned short)(unsigned int)sink->ctx;
+
+    if (serial_held_com(com) && !log_flushing) {
+        return 0;
+    }
+    return serial_write_buf_nowait_com(com, buf, len);
+}
+
+static void log_serial_wait(struct log_sink *sink)
+{
+    serial_flush_com((unsigned short)(unsigned int)sink->ctx);
+}
+
+
+static unsigned char log_fb_queue[LOG_SINK_QUEUE_SIZE];
+static unsigned char log_com_queues[4][LOG_SINK_QUEUE_SIZE];
+static unsigned char log_mem_ring[LOG_MEM_RING_SIZE];
+
+#define LOG_COM_SINK(n, base)                                               \
+    { .name = "com" #n, .write = log_serial_write, .wait = log_serial_wait, \
+      .ctx = (void *)(base), .policy = LOG_SINK_DROP_NEWEST,                \
+      .enabled = (n) == 1, .size = LOG_SINK_QUEUE_SIZE,                     \
+      .queue = log_com_queues[(n) - 1] }
+
+/* Matches log.c's default device, LOG_SERIAL: COM1, and the memory ring */
+static struct log_sink log_builtin_sinks[] = {
+    { .name = "fb", .write = log_fb_write, .policy = LOG_SINK_BLOCK,
+      .size = LOG_SINK_QUEUE_SIZE, .queue = log_fb_queue },
+    LOG_COM_SINK(1, SERIAL_COM1_BASE),
+    LOG_COM_SINK(2, SERIAL_COM2_BASE),
+    LOG_COM_SINK(3, SERIAL_COM3_BASE),
+    LOG_COM_SINK(4, SERIAL_COM4_BASE),
+    { .name = "mem", .policy = LOG_SINK_DROP_OLDEST, .enabled = 1,
+      .size = LOG_MEM_RING_SIZE, .queue = log_mem_ring },
+};
+#define LOG_NUM_BUILTIN_SINKS (sizeof(log_builtin_sinks) / sizeof(log_builtin_sinks[0]))
+
+static struct log_sink *log_sinks[LOG_MAX_SINKS] = {
+    &log_builtin_sinks[0], &log_builtin_sinks[1], &log_builtin_sinks[2],
+    &log_builtin_sinks[3], &log_builtin_sinks[4], &log_builtin_sinks[5],
+};
+static unsigned int log_num_sinks = LOG_NUM_BUILTIN_SINKS;
+
+static struct spinlock log_sinks_lock = SPINLOCK_INIT;
+
+static struct task *log_thread;
+/* Set by APs, which must not touch the scheduler; the BSP's tick wakes klogd */
+static volatile unsigned int log_wake_pending;
+
+
+/* klogd and the scheduler live on the bootstrap processor */
+static int log_on_ap(void)
+{
+    return this_cpu()->id != 0;
+}
+
+
+int log_sink_register(struct log_sink *sink)
+{
+    unsigned int flags = spin_lock_irqsave(&log_sinks_lock);
+    int ret = -1;
+
+    if (log_num_sinks < LOG_MAX_SINKS) {
+        sink->head = sink->tail = 0;
+        sink->draining = 0;
+        sink->dropped = sink->blocked = 0;
+        sink->lock.locked = 0;
+        /* Readers walk the array without the lock: the entry before the count */
+        log_sinks[log_num_sinks] = sink;
+        __asm__ volatile("" : : : "memory");
+        log_num_sinks++;
+        ret = 0;
+    }
+    spin_unlock_irqrestore(&log_sinks_lock, flags);
+    return ret;
+}
+
+
+struct log_sink *log_sink_find(const char *name)
+{
+    for (unsigned int i = 0; i < log_num_sinks; i++) {
+        if (strcmp(log_sinks[i]->name, name) == 0) {
+            return log_sinks[i];
+        }
+    }
+    return 0;
+}
+
+
+void log_sink_enable(struct log_sink *sink, int enabled)
+{
+    sink->enabled = enabled != 0;
+}
+
+
+void log_sink_set_policy(struct log_sink *sink, unsigned int policy)
+{
+    sink->policy = policy;
+}
+
+
+/*
+ * Frees at least need bytes by moving tail forward, then on to the start
+ * of the next line so the reader never sees half of one. sink->lock held.
+ */
+static void log_sink_drop_oldest(struct log_sink *sink, unsigned int need)
+{
+    unsigned int mask = sink->size - 1;
+    unsigned int head = sink->head;
+    unsigned int tail = head - (sink->size - need);
+
+    while (tail != head && sink->queue[(tail - 1) & mask] != '\n') {
+        tail++;
+    }
+    sink->dropped += tail - sink->tail;
+    sink->tail = tail;
+}
+
+
+unsigned int __hot log_sink_writev(struct log_sink *sink, const struct log_iovec *iov, unsigned int n)
+{
+    unsigned int mask = sink->size - 1;
+    unsigned int total = 0;
+    unsigned int flags, head;
+    int waited = 0;
+
+    for (unsigned int i = 0; i < n; i++) {
+        total += iov[i].len;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    flags = spin_lock_irqsave(&sink->lock);
+    while (sink->size - (sink->head - sink->tail) < total) {
+        unsigned int policy = sink->policy;
+
+        /* Nothing drains a ring without a device: make room instead */
+        if (policy == LOG_SINK_BLOCK && !sink->write) {
+            policy = LOG_SINK_DROP_OLDEST;
+        }
+        if (total > sink->size || policy == LOG_SINK_DROP_NEWEST) {
+            sink->dropped += total;
+            spin_unlock_irqrestore(&sink->lock, flags);
+            return 0;
+        }
+        if (policy == LOG_SINK_DROP_OLDEST) {
+            log_sink_drop_oldest(sink, total);
+            break;
+        }
+
+        /*
+         * LOG_SINK_BLOCK. An AP spins until klogd, on the BSP, makes room.
+         * A drain this write interrupted (we are in an interrupt handler)
+         * never finishes while we wait: drop instead. A thread that
+         * preempted klogd sleeps so klogd can finish.
+         */
+        if (!waited) {
+            sink->blocked++;
+            waited = 1;
+        }
+        if (log_on_ap()) {
+            if (!log_thread) {
+                sink->dropped += total;
+                spin_unlock_irqrestore(&sink->lock, flags);
+                return 0;
+            }
+            spin_unlock_irqrestore(&sink->lock, flags);
+            log_wake_pending = 1;
+            __asm__ volatile("pause" : : : "memory");
+        } else if (sink->draining) {
+            if (!(flags & EFLAGS_IF) || !task_current()) {
+                sink->dropped += total;
+                spin_unlock_irqrestore(&sink->lock, flags);
+                return 0;
+            }
+            spin_unlock_irqrestore(&sink->lock, flags);
+            task_sleep(1);
+        } else {
+            spin_unlock_irqrestore(&sink->lock, flags);
+            if (log_sink_drain(sink) == 0 && sink->wait) {
+                sink->wait(sink);
+            }
+        }
+        flags = spin_lock_irqsave(&sink->lock);
+    }
+
+    head = sink->head;
+    for (unsigned int i = 0; i < n; i++) {
+        const unsigned char *src = (const unsigned char *)iov[i].base;
+        unsigned int len = iov[i].len;
+
+        while (len > 0) {
+            unsigned int offset = head & mask;
+            unsigned int chunk = sink->size - offset;
+
+            if (chunk > len) {
+                chunk = len;
+            }
+            memcpy(sink->queue + offset, src, chunk);
+            head += chunk;
+            src += chunk;
+            len -= chunk;
+        }
+    }
+    sink->head = head;
+    spin_unlock_irqrestore(&sink->lock, flags);
+    return total;
+}
+
+
+/*
+ * One pass over every sink with a device. Returns how many of them kept
+ * bytes the device would not take.
+ */
+static unsigned int log_sinks_drain(void)
+{
+    unsigned int stalled = 0;
+
+    for (unsigned int i = 0; i < log_num_sinks; i++) {
+        struct log_sink *sink = log_sinks[i];
+        unsigned int queued;
+
+        if (!sink->write) {
+            continue;
+        }
+        queued = sink->head - sink->tail;
+        if (queued > 0 && log_sink_drain(sink) < queued) {
+            stalled++;
+        }
+    }
+    return stalled;
+}
+
+static int log_sinks_pending(void)
+{
+    for (unsigned int i = 0; i < log_num_sinks; i++) {
+        if (log_sinks[i]->write && log_sinks[i]->head != log_sinks[i]->tail) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+void __hot log_sinks_writev(const struct log_iovec *iov, unsigned int n)
+{
+    for (unsigned int i = 0; i < log_num_sinks; i++) {
+        if (log_sinks[i]->enabled) {
+            log_sink_writev(log_sinks[i], iov, n);
+        }
+    }
+    if (!log_thread) {
+        /* Before klogd only the BSP logs: no AP is running yet */
+        if (!log_on_ap()) {
+            log_sinks_drain();
+        }
+    } else if (log_on_ap()) {
+        log_wake_pending = 1;
+    } else {
+        task_wake(log_thread);
+    }
+}
+
+
+unsigned int log_sink_drain(struct log_sink *sink)
+{
+    unsigned char buf[LOG_DRAIN_CHUNK_SIZE];
+    unsigned int mask = sink->size - 1;
+    unsigned int taken = 0;
+    unsigned int flags, end;
+
+    if (!sink->write) {
+        return 0;
+    }
+    flags = spin_lock_irqsave(&sink->lock);
+    if (sink->draining) {
+        spin_unlock_irqrestore(&sink->lock, flags);
+        return 0;
+    }
+    sink->draining = 1;
+    /* What is queued now; later messages wait for the next drain */
+    end = sink->head;
+    spin_unlock_irqrestore(&sink->lock, flags);
+
+    /*
+     * The device gets a copy taken under the lock: a LOG_SINK_DROP_OLDEST
+     * writer may reuse the queue space as soon as it is unlocked.
+     */
+    for (;;) {
+        unsigned int tail, count, n;
+
+        flags = spin_lock_irqsave(&sink->lock);
+        tail = sink->tail;
+        count = (int)(end - tail) > 0 ? end - tail : 0;
+        if (count > sizeof(buf)) {
+            count = sizeof(buf);
+        }
+        for (unsigned int i = 0; i < count; i++) {
+            buf[i] = sink->queue[(tail + i) & mask];
+        }
+        spin_unlock_irqrestore(&sink->lock, flags);
+        /* Whole lines where possible: the rest of a line may be dropped meanwhile */
+        if (count == sizeof(buf)) {
+            unsigned int line_end = count;
+
+            while (line_end > 0 && buf[line_end - 1] != '\n') {
+                line_end--;
+            }
+            if (line_end > 0) {
+                count = line_end;
+            }
+        }
+        if (count == 0) {
+            break;
+        }
+
+        n = sink->write(sink, buf, count);
+
+        /* Unless drop-oldest writers have moved tail further meanwhile */
+        flags = spin_lock_irqsave(&sink->lock);
+        if ((int)(sink->tail - (tail + n)) < 0) {
+            sink->tail = tail + n;
+        }
+        spin_unlock_irqrestore(&sink->lock, flags);
+        taken += n;
+        if (n < count) {
+            break;
+        }
+    }
+
+    flags = spin_lock_irqsave(&sink->lock);
+    sink->draining = 0;
+    spin_unlock_irqrestore(&sink->lock, flags);
+    return taken;
+}
+
+
+unsigned int log_sink_read(struct log_sink *sink, void *buf, unsigned int size)
+{
+    unsigned int mask = sink->size - 1;
+    unsigned char *dst = (unsigned char *)buf;
+    unsigned int flags = spin_lock_irqsave(&sink->lock);
+    unsigned int tail = sink->tail;
+    unsigned int count = sink->head - tail;
+
+    if (count > size) {
+        count = size;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        dst[i] = sink->queue[(tail + i) & mask];
+    }
+    sink->tail = tail + count;
+    spin_unlock_irqrestore(&sink->lock, flags);
+    return count;
+}
+
+
+void __cold log_flush(void)
+{
+    /* A frame this interrupted never finishes: write over its hold */
+    log_flushing = 1;
+    for (unsigned int i = 0; i < log_num_sinks; i++) {
+        struct log_sink *sink = log_sinks[i];
+
+        if (!sink->write) {
+            continue;
+        }
+        sink->draining = 0;
+        while (sink->head != sink->tail) {
+            if (log_sink_drain(sink) == 0) {
+                if (!sink->wait) {
+                    break;
+                }
+                sink->wait(sink);
+            }
+        }
+    }
+}
+
+
+/** log_thread_main:
+ *  klogd: drains every sink, again right away if writers queued more
+ *  meanwhile, after LOG_THREAD_RETRY_TICKS if a device was full, and
+ *  otherwise once a writer wakes it.
+ */
+static void log_thread_main(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        unsigned int flags;
+
+        if (log_sinks_drain() > 0) {
+            task_sleep(LOG_THREAD_RETRY_TICKS);
+            continue;
+        }
+        flags = irq_save();
+        if (!log_sinks_pending()) {
+            task_block();
+        }
+        irq_restore(flags);
+    }
+}
+
+
+/* PIT hook: passes on the wakeups APs could only flag */
+static void log_tick(struct interrupt_frame *frame)
+{
+    (void)frame;
+    if (log_wake_pending) {
+        log_wake_pending = 0;
+        task_wake(log_thread);
+    }
+}
+
+
+void __init log_start_thread(void)
+{
+    log_thread = task_create("klogd", log_thread_main, 0, LOG_THREAD_PRIORITY);
+    if (log_thread) {
+        pit_add_hook(log_tick);
+    }
+}
@@ -0,0 +1,151 @@
+#include "paging.h"
+#include "compiler.h"
+#include "pmm.h"
+#include "string.h"
+#include "cpu.h"
+
+/* Built and loaded into CR3 by loader.s; stays the kernel page directory */
+extern unsigned int boot_page_directory[PAGE_TABLE_ENTRIES];
+
+/* PAGE_GLOBAL if the CPU has global pages, otherwise 0 */
+static unsigned int paging_global_flag;
+
+/* Next free page of the mapping area for paging_map_mmio */
+static unsigned int paging_mmio_next = PAGING_MAP_AREA_START;
+
+
+static unsigned int *paging_pde(unsigned int virt)
+{
+    return &boot_page_directory[virt >> 22];
+}
+
+
+void __init paging_init(void)
+{
+    unsigned int a, b, c, d;
+    unsigned int first = KERNEL_VIRTUAL_BASE >> 22;
+
+    cpuid(1, 0, &a, &b, &c, &d);
+    if (d & CPUID_1_EDX_PGE) {
+        paging_global_flag = PAGE_GLOBAL;
+    }
+
+    for (unsigned int i = 0; i < PAGING_DIRECT_MAP_SIZE / PAGE_LARGE_SIZE; i++) {
+        boot_page_directory[first + i] = (i * PAGE_LARGE_SIZE) | PAGE_PRESENT |
+                                         PAGE_WRITABLE | PAGE_LARGE | paging_global_flag;
+    }
+    /* Execution left the identity mapping in loader.s */
+    boot_page_directory[0] = 0;
+
+    /*
+     * One full flush for the new directory. Setting CR4.PGE afterwards
+     * flushes again, global entries included, so the global kernel pages
+     * start out fresh. Later changes use invlpg on the single page.
+     */
+    write_cr3(read_cr3());
+    if (paging_global_flag) {
+        write_cr4(read_cr4() | CR4_PGE);
+    }
+}
+
+
+int paging_map_page(unsigned int virt, unsigned int phys, unsigned int flags)
+{
+    unsigned int *pde = paging_pde(virt);
+    unsigned int *table;
+
+    if (*pde & PAGE_LARGE) {
+        return -1;
+    }
+    if (!(*pde & PAGE_PRESENT)) {
+        unsigned int frame = pmm_alloc_frame();
+
+        if (!frame) {
+            return -1;
+        }
+        memset(phys_to_virt(frame), 0, PAGE_SIZE);
+        /* Permissions are narrowed per page; the directory entry allows everything */
+        *pde = frame | PAGE_PRESENT | PAGE_WRITABLE | (flags & PAGE_USER);
+    } else if (flags & PAGE_USER) {
+        *pde |= PAGE_USER;
+    }
+
+    if (virt >= KERNEL_VIRTUAL_BASE) {
+        flags |= paging_global_flag;
+    }
+    table = phys_to_virt(*pde & PAGE_FRAME_MASK);
+    table[(virt >> 12) % PAGE_TABLE_ENTRIES] = (phys & PAGE_FRAME_MASK) | flags | PAGE_PRESENT;
+    invlpg((void *)virt);
+    return 0;
+}
+
+
+unsigned int paging_unmap_page(unsigned int virt)
+{
+    unsigned int *pde = paging_pde(virt);
+    unsigned int *entry;
+    unsigned int phys;
+
+    if (!(*pde & PAGE_PRESENT) || (*pde & PAGE_LARGE)) {
+        return 0;
+    }
+    entry = (unsigned int *)phys_to_virt(*pde & PAGE_FRAME_MASK) + (virt >> 12) % PAGE_TABLE_ENTRIES;
+    if (!(*entry & PAGE_PRESENT)) {
+        return 0;
+    }
+    phys = *entry & PAGE_FRAME_MASK;
+    *entry = 0;
+    invlpg((void *)virt);
+    return phys;
+}
+
+
+unsigned int paging_virt_to_phys(unsigned int virt)
+{
+    unsigned int pde = *paging_pde(virt);
+    unsigned int pte;
+
+    if (!(pde & PAGE_PRESENT)) {
+        return 0;
+    }
+    if (pde & PAGE_LARGE) {
+        return (pde & ~(PAGE_LARGE_SIZE - 1)) | (virt & (PAGE_LARGE_SIZE - 1));
+    }
+    pte = ((unsigned int *)phys_to_virt(pde & PAGE_FRAME_MASK))[(virt >> 12) % PAGE_TABLE_ENTRIES];
+    if (!(pte & PAGE_PRESENT)) {
+        return 0;
+    }
+    return (pte & PAGE_FRAME_MASK) | (virt & (PAGE_SIZE - 1));
+}
+
+
+void *paging_map_mmio(unsigned int phys, unsigned int size)
+{
+    unsigned int offset = phys & (PAGE_SIZE - 1);
+    unsigned int pages, virt;
+
+    if (phys < PAGING_DIRECT_MAP_SIZE && size <= PAGING_DIRECT_MAP_SIZE - phys) {
+        return phys_to_virt(phys);
+    }
+    pages = (offset + size + PAGE_SIZE - 1) / PAGE_SIZE;
+    /* The area runs to the top of the address space, where the counter wraps to 0 */
+    if (paging_mmio_next == 0 || pages > (0 - paging_mmio_next) / PAGE_SIZE) {
+        return 0;
+    }
+    virt = paging_mmio_next;
+    for (unsigned int i = 0; i < pages; i++) {
+        if (paging_map_page(virt + i * PAGE_SIZE, (phys & PAGE_FRAME_MASK) + i * PAGE_SIZE,
+                            PAGE_WRITABLE | PAGE_CACHE_DISABLE) < 0) {
+            return 0;
+        }
+    }
+    paging_mmio_next += pages * PAGE_SIZE;
+    return (void *)(virt + offset);
+}
+
+
+void paging_identity_map_low(int enable)
+{
+    boot_page_directory[0] = enable ? PAGE_PRESENT | PAGE_WRITABLE | PAGE_LARGE : 0;
+    write_cr3(read_cr3());
+}
@@ -0,0 +1,58 @@
+#include "pic.h"
+
+/* Bit n set: IRQ n masked. Written through, never read back from the PIC. */
+static unsigned short pic_masks = 0xFFFF;
+
+
+static void pic_write_masks(unsigned int irq)
+{
+    if (irq < 8) {
+        outb(PIC1_DATA_PORT, pic_masks & 0xFF);
+    } else {
+        outb(PIC2_DATA_PORT, pic_masks >> 8);
+    }
+}
+
+
+void pic_init(unsigned char master_vector, unsigned char slave_vector)
+{
+    /* ICW1: start initialisation, ICW2: vector base, ICW3: wiring, ICW4: mode */
+    outb(PIC1_COMMAND_PORT, PIC_ICW1_INIT_ICW4);
+    io_wait();
+    outb(PIC2_COMMAND_PORT, PIC_ICW1_INIT_ICW4);
+    io_wait();
+    outb(PIC1_DATA_PORT, master_vector);
+    io_wait();
+    outb(PIC2_DATA_PORT, slave_vector);
+    io_wait();
+    outb(PIC1_DATA_PORT, 1 << PIC_CASCADE_IRQ);
+    io_wait();
+    outb(PIC2_DATA_PORT, PIC_CASCADE_IRQ);
+    io_wait();
+    outb(PIC1_DATA_PORT, PIC_ICW4_8086 | PIC_ICW4_AUTO_EOI);
+    io_wait();
+    outb(PIC2_DATA_PORT, PIC_ICW4_8086);
+    io_wait();
+
+    pic_masks = 0xFFFF & ~(1 << PIC_CASCADE_IRQ);
+    outb(PIC1_DATA_PORT, pic_masks & 0xFF);
+    outb(PIC2_DATA_PORT, pic_masks >> 8);
+}
+
+
+void pic_mask_irq(unsigned int irq)
+{
+    if (irq < PIC_NUM_IRQS) {
+        pic_masks |= 1 << irq;
+        pic_write_masks(irq);
+    }
+}
+
+
+void pic_unmask_irq(unsigned int irq)
+{
+    if (irq < PIC_NUM_IRQS) {
+        pic_masks &= ~(1 << irq);
+        pic_write_masks(irq);
+    }
+}
@@ -0,0 +1,63 @@
+#include "pit.h"
+#include "compiler.h"
+#include "io.h"
+#include "cpu.h"
+
+static volatile unsigned int pit_tick_count;
+static unsigned int pit_hz;
+static interrupt_handler_t pit_hooks[PIT_MAX_HOOKS];
+static unsigned int pit_num_hooks;
+
+
+static void __hot pit_irq(struct interrupt_frame *frame)
+{
+    pit_tick_count++;
+    for (unsigned int i = 0; i < pit_num_hooks; i++) {
+        pit_hooks[i](frame);
+    }
+}
+
+
+void __init pit_init(unsigned int hz)
+{
+    unsigned int divisor = PIT_BASE_FREQUENCY / hz;
+    unsigned int flags;
+
+    /* 16-bit reload value; 0 would mean 65536 */
+    if (divisor > 0xFFFF) divisor = 0xFFFF;
+    if (divisor < 1) divisor = 1;
+
+    flags = irq_save();
+    pit_hz = hz;
+    outb(PIT_COMMAND_PORT, PIT_CHANNEL0_RATE_GENERATOR);
+    outb(PIT_CHANNEL0_DATA_PORT, divisor & 0xFF);
+    outb(PIT_CHANNEL0_DATA_PORT, divisor >> 8);
+    interrupt_register(IRQ_VECTOR(IRQ_TIMER), pit_irq);
+    irq_restore(flags);
+}
+
+
+int pit_add_hook(interrupt_handler_t fn)
+{
+    unsigned int flags;
+
+    if (pit_num_hooks == PIT_MAX_HOOKS) {
+        return -1;
+    }
+    flags = irq_save();
+    pit_hooks[pit_num_hooks++] = fn;
+    irq_restore(flags);
+    return 0;
+}
+
+
+unsigned int pit_ticks(void)
+{
+    return pit_tick_count;
+}
+
+
+unsigned int pit_frequency(void)
+{
+    return pit_hz;
+}
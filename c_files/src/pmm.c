@@ -0,0 +1,243 @@
+#include "pmm.h"
+#include "compiler.h"
+#include "string.h"
+#include "jump_label.h"
+#include "cpu.h"
+
+/* Defined in link.ld around the loaded kernel image, as physical addresses */
+extern char kernel_phys_start[];
+extern char kernel_phys_end[];
+
+/* Page aligned bounds of .init.text (__init functions), as virtual addresses */
+extern char __init_start[];
+extern char __init_end[];
+
+/*
+ * Free frames are kept in a four-level bitmap. Level 0 has one bit per
+ * frame, set while the frame is free. Every higher level has one bit per
+ * word of the level below, set while that word has any free frame, so
+ * level 3 is a single word covering all of PMM_MAX_FRAMES.
+ *
+ * Allocation follows the lowest set bit down from level 3 with one ctz per
+ * level, and freeing sets at most one bit per level: both are O(1) no
+ * matter how much memory is installed or how fragmented it is. The map
+ * takes about 25 KiB of .bss and never touches the frames it describes.
+ */
+#define PMM_LEVELS 4
+#define PMM_WORDS(bits) (((bits) + 31) / 32)
+
+static unsigned int pmm_level0[PMM_WORDS(PMM_MAX_FRAMES)];
+static unsigned int pmm_level1[PMM_WORDS(PMM_WORDS(PMM_MAX_FRAMES))];
+static unsigned int pmm_level2[PMM_WORDS(PMM_WORDS(PMM_WORDS(PMM_MAX_FRAMES)))];
+static unsigned int pmm_level3[1];
+
+static unsigned int *const pmm_levels[PMM_LEVELS] = {
+    pmm_level0, pmm_level1, pmm_level2, pmm_level3
+};
+
+static unsigned int pmm_free_count;
+static unsigned int pmm_total_count;
+
+/* Threads preempt each other and APs may allocate: every bitmap update holds it */
+static struct spinlock pmm_lock = SPINLOCK_INIT;
+
+
+static int pmm_frame_is_free(unsigned int frame)
+{
+    return (pmm_level0[frame / 32] >> (frame % 32)) & 1;
+}
+
+/* Sets the frame's bit, and the summary bits above it that were clear */
+static void pmm_mark_free(unsigned int frame)
+{
+    for (int level = 0; level < PMM_LEVELS; level++) {
+        unsigned int *word = &pmm_levels[level][frame / 32];
+        unsigned int was = *word;
+
+        *word = was | (1u << (frame % 32));
+        if (was) {
+            break;
+        }
+        frame /= 32;
+    }
+}
+
+/* Clears the frame's bit, and the summary bits whose word became empty */
+static void pmm_mark_used(unsigned int frame)
+{
+    for (int level = 0; level < PMM_LEVELS; level++) {
+        unsigned int *word = &pmm_levels[level][frame / 32];
+
+        *word &= ~(1u << (frame % 32));
+        if (*word) {
+            break;
+        }
+        frame /= 32;
+    }
+}
+
+
+void pmm_release_region(unsigned long long start, unsigned long long end)
+{
+    unsigned long long first = (start + PMM_FRAME_SIZE - 1) >> PMM_FRAME_SHIFT;
+    unsigned long long last = end >> PMM_FRAME_SHIFT;
+
+    unsigned int flags;
+
+    if (last > PMM_MAX_FRAMES) {
+        last = PMM_MAX_FRAMES;
+    }
+    flags = spin_lock_irqsave(&pmm_lock);
+    for (unsigned long long frame = first; frame < last; frame++) {
+        if (!pmm_frame_is_free(frame)) {
+            pmm_mark_free(frame);
+            pmm_free_count++;
+        }
+    }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+void pmm_reserve_region(unsigned long long start, unsigned long long end)
+{
+    unsigned long long first = start >> PMM_FRAME_SHIFT;
+    unsigned long long last = (end + PMM_FRAME_SIZE - 1) >> PMM_FRAME_SHIFT;
+
+    unsigned int flags;
+
+    if (last > PMM_MAX_FRAMES) {
+        last = PMM_MAX_FRAMES;
+    }
+    flags = spin_lock_irqsave(&pmm_lock);
+    for (unsigned long long frame = first; frame < last; frame++) {
+        if (pmm_frame_is_free(frame)) {
+            pmm_mark_used(frame);
+            pmm_free_count--;
+        }
+    }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+
+/** pmm_reserve_boot_info:
+ *  Reserves what GRUB left in memory that the kernel may still read:
+ *  the info structure, the memory map, the command line and the modules.
+ */
+static void __init pmm_reserve_boot_info(struct multiboot_info *mbi)
+{
+    unsigned int addr = virt_to_phys(mbi);
+
+    /* Everything GRUB points to is a physical address */
+    pmm_reserve_region(addr, addr + sizeof(*mbi));
+    if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+        pmm_reserve_region(mbi->mmap_addr, mbi->mmap_addr + mbi->mmap_length);
+    }
+    if (mbi->flags & MULTIBOOT_INFO_CMDLINE) {
+        pmm_reserve_region(mbi->cmdline, mbi->cmdline + strlen(phys_to_virt(mbi->cmdline)) + 1);
+    }
+    if (mbi->flags & MULTIBOOT_INFO_MODS) {
+        struct multiboot_module *mods = phys_to_virt(mbi->mods_addr);
+
+        pmm_reserve_region(mbi->mods_addr, mbi->mods_addr + mbi->mods_count * sizeof(*mods));
+        for (unsigned int i = 0; i < mbi->mods_count; i++) {
+            pmm_reserve_region(mods[i].mod_start, mods[i].mod_end);
+            if (mods[i].string) {
+                pmm_reserve_region(mods[i].string, mods[i].string + strlen(phys_to_virt(mods[i].string)) + 1);
+            }
+        }
+    }
+}
+
+
+int __init pmm_init(struct multiboot_info *mbi)
+{
+    if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+        unsigned int addr;
+        unsigned int end = mbi->mmap_addr + mbi->mmap_length;
+
+        /* Free what is available first, then take back anything another entry reserves */
+        for (int pass = 0; pass < 2; pass++) {
+            for (addr = mbi->mmap_addr; addr < end;) {
+                struct multiboot_mmap_entry *entry = phys_to_virt(addr);
+
+                if (pass == 0 && entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                    pmm_release_region(entry->addr, entry->addr + entry->len);
+                } else if (pass == 1 && entry->type != MULTIBOOT_MEMORY_AVAILABLE) {
+                    pmm_reserve_region(entry->addr, entry->addr + entry->len);
+                }
+                addr += entry->size + sizeof(entry->size);
+            }
+        }
+    } else if (mbi->flags & MULTIBOOT_INFO_MEMORY) {
+        pmm_release_region(PMM_LOW_MEMORY_END,
+                           PMM_LOW_MEMORY_END + (unsigned long long)mbi->mem_upper * 1024);
+    } else {
+        return -1;
+    }
+    pmm_total_count = pmm_free_count;
+
+    pmm_reserve_region(0, PMM_LOW_MEMORY_END);
+    pmm_reserve_region((unsigned int)kernel_phys_start, (unsigned int)kernel_phys_end);
+    pmm_reserve_boot_info(mbi);
+    return 0;
+}
+
+
+unsigned int __hot pmm_alloc_frame(void)
+{
+    unsigned int frame = 0;
+    unsigned int flags = spin_lock_irqsave(&pmm_lock);
+
+    if (!pmm_level3[0]) {
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        return 0;
+    }
+    for (int level = PMM_LEVELS - 1; level >= 0; level--) {
+        frame = frame * 32 + __builtin_ctz(pmm_levels[level][frame]);
+    }
+    pmm_mark_used(frame);
+    pmm_free_count--;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return frame << PMM_FRAME_SHIFT;
+}
+
+
+void __hot pmm_free_frame(unsigned int addr)
+{
+    unsigned int frame = addr >> PMM_FRAME_SHIFT;
+    unsigned int flags = spin_lock_irqsave(&pmm_lock);
+
+    if (!pmm_frame_is_free(frame)) {
+        pmm_mark_free(frame);
+        pmm_free_count++;
+    }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+
+unsigned int pmm_free_frames(void)
+{
+    return pmm_free_count;
+}
+
+
+unsigned int pmm_total_frames(void)
+{
+    return pmm_total_count;
+}
+
+
+unsigned int pmm_release_init(void)
+{
+    unsigned int size = __init_end - __init_start;
+
+    /* Without a memory map the kernel image was never reserved either */
+    if (!pmm_total_count || !size) {
+        return 0;
+    }
+    /* log_info and friends in __init code left static_branch sites in there */
+    jump_label_release((unsigned int)__init_start, (unsigned int)__init_end);
+    /* int3 everywhere: a late call into an __init function traps at once */
+    memset(__init_start, 0xCC, size);
+    pmm_release_region(virt_to_phys(__init_start), virt_to_phys(__init_end));
+    return size;
+}
@@ -0,0 +1,200 @@
+#include "profile.h"
+#include "compiler.h"
+#include "pit.h"
+#include "paging.h"
+#include "serial.h"
+#include "cpu.h"
+#include "ksyms.h"
+#include "string.h"
+
+/*
+ * Samples are appended as words: depth, eip, then depth return addresses.
+ * Only the PIT hook writes, with interrupts off; the buffer fills up and
+ * stays full (counting what it drops) until profile_dump empties it, so a
+ * dump always covers one contiguous stretch of time.
+ */
+static unsigned int profile_buffer[PROFILE_BUFFER_WORDS];
+static unsigned int profile_len;
+static unsigned int profile_samples;
+static unsigned int profile_dropped;
+
+static volatile unsigned int profile_running;
+static unsigned int profile_interval = 1;
+static unsigned int profile_depth;
+static unsigned int profile_countdown;
+
+
+/* A frame pointer the walk may dereference: aligned and inside the direct map */
+static int profile_frame_ok(unsigned int fp)
+{
+    return (fp & 3) == 0 && fp >= KERNEL_VIRTUAL_BASE &&
+           fp < KERNEL_VIRTUAL_BASE + PAGING_DIRECT_MAP_SIZE - 8;
+}
+
+
+static void __hot profile_tick(struct interrupt_frame *frame)
+{
+    unsigned int *sample;
+    unsigned int depth = 0;
+    unsigned int fp;
+
+    if (!profile_running || --profile_countdown) {
+        return;
+    }
+    profile_countdown = profile_interval;
+
+    if (profile_len + 2 + profile_depth > PROFILE_BUFFER_WORDS) {
+        profile_dropped++;
+        return;
+    }
+    sample = &profile_buffer[profile_len];
+    sample[1] = frame->eip;
+
+    /*
+     * Each frame holds the caller's ebp at [ebp] and the return address at
+     * [ebp + 4]. Stack frames only get older towards higher addresses, so
+     * anything else means the chain is broken (or code without frame
+     * pointers was interrupted) and the walk stops.
+     */
+    for (fp = frame->ebp; depth < profile_depth && profile_frame_ok(fp); depth++) {
+        unsigned int *link = (unsigned int *)fp;
+
+        if (link[1] < KERNEL_VIRTUAL_BASE) {
+            break;
+        }
+        sample[2 + depth] = link[1];
+        if (link[0] <= fp) {
+            depth++;
+            break;
+        }
+        fp = link[0];
+    }
+    sample[0] = depth;
+    profile_len += 2 + depth;
+    profile_samples++;
+}
+
+
+void __init profile_init(void)
+{
+    pit_add_hook(profile_tick);
+}
+
+
+void profile_start(unsigned int interval, unsigned int depth)
+{
+    unsigned int flags = irq_save();
+
+    profile_interval = interval ? interval : 1;
+    profile_depth = depth < PROFILE_MAX_DEPTH ? depth : PROFILE_MAX_DEPTH;
+    profile_countdown = profile_interval;
+    profile_running = 1;
+    irq_restore(flags);
+}
+
+
+void profile_stop(void)
+{
+    profile_running = 0;
+}
+
+
+void __cold profile_dump(void)
+{
+    unsigned int header[4];
+    unsigned int running = profile_running;
+    unsigned int offset = 0;
+
+    profile_running = 0;
+
+    header[0] = PROFILE_DUMP_MAGIC;
+    header[1] = profile_samples;
+    header[2] = profile_dropped;
+    header[3] = pit_frequency() / profile_interval;
+    serial_flush();
+    serial_write_buf(header, sizeof(header));
+
+    /* Pieces of at most half the serial transmit ring, flushed first so nothing is dropped */
+    while (offset < profile_len) {
+        unsigned int chunk = profile_len - offset;
+
+        if (chunk > SERIAL_TX_RING_SIZE / 8) {
+            chunk = SERIAL_TX_RING_SIZE / 8;
+        }
+        serial_flush();
+        serial_write_buf(&profile_buffer[offset], chunk * 4);
+        offset += chunk;
+    }
+    serial_flush();
+
+    profile_len = 0;
+    profile_samples = 0;
+    profile_dropped = 0;
+    profile_running = running;
+}
+
+
+void __cold profile_report(unsigned int top)
+{
+    /* Open addressing on the name pointer; ksyms returns one pointer per function */
+    static struct {
+        const char *name;
+        unsigned int samples;
+    } slots[PROFILE_REPORT_SLOTS];
+    unsigned int running = profile_running;
+    unsigned int unknown = 0, other = 0;
+    unsigned int pos;
+    char line[96];
+
+    profile_running = 0;
+    memset(slots, 0, sizeof(slots));
+    for (pos = 0; pos < profile_len; pos += 2 + profile_buffer[pos]) {
+        const char *name = ksyms_lookup(profile_buffer[pos + 1], 0);
+        unsigned int i, probes;
+
+        if (!name) {
+            unknown++;
+            continue;
+        }
+        i = ((unsigned int)name >> 2) % PROFILE_REPORT_SLOTS;
+        for (probes = 0; probes < PROFILE_REPORT_SLOTS; probes++) {
+            if (!slots[i].name || slots[i].name == name) {
+                break;
+            }
+            i = (i + 1) % PROFILE_REPORT_SLOTS;
+        }
+        if (probes == PROFILE_REPORT_SLOTS) {
+            other++;
+            continue;
+        }
+        slots[i].name = name;
+        slots[i].samples++;
+    }
+
+    snprintf(line, sizeof(line), "\nprofile: %u samples, %u dropped\n", profile_samples, profile_dropped);
+    serial_write(line);
+    /* Selection by repeated maximum: top is small and the table is fixed */
+    while (top-- > 0 && profile_samples) {
+        unsigned int best = 0;
+
+        for (unsigned int i = 1; i < PROFILE_REPORT_SLOTS; i++) {
+            if (slots[i].samples > slots[best].samples) {
+                best = i;
+            }
+        }
+        if (!slots[best].samples) {
+            break;
+        }
+        snprintf(line, sizeof(line), "profile: %8u %5u.%u%% %s\n", slots[best].samples,
+                 slots[best].samples * 100 / profile_samples,
+                 slots[best].samples * 1000 / profile_samples % 10, slots[best].name);
+        serial_write(line);
+        slots[best].samples = 0;
+    }
+    if (unknown || other) {
+        snprintf(line, sizeof(line), "profile: %u samples outside known functions, %u in uncounted ones\n",
+                 unknown, other);
+        serial_write(line);
+    }
+    profile_running = running;
+}
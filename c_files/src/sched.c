@@ -0,0 +1,379 @@
+#include "sched.h"
+#include "compiler.h"
+#include "interrupt.h"
+#include "paging.h"
+#include "pmm.h"
+#include "slab.h"
+#include "pit.h"
+#include "string.h"
+#include "cpu.h"
+
+/* asm/switch.s: saves ebx/esi/edi/ebp, stores esp to *prev_esp, resumes next_esp */
+void switch_to(unsigned int *prev_esp, unsigned int next_esp);
+
+volatile unsigned int sched_need_resched;
+
+struct sched_queue {
+    struct task *head;
+    struct task *tail;
+};
+
+static struct sched_queue sched_queues[SCHED_NUM_PRIORITIES];
+static unsigned int sched_ready_mask;      /* bit p set: sched_queues[p] is not empty */
+
+static struct task sched_boot_task;
+static struct task *sched_current;
+static struct task *sched_sleepers;
+static struct task *sched_dead;            /* exited, waiting to be freed */
+static struct kmem_cache *sched_task_cache;
+static unsigned int sched_next_id;
+static unsigned int sched_waiting;         /* sched_switch is halting for a ready thread */
+
+/* Lazy x87/SSE switching: the registers hold sched_fpu_owner's state */
+static struct task *sched_fpu_owner;
+static int sched_lazy_fpu;
+static unsigned char sched_fpu_initial[TASK_FPU_STATE_SIZE] __attribute__((aligned(16)));
+
+
+static void sched_enqueue(struct task *task)
+{
+    struct sched_queue *q = &sched_queues[task->priority];
+
+    task->state = TASK_READY;
+    task->next = 0;
+    if (q->tail) {
+        q->tail->next = task;
+    } else {
+        q->head = task;
+    }
+    q->tail = task;
+    sched_ready_mask |= 1u << task->priority;
+}
+
+
+static struct task *sched_dequeue(unsigned int priority)
+{
+    struct sched_queue *q = &sched_queues[priority];
+    struct task *task = q->head;
+
+    q->head = task->next;
+    if (!q->head) {
+        q->tail = 0;
+        sched_ready_mask &= ~(1u << priority);
+    }
+    return task;
+}
+
+
+/* Ready task that should take over the CPU from the running one */
+static void sched_make_ready(struct task *task)
+{
+    sched_enqueue(task);
+    if (task->priority < sched_current->priority) {
+        sched_need_resched = 1;
+    }
+}
+
+
+/* Runs first in every thread that switch_to resumes */
+static void __hot sched_finish_switch(void)
+{
+    struct task *dead = sched_dead;
+
+    if (!dead) {
+        return;
+    }
+    sched_dead = 0;
+    if (sched_fpu_owner == dead) {
+        sched_fpu_owner = 0;
+    }
+    /* The boot thread's stack and task are static */
+    if (dead != &sched_boot_task) {
+        pmm_free_frame(virt_to_phys(dead->stack));
+        kmem_cache_free(sched_task_cache, dead);
+    }
+}
+
+
+/*
+ * Picks the next thread and switches to it. Interrupts must be disabled.
+ * A running caller keeps the CPU unless a thread of the same or higher
+ * priority is ready; any other caller has already left the run queues.
+ */
+static void __hot sched_switch(void)
+{
+    struct task *prev = sched_current;
+    struct task *next;
+
+    if (prev->state == TASK_RUNNING) {
+        if (!sched_ready_mask ||
+            (unsigned int)__builtin_ctz(sched_ready_mask) > prev->priority) {
+            sched_need_resched = 0;
+            return;
+        }
+        sched_enqueue(prev);
+    }
+
+    /*
+     * Only before sched_idle can every thread be waiting. Halt here until
+     * an interrupt readies one; sched_preempt leaves this loop alone.
+     */
+    sched_waiting = 1;
+    while (!sched_ready_mask) {
+        __asm__ volatile("sti\n\thlt\n\tcli" : : : "memory");
+    }
+    sched_waiting = 0;
+
+    next = sched_dequeue(__builtin_ctz(sched_ready_mask));
+    next->state = TASK_RUNNING;
+    next->slice = SCHED_TIMESLICE_TICKS;
+    sched_need_resched = 0;
+    if (next == prev) {
+        return;
+    }
+
+    /* The FPU registers stay put; the first x87/SSE instruction of a new owner traps */
+    if (sched_lazy_fpu) {
+        if (next == sched_fpu_owner) {
+            clts();
+        } else {
+            write_cr0(read_cr0() | CR0_TS);
+        }
+    }
+
+    sched_current = next;
+    switch_to(&prev->esp, next->esp);
+    sched_finish_switch();
+}
+
+
+/* #NM: the running thread touched the FPU while CR0.TS was set */
+static void sched_fpu_trap(struct interrupt_frame *frame)
+{
+    struct task *task = sched_current;
+
+    (void)frame;
+    clts();
+    if (sched_fpu_owner == task) {
+        return;
+    }
+    if (sched_fpu_owner) {
+        __asm__ volatile("fxsave %0" : "=m"(sched_fpu_owner->fpu));
+    }
+    __asm__ volatile("fxrstor %0" : : "m"(task->fpu));
+    sched_fpu_owner = task;
+}
+
+
+/* PIT hook: wakes sleepers and ends time slices */
+static void __hot sched_tick(struct interrupt_frame *frame)
+{
+    struct task **link = &sched_sleepers;
+    unsigned int now = pit_ticks();
+
+    (void)frame;
+    while (*link) {
+        struct task *task = *link;
+
+        if ((int)(now - task->wake_tick) >= 0) {
+            *link = task->next;
+            sched_make_ready(task);
+        } else {
+            link = &task->next;
+        }
+    }
+
+    if (sched_current->slice && --sched_current->slice) {
+        return;
+    }
+    if (sched_ready_mask &&
+        (unsigned int)__builtin_ctz(sched_ready_mask) <= sched_current->priority) {
+        sched_need_resched = 1;
+    }
+}
+
+
+/* First code of every new thread, entered from switch_to's ret */
+static void task_start(void)
+{
+    struct task *task = sched_current;
+
+    sched_finish_switch();
+    irq_enable();
+    task->fn(task->arg);
+    task_exit();
+}
+
+
+static void task_set_name(struct task *task, const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < TASK_NAME_LEN - 1 && name[i] != '\0'; i++) {
+        task->name[i] = name[i];
+    }
+    task->name[i] = '\0';
+}
+
+
+void __init sched_init(void)
+{
+    struct task *task = &sched_boot_task;
+
+    task_set_name(task, "main");
+    task->state = TASK_RUNNING;
+    task->priority = SCHED_PRIORITY_DEFAULT;
+    task->slice = SCHED_TIMESLICE_TICKS;
+    task->id = sched_next_id++;
+    sched_current = task;
+
+    sched_task_cache = kmem_cache_create("task", sizeof(struct task), 16);
+
+    /* New threads start from the state right after fninit (cpu_enable_sse) */
+    sched_lazy_fpu = cpu_sse_enabled();
+    if (sched_lazy_fpu) {
+        __asm__ volatile("fninit\n\tfxsave %0" : "=m"(sched_fpu_initial));
+        sched_fpu_owner = task;
+        interrupt_register(EXCEPTION_DEVICE_NOT_AVAIL, sched_fpu_trap);
+    }
+    pit_add_hook(sched_tick);
+}
+
+
+struct task *task_create(const char *name, task_fn_t fn, void *arg, unsigned int priority)
+{
+    struct task *task;
+    unsigned int frame, *sp, flags;
+
+    if (!sched_task_cache || priority >= SCHED_PRIORITY_IDLE) {
+        return 0;
+    }
+    task = kmem_cache_alloc(sched_task_cache);
+    if (!task) {
+        return 0;
+    }
+    frame = pmm_alloc_frame();
+    if (!frame) {
+        kmem_cache_free(sched_task_cache, task);
+        return 0;
+    }
+
+    task_set_name(task, name);
+    memcpy(task->fpu, sched_fpu_initial, TASK_FPU_STATE_SIZE);
+    task->priority = priority;
+    task->stack = phys_to_virt(frame);
+    task->fn = fn;
+    task->arg = arg;
+
+    /* What switch_to pops: edi, esi, ebx, ebp = 0 (ends backtraces), then task_start */
+    sp = (unsigned int *)((char *)task->stack + TASK_STACK_SIZE);
+    *--sp = 0;                              /* task_start's return address, never used */
+    *--sp = (unsigned int)task_start;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+    task->esp = (unsigned int)sp;
+
+    flags = irq_save();
+    task->id = sched_next_id++;
+    sched_make_ready(task);
+    if (sched_need_resched && (flags & EFLAGS_IF)) {
+        sched_switch();
+    }
+    irq_restore(flags);
+    return task;
+}
+
+
+struct task *task_current(void)
+{
+    return sched_current;
+}
+
+
+void sched_yield(void)
+{
+    unsigned int flags;
+
+    if (!sched_current) {
+        return;
+    }
+    flags = irq_save();
+    sched_switch();
+    irq_restore(flags);
+}
+
+
+void task_sleep(unsigned int ticks)
+{
+    unsigned int flags = irq_save();
+    struct task *task = sched_current;
+
+    task->state = TASK_SLEEPING;
+    task->wake_tick = pit_ticks() + (ticks ? ticks : 1);
+    task->next = sched_sleepers;
+    sched_sleepers = task;
+    sched_switch();
+    irq_restore(flags);
+}
+
+
+void task_block(void)
+{
+    unsigned int flags = irq_save();
+
+    sched_current->state = TASK_BLOCKED;
+    sched_switch();
+    irq_restore(flags);
+}
+
+
+void task_wake(struct task *task)
+{
+    unsigned int flags = irq_save();
+
+    if (task->state == TASK_BLOCKED) {
+        sched_make_ready(task);
+        /* Called from a thread: switch now instead of at the next interrupt */
+        if (sched_need_resched && (flags & EFLAGS_IF)) {
+            sched_switch();
+        }
+    }
+    irq_restore(flags);
+}
+
+
+void task_exit(void)
+{
+    irq_disable();
+    sched_current->state = TASK_DEAD;
+    sched_dead = sched_current;
+    sched_switch();
+    for (;;) {
+        /* not reached: nothing switches back to a dead thread */
+    }
+}
+
+
+void sched_idle(void)
+{
+    unsigned int flags = irq_save();
+
+    sched_current->priority = SCHED_PRIORITY_IDLE;
+    sched_switch();
+    irq_restore(flags);
+
+    /* Interrupts that ready a thread switch to it on their way out */
+    for (;;) {
+        __asm__ volatile("hlt");
+    }
+}
+
+
+void sched_preempt(void)
+{
+    if (sched_current && !sched_waiting) {
+        sched_switch();
+    }
+}
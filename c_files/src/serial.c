@@ -1,5 +1,43 @@
-#include "stdio.h"
+#include "io.h"
+#include "compiler.h"
+#include "cpu.h"
 #include "serial.h"
+#include "sched.h"
+
+#define SERIAL_TX_RING_MASK (SERIAL_TX_RING_SIZE - 1)
+
+/*
+ * Transmit ring of one COM port. head and tail run freely and are masked on
+ * access, so head - tail is always the number of queued bytes. Writers move
+ * head, the drain side (IRQ handler or a kicking writer) moves tail; both
+ * hold lock with interrupts off, since two threads, or another CPU, may
+ * write to the same port at once.
+ */
+struct serial_tx_ring {
+    struct spinlock lock;
+    volatile unsigned int head;
+    volatile unsigned int tail;
+    volatile unsigned int busy;         /* FIFO was refilled, a THRE irq will follow */
+    volatile unsigned int held;         /* a frame is going out: serial_hold_com */
+    unsigned int irq_enabled;
+    unsigned int full_events;
+    unsigned int dropped;
+    unsigned char buf[SERIAL_TX_RING_SIZE];
+};
+
+static struct serial_tx_ring serial_tx_rings[4];
+
+
+static struct serial_tx_ring *serial_tx_ring(unsigned short com)
+{
+    switch (com) {
+        case SERIAL_COM1_BASE: return &serial_tx_rings[0];
+        case SERIAL_COM2_BASE: return &serial_tx_rings[1];
+        case SERIAL_COM3_BASE: return &serial_tx_rings[2];
+        case SERIAL_COM4_BASE: return &serial_tx_rings[3];
+        default:               return 0;
+    }
+}
 
 void serial_configure_baud_rate(unsigned short com, unsigned short divisor)
 {
@@ -53,11 +91,17 @@ void serial_init(void)
 
 void serial_begin_com(unsigned short com, unsigned int baud_rate)
 {
+    struct serial_tx_ring *ring = serial_tx_ring(com);
     unsigned short divisor = 115200 / baud_rate;
+
     serial_configure_baud_rate(com, divisor);
     serial_configure_line(com);
     serial_configure_fifo(com);
     serial_configure_modem(com);
+    /* Reconfiguring an interrupt-driven port (log_init does) must not cut OUT2 and THRE */
+    if (ring && ring->irq_enabled) {
+        serial_tx_irq_enable_com(com);
+    }
 }
 
 
@@ -67,10 +111,108 @@ void serial_begin(unsigned int baud_rate)
 }
 
 
+/** serial_tx_fill_fifo:
+ *  Moves up to SERIAL_TX_FIFO_SIZE bytes from the ring into the UART if its
+ *  transmitter is empty. The caller holds ring->lock with interrupts off.
+ */
+static void serial_tx_fill_fifo(unsigned short com, struct serial_tx_ring *ring)
+{
+    unsigned int tail = ring->tail;
+    unsigned int count = ring->head - tail;
+
+    if (count == 0) {
+        ring->busy = 0;
+        return;
+    }
+    if (serial_is_transmit_fifo_empty_com(com) == 0) {
+        return;
+    }
+
+    if (count > SERIAL_TX_FIFO_SIZE) {
+        count = SERIAL_TX_FIFO_SIZE;
+    }
+    while (count > 0) {
+        /* One rep outsb per contiguous piece of the ring */
+        unsigned int offset = tail & SERIAL_TX_RING_MASK;
+        unsigned int chunk = SERIAL_TX_RING_SIZE - offset;
+
+        if (chunk > count) {
+            chunk = count;
+        }
+        outsb(SERIAL_DATA_PORT(com), &ring->buf[offset], chunk);
+        tail += chunk;
+        count -= chunk;
+    }
+    ring->tail = tail;
+    ring->busy = 1;
+}
+
+
+/** serial_tx_kick:
+ *  Starts or continues transmission from the writer's side. With transmit
+ *  interrupts on this is only needed when the UART went idle. Called with
+ *  ring->lock held.
+ */
+static void serial_tx_kick(unsigned short com, struct serial_tx_ring *ring)
+{
+    if (!(ring->irq_enabled && ring->busy)) {
+        serial_tx_fill_fifo(com, ring);
+    }
+}
+
+
+/** serial_tx_enqueue:
+ *  Copies len bytes into the ring and kicks the transmitter, all under the
+ *  ring's lock. When the ring is full: with partial set, stops there;
+ *  otherwise a port without transmit interrupts drains it by polling and
+ *  an interrupt-driven port drops the rest. Returns the number of bytes
+ *  queued.
+ */
+static unsigned int serial_tx_enqueue(unsigned short com, struct serial_tx_ring *ring,
+                                      const char *buf, unsigned int len, int partial)
+{
+    unsigned int flags = spin_lock_irqsave(&ring->lock);
+    unsigned int head = ring->head;
+    unsigned int i;
+
+    for (i = 0; i < len; i++) {
+        if (head - ring->tail == SERIAL_TX_RING_SIZE) {
+            ring->head = head;
+            if (partial) {
+                break;
+            }
+            ring->full_events++;
+            if (ring->irq_enabled) {
+                ring->dropped += len - i;
+                break;
+            }
+            /* Poll with interrupts on between status reads */
+            while (head - ring->tail == SERIAL_TX_RING_SIZE) {
+                spin_unlock_irqrestore(&ring->lock, flags);
+                flags = spin_lock_irqsave(&ring->lock);
+                serial_tx_fill_fifo(com, ring);
+                head = ring->head;
+            }
+        }
+        ring->buf[head++ & SERIAL_TX_RING_MASK] = buf[i];
+    }
+    ring->head = head;
+    serial_tx_kick(com, ring);
+    spin_unlock_irqrestore(&ring->lock, flags);
+    return i;
+}
+
+
 void serial_write_char_com(unsigned short com, char c)
 {
-    while (serial_is_transmit_fifo_empty_com(com) == 0);
-    outb(SERIAL_DATA_PORT(com), c);
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+
+    if (!ring) {
+        while (serial_is_transmit_fifo_empty_com(com) == 0);
+        outb(SERIAL_DATA_PORT(com), c);
+        return;
+    }
+    serial_tx_enqueue(com, ring, &c, 1, 0);
 }
 
 
@@ -82,9 +224,80 @@ void serial_write_char(char c)
 
 void serial_write_com(unsigned short com, char *buf)
 {
-    while (*buf) {
-        serial_write_char_com(com, *buf++);
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+    unsigned int len = 0;
+
+    if (!ring) {
+        while (*buf) {
+            serial_write_char_com(com, *buf++);
+        }
+        return;
+    }
+    while (buf[len]) {
+        len++;
+    }
+    serial_tx_enqueue(com, ring, buf, len, 0);
+}
+
+
+void serial_write_buf_com(unsigned short com, const void *buf, unsigned int len)
+{
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+    const char *bytes = (const char *)buf;
+
+    if (!ring) {
+        while (len-- > 0) {
+            serial_write_char_com(com, *bytes++);
+        }
+        return;
     }
+    serial_tx_enqueue(com, ring, bytes, len, 0);
+}
+
+
+void serial_write_buf(const void *buf, unsigned int len)
+{
+    serial_write_buf_com(SERIAL_COM1_BASE, buf, len);
+}
+
+
+void serial_write_buf_blocking_com(unsigned short com, const void *buf, unsigned int len)
+{
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+    const char *bytes = (const char *)buf;
+
+    if (!ring) {
+        serial_write_buf_com(com, buf, len);
+        return;
+    }
+    for (;;) {
+        /* Queue only what fits, so serial_tx_enqueue never counts a drop */
+        unsigned int n = serial_tx_enqueue(com, ring, bytes, len, 1);
+        unsigned int flags;
+
+        bytes += n;
+        len -= n;
+        if (len == 0) {
+            break;
+        }
+        flags = spin_lock_irqsave(&ring->lock);
+        serial_tx_fill_fifo(com, ring);
+        spin_unlock_irqrestore(&ring->lock, flags);
+        if (ring->irq_enabled && (flags & EFLAGS_IF)) {
+            sched_yield();
+        }
+    }
+}
+
+
+unsigned int serial_write_buf_nowait_com(unsigned short com, const void *buf, unsigned int len)
+{
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+
+    if (!ring) {
+        return 0;
+    }
+    return serial_tx_enqueue(com, ring, (const char *)buf, len, 1);
 }
 
 
@@ -93,3 +306,119 @@ void serial_write(char *buf)
     serial_write_com(SERIAL_COM1_BASE, buf);
 }
 
+
+void serial_flush_com(unsigned short com)
+{
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+
+    if (!ring) {
+        return;
+    }
+    while (ring->head != ring->tail) {
+        unsigned int flags = spin_lock_irqsave(&ring->lock);
+
+        serial_tx_fill_fifo(com, ring);
+        spin_unlock_irqrestore(&ring->lock, flags);
+        /* The THRE interrupt keeps draining; let other threads compute meanwhile */
+        if (ring->irq_enabled && (flags & EFLAGS_IF)) {
+            sched_yield();
+        }
+    }
+}
+
+
+void serial_flush(void)
+{
+    serial_flush_com(SERIAL_COM1_BASE);
+}
+
+
+void serial_hold_com(unsigned short com)
+{
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+
+    if (!ring) {
+        return;
+    }
+    for (;;) {
+        unsigned int flags = spin_lock_irqsave(&ring->lock);
+
+        if (!ring->held) {
+            ring->held = 1;
+            spin_unlock_irqrestore(&ring->lock, flags);
+            return;
+        }
+        spin_unlock_irqrestore(&ring->lock, flags);
+        /* Another thread's frame: it releases the port when it is done */
+        if (flags & EFLAGS_IF) {
+            sched_yield();
+        } else {
+            __asm__ volatile("pause" : : : "memory");
+        }
+    }
+}
+
+
+void serial_release_com(unsigned short com)
+{
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+
+    if (ring) {
+        ring->held = 0;
+    }
+}
+
+
+int serial_held_com(unsigned short com)
+{
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+
+    return ring && ring->held;
+}
+
+
+void serial_tx_irq_enable_com(unsigned short com)
+{
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+    unsigned int flags;
+
+    if (!ring) {
+        return;
+    }
+    flags = spin_lock_irqsave(&ring->lock);
+    ring->irq_enabled = 1;
+    outb(SERIAL_MODEM_COMMAND_PORT(com), SERIAL_MODEM_CONFIG_IRQ);
+    outb(SERIAL_INTERRUPT_ENABLE_PORT(com), SERIAL_IER_THRE);
+    serial_tx_fill_fifo(com, ring);
+    spin_unlock_irqrestore(&ring->lock, flags);
+}
+
+
+void __hot serial_tx_irq_handler(unsigned short com)
+{
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+    unsigned char iir = inb(SERIAL_INTERRUPT_ID_PORT(com));
+
+    if (!ring || (iir & SERIAL_IIR_NO_INTERRUPT)) {
+        return;
+    }
+    if ((iir & SERIAL_IIR_ID_MASK) == SERIAL_IIR_THRE) {
+        spin_lock(&ring->lock);
+        serial_tx_fill_fifo(com, ring);
+        spin_unlock(&ring->lock);
+    }
+}
+
+
+void serial_tx_stats_com(unsigned short com, struct serial_tx_stats *stats)
+{
+    struct serial_tx_ring *ring = serial_tx_ring(com);
+
+    if (!ring) {
+        stats->queued = stats->full_events = stats->dropped = 0;
+        return;
+    }
+    stats->queued      = ring->head - ring->tail;
+    stats->full_events = ring->full_events;
+    stats->dropped     = ring->dropped;
+}
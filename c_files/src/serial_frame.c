@@ -0,0 +1,288 @@
+#include "serial_frame.h"
+#include "serial.h"
+#include "slab.h"
+#include "string.h"
+#include "cpu.h"
+
+/* LZ4 block format limits: see the LZ4 block format description */
+#define LZ_MINMATCH     4       /* shortest match worth a sequence */
+#define LZ_MFLIMIT      12      /* the last match starts at least this far from the end */
+#define LZ_LASTLITERALS 5       /* ... and the block ends with at least this many literals */
+#define LZ_HASH_SIZE    (1u << SERIAL_FRAME_LZ_HASH_BITS)
+
+#define COBS_BLOCK_MAX  255     /* code byte plus up to 254 non-zero bytes */
+
+#define FRAME_BUF_SIZE  (sizeof(struct serial_frame_header) + SERIAL_FRAME_MAX_DATA + 4)
+
+static unsigned int crc32_table[256];
+static unsigned int serial_frame_seq;
+
+
+unsigned int crc32(unsigned int crc, const void *data, unsigned int len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    unsigned int i;
+
+    /* Built on first use; building it twice concurrently gives the same table */
+    if (!crc32_table[1]) {
+        for (i = 0; i < 256; i++) {
+            unsigned int c = i;
+            unsigned int k;
+
+            for (k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            crc32_table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (i = 0; i < len; i++) {
+        crc = crc32_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+
+static unsigned int lz_read32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+
+/* Writes an LZ4 length continuation: 255s and then the remainder */
+static unsigned char *lz_write_length(unsigned char *op, unsigned int len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+
+/*
+ * Greedy LZ4 block compressor with a single-entry hash table of 4-byte
+ * sequences. Returns the compressed size, or 0 if it would not fit in cap
+ * bytes, in which case the caller sends the data as it is.
+ */
+static unsigned int lz_compress(const unsigned char *src, unsigned int len,
+                                unsigned char *dst, unsigned int cap,
+                                unsigned short *table)
+{
+    unsigned char *op = dst;
+    unsigned char *end = dst + cap;
+    unsigned int ip = 0;
+    unsigned int anchor = 0;
+    unsigned int lits;
+
+    if (len > LZ_MFLIMIT) {
+        /* Entries hold position + 1, so 0 means empty */
+        memset(table, 0, LZ_HASH_SIZE * sizeof(*table));
+
+        while (ip < len - LZ_MFLIMIT) {
+            unsigned int seq = lz_read32(src + ip);
+            unsigned int h = (seq * 2654435761u) >> (32 - SERIAL_FRAME_LZ_HASH_BITS);
+            unsigned int ref = table[h];
+            unsigned int mlen;
+
+            table[h] = (unsigned short)(ip + 1);
+            if (!ref || lz_read32(src + ref - 1) != seq) {
+                ip++;
+                continue;
+            }
+            ref--;
+
+            mlen = LZ_MINMATCH;
+            while (ip + mlen < len - LZ_LASTLITERALS && src[ref + mlen] == src[ip + mlen]) {
+                mlen++;
+            }
+
+            /* token, literal length, literals, offset, match length */
+            lits = ip - anchor;
+            if ((unsigned int)(end - op) < 1 + lits / 255 + 1 + lits + 2 + (mlen - LZ_MINMATCH) / 255 + 1) {
+                return 0;
+            }
+            *op++ = (unsigned char)(((lits < 15 ? lits : 15) << 4) |
+                                    (mlen - LZ_MINMATCH < 15 ? mlen - LZ_MINMATCH : 15));
+            if (lits >= 15) {
+                op = lz_write_length(op, lits - 15);
+            }
+            memcpy(op, src + anchor, lits);
+            op += lits;
+            *op++ = (unsigned char)(ip - ref);
+            *op++ = (unsigned char)((ip - ref) >> 8);
+            if (mlen - LZ_MINMATCH >= 15) {
+                op = lz_write_length(op, mlen - LZ_MINMATCH - 15);
+            }
+
+            ip += mlen;
+            anchor = ip;
+        }
+    }
+
+    /* The last sequence is literals only */
+    lits = len - anchor;
+    if ((unsigned int)(end - op) < 1 + lits / 255 + 1 + lits) {
+        return 0;
+    }
+    *op++ = (unsigned char)((lits < 15 ? lits : 15) << 4);
+    if (lits >= 15) {
+        op = lz_write_length(op, lits - 15);
+    }
+    memcpy(op, src + anchor, lits);
+    op += lits;
+    return op - dst;
+}
+
+
+/* COBS-encodes src and sends it one block at a time */
+static void serial_frame_write_cobs(unsigned short com, const unsigned char *src, unsigned int len)
+{
+    unsigned char block[COBS_BLOCK_MAX];
+    unsigned int n = 1;
+    unsigned int i;
+
+    for (i = 0; i < len; i++) {
+        if (src[i] != 0) {
+            block[n++] = src[i];
+        }
+        /* Code n: n - 1 bytes follow, then a zero unless n is 255 */
+        if (src[i] == 0 || n == COBS_BLOCK_MAX) {
+            block[0] = (unsigned char)n;
+            serial_write_buf_blocking_com(com, block, n);
+            n = 1;
+        }
+    }
+    block[0] = (unsigned char)n;
+    serial_write_buf_blocking_com(com, block, n);
+}
+
+
+/* buf: FRAME_BUF_SIZE bytes; table: LZ_HASH_SIZE entries, or 0 */
+static void serial_frame_send(unsigned short com, unsigned int stream, unsigned int offset,
+                              const void *data, unsigned int len, unsigned int flags,
+                              unsigned char *buf, unsigned short *table)
+{
+    struct serial_frame_header *hdr = (struct serial_frame_header *)buf;
+    unsigned char *payload = buf + sizeof(*hdr);
+    unsigned int size = 0;
+    unsigned int crc, irq_flags;
+    const unsigned char delim = 0;
+
+    hdr->version = SERIAL_FRAME_VERSION;
+    hdr->flags = flags & SERIAL_FRAME_FLAG_END;
+    hdr->stream = (unsigned short)stream;
+    hdr->offset = offset;
+    hdr->length = (unsigned short)len;
+    hdr->reserved = 0;
+
+    /* Keep the result only if it saves at least one byte */
+    if (table && len > 0) {
+        size = lz_compress((const unsigned char *)data, len, payload, len - 1, table);
+    }
+    if (size) {
+        hdr->flags |= SERIAL_FRAME_FLAG_LZ;
+    } else {
+        memcpy(payload, data, len);
+        size = len;
+    }
+
+    irq_flags = irq_save();
+    hdr->seq = serial_frame_seq++;
+    irq_restore(irq_flags);
+
+    crc = crc32(0, buf, sizeof(*hdr) + size);
+    payload[size] = (unsigned char)crc;
+    payload[size + 1] = (unsigned char)(crc >> 8);
+    payload[size + 2] = (unsigned char)(crc >> 16);
+    payload[size + 3] = (unsigned char)(crc >> 24);
+
+    /*
+     * The leading zero ends whatever partial frame or text came before.
+     * The writes below may yield; holding the port keeps klogd's text out
+     * of the frame meanwhile.
+     */
+    serial_hold_com(com);
+    serial_write_buf_blocking_com(com, &delim, 1);
+    serial_frame_write_cobs(com, buf, sizeof(*hdr) + size + 4);
+    serial_write_buf_blocking_com(com, &delim, 1);
+    serial_release_com(com);
+}
+
+
+/* Gets the buffers serial_frame_send needs, or returns 0 */
+static unsigned char *serial_frame_alloc(unsigned int flags, unsigned short **table)
+{
+    unsigned char *buf = kmalloc(FRAME_BUF_SIZE);
+
+    *table = 0;
+    if (!buf) {
+        return 0;
+    }
+    if (flags & SERIAL_FRAME_COMPRESS) {
+        *table = kmalloc(LZ_HASH_SIZE * sizeof(**table));
+        if (!*table) {
+            kfree(buf);
+            return 0;
+        }
+    }
+    return buf;
+}
+
+
+int serial_send_frame_com(unsigned short com, unsigned int stream, unsigned int offset,
+                          const void *data, unsigned int len, unsigned int flags)
+{
+    unsigned short *table;
+    unsigned char *buf;
+
+    if (len > SERIAL_FRAME_MAX_DATA) {
+        return -1;
+    }
+    buf = serial_frame_alloc(flags, &table);
+    if (!buf) {
+        return -1;
+    }
+    serial_frame_send(com, stream, offset, data, len, flags, buf, table);
+    kfree(table);
+    kfree(buf);
+    return 0;
+}
+
+
+int serial_send_frame(unsigned int stream, unsigned int offset,
+                      const void *data, unsigned int len, unsigned int flags)
+{
+    return serial_send_frame_com(SERIAL_COM1_BASE, stream, offset, data, len, flags);
+}
+
+
+int serial_send_data(unsigned int stream, const void *data, unsigned int len, unsigned int flags)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned int offset = 0;
+    unsigned short *table;
+    unsigned char *buf;
+
+    buf = serial_frame_alloc(flags, &table);
+    if (!buf) {
+        return -1;
+    }
+    do {
+        unsigned int n = len - offset;
+
+        if (n > SERIAL_FRAME_MAX_DATA) {
+            n = SERIAL_FRAME_MAX_DATA;
+        }
+        serial_frame_send(SERIAL_COM1_BASE, stream, offset, bytes + offset, n,
+                          (flags & ~SERIAL_FRAME_FLAG_END) |
+                          (offset + n == len ? SERIAL_FRAME_FLAG_END : 0),
+                          buf, table);
+        offset += n;
+    } while (offset < len);
+    kfree(table);
+    kfree(buf);
+    return 0;
+}
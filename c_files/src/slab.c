@@ -0,0 +1,295 @@
+#include "slab.h"
+#include "compiler.h"
+#include "pmm.h"
+#include "paging.h"
+#include "log.h"
+#include "string.h"
+#include "cpu.h"
+
+/*
+ * Header at the start of every slab frame. kfree finds it by rounding the
+ * object address down to the frame, and from it the owning cache.
+ */
+struct kmem_slab {
+    struct kmem_cache *cache;
+    struct kmem_slab *prev;
+    struct kmem_slab *next;
+    void *free;                     /* first free object, chained through word 0 */
+    unsigned int inuse;
+};
+
+/* Caches made by kmem_cache_create are objects of this cache */
+static struct kmem_cache kmem_cache_cache;
+
+static struct kmem_cache kmalloc_caches[KMALLOC_NUM_CLASSES];
+static char kmalloc_names[KMALLOC_NUM_CLASSES][KMEM_CACHE_NAME_LEN];
+
+/* Every cache, newest first */
+static struct kmem_cache *kmem_caches;
+
+
+static struct kmem_slab *kmem_slab_of(void *obj)
+{
+    return (struct kmem_slab *)((unsigned int)obj & ~(PMM_FRAME_SIZE - 1));
+}
+
+static void kmem_list_add(struct kmem_slab **list, struct kmem_slab *slab)
+{
+    slab->prev = 0;
+    slab->next = *list;
+    if (*list) {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+static void kmem_list_del(struct kmem_slab **list, struct kmem_slab *slab)
+{
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+
+/** kmem_slab_new:
+ *  Takes a frame from the PMM and threads its objects onto a free list
+ *  in address order.
+ */
+static struct kmem_slab *kmem_slab_new(struct kmem_cache *cache)
+{
+    unsigned int frame = pmm_alloc_frame();
+    struct kmem_slab *slab;
+    char *obj;
+
+    if (!frame) {
+        return 0;
+    }
+    slab = phys_to_virt(frame);
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free = (char *)slab + cache->first_offset;
+
+    obj = slab->free;
+    for (unsigned int i = 1; i < cache->objects_per_slab; i++) {
+        *(void **)obj = obj + cache->object_size;
+        obj += cache->object_size;
+    }
+    *(void **)obj = 0;
+
+    cache->slabs++;
+    return slab;
+}
+
+static void kmem_slab_release(struct kmem_cache *cache, struct kmem_slab *slab)
+{
+    pmm_free_frame(virt_to_phys(slab));
+    cache->slabs--;
+}
+
+
+static void kmem_cache_setup(struct kmem_cache *cache, const char *name,
+                             unsigned int size, unsigned int align)
+{
+    unsigned int i;
+
+    memset(cache, 0, sizeof(*cache));
+    for (i = 0; i < KMEM_CACHE_NAME_LEN - 1 && name[i] != '\0'; i++) {
+        cache->name[i] = name[i];
+    }
+    cache->name[i] = '\0';
+
+    /* Every object has to hold the free list link */
+    if (size < sizeof(void *)) {
+        size = sizeof(void *);
+    }
+    if (align < sizeof(void *)) {
+        align = sizeof(void *);
+    }
+    cache->align = align;
+    cache->object_size = (size + align - 1) & ~(align - 1);
+    cache->first_offset = (sizeof(struct kmem_slab) + align - 1) & ~(align - 1);
+    cache->objects_per_slab = (PMM_FRAME_SIZE - cache->first_offset) / cache->object_size;
+
+    cache->next = kmem_caches;
+    kmem_caches = cache;
+}
+
+
+void __init kmem_init(void)
+{
+    kmem_cache_setup(&kmem_cache_cache, "kmem_cache", sizeof(struct kmem_cache), 0);
+
+    for (unsigned int i = 0; i < KMALLOC_NUM_CLASSES; i++) {
+        unsigned int size = 1u << (i + KMALLOC_MIN_SHIFT);
+
+        snprintf(kmalloc_names[i], KMEM_CACHE_NAME_LEN, "kmalloc-%u", size);
+        kmem_cache_setup(&kmalloc_caches[i], kmalloc_names[i], size,
+                         size < KMEM_CACHE_LINE ? size : KMEM_CACHE_LINE);
+    }
+}
+
+
+struct kmem_cache *kmem_cache_create(const char *name, unsigned int size, unsigned int align)
+{
+    struct kmem_cache *cache;
+    unsigned int flags;
+
+    if (size == 0 || size > KMALLOC_MAX_SIZE || (align & (align - 1)) ||
+        align > KMALLOC_MAX_SIZE) {
+        return 0;
+    }
+    cache = kmem_cache_alloc(&kmem_cache_cache);
+    if (!cache) {
+        return 0;
+    }
+    flags = irq_save();
+    kmem_cache_setup(cache, name, size, align);
+    irq_restore(flags);
+    return cache;
+}
+
+
+int kmem_cache_destroy(struct kmem_cache *cache)
+{
+    struct kmem_cache **link;
+    unsigned int flags = irq_save();
+
+    if (cache->active_objects) {
+        irq_restore(flags);
+        return -1;
+    }
+    /* No objects in use: the only slab left is the spare */
+    if (cache->empty) {
+        kmem_slab_release(cache, cache->empty);
+        cache->empty = 0;
+    }
+    for (link = &kmem_caches; *link != cache; link = &(*link)->next) {
+    }
+    *link = cache->next;
+    irq_restore(flags);
+
+    kmem_cache_free(&kmem_cache_cache, cache);
+    return 0;
+}
+
+
+void __hot *kmem_cache_alloc(struct kmem_cache *cache)
+{
+    unsigned int flags = irq_save();
+    struct kmem_slab *slab = cache->partial;
+    void *obj;
+
+    if (!slab) {
+        if (cache->empty) {
+            slab = cache->empty;
+            cache->empty = 0;
+        } else {
+            slab = kmem_slab_new(cache);
+            if (!slab) {
+                cache->failed++;
+                irq_restore(flags);
+                return 0;
+            }
+        }
+        kmem_list_add(&cache->partial, slab);
+    }
+
+    obj = slab->free;
+    slab->free = *(void **)obj;
+    if (++slab->inuse == cache->objects_per_slab) {
+        kmem_list_del(&cache->partial, slab);
+        kmem_list_add(&cache->full, slab);
+    }
+
+    cache->allocs++;
+    if (++cache->active_objects > cache->peak_objects) {
+        cache->peak_objects = cache->active_objects;
+    }
+    irq_restore(flags);
+    return obj;
+}
+
+
+void __hot kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+    struct kmem_slab *slab = kmem_slab_of(obj);
+    unsigned int flags = irq_save();
+
+    *(void **)obj = slab->free;
+    slab->free = obj;
+    if (slab->inuse-- == cache->objects_per_slab) {
+        kmem_list_del(&cache->full, slab);
+        kmem_list_add(&cache->partial, slab);
+    }
+    if (slab->inuse == 0) {
+        /* Keep one empty slab so a cache at a slab boundary does not thrash the PMM */
+        kmem_list_del(&cache->partial, slab);
+        if (cache->empty) {
+            kmem_slab_release(cache, slab);
+        } else {
+            cache->empty = slab;
+        }
+    }
+
+    cache->frees++;
+    cache->active_objects--;
+    irq_restore(flags);
+}
+
+
+void __hot *kmalloc(unsigned int size)
+{
+    unsigned int class = 0;
+
+    if (size == 0 || size > KMALLOC_MAX_SIZE) {
+        return 0;
+    }
+    if (size > (1u << KMALLOC_MIN_SHIFT)) {
+        class = 32 - __builtin_clz(size - 1) - KMALLOC_MIN_SHIFT;
+    }
+    return kmem_cache_alloc(&kmalloc_caches[class]);
+}
+
+
+void __hot kfree(void *ptr)
+{
+    if (ptr) {
+        kmem_cache_free(kmem_slab_of(ptr)->cache, ptr);
+    }
+}
+
+
+void kmem_cache_stats(struct kmem_cache *cache, struct kmem_cache_stats *stats)
+{
+    unsigned int flags = irq_save();
+
+    stats->object_size = cache->object_size;
+    stats->objects_per_slab = cache->objects_per_slab;
+    stats->slabs = cache->slabs;
+    stats->active_objects = cache->active_objects;
+    stats->peak_objects = cache->peak_objects;
+    stats->allocs = cache->allocs;
+    stats->frees = cache->frees;
+    stats->failed = cache->failed;
+    irq_restore(flags);
+}
+
+
+void __cold kmem_print_stats(void)
+{
+    log_printf("%-16s %5s %5s %5s %7s %7s %9s %9s %6s\n",
+               "cache", "size", "objs", "slabs", "active", "peak", "allocs", "frees", "failed");
+    for (struct kmem_cache *cache = kmem_caches; cache; cache = cache->next) {
+        struct kmem_cache_stats s;
+
+        kmem_cache_stats(cache, &s);
+        log_printf("%-16s %5u %5u %5u %7u %7u %9u %9u %6u\n",
+                   cache->name, s.object_size, s.objects_per_slab, s.slabs,
+                   s.active_objects, s.peak_objects, s.allocs, s.frees, s.failed);
+    }
+}
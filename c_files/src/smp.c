@@ -0,0 +1,399 @@
+#include "smp.h"
+#include "compiler.h"
+#include "lapic.h"
+#include "paging.h"
+#include "pit.h"
+#include "sched.h"
+#include "string.h"
+#include "log.h"
+#include "cpu.h"
+
+/* ACPI 1.0 root pointer; the 2.0 extension (XSDT) is not needed in 32-bit mode */
+struct acpi_rsdp {
+    char signature[8];
+    unsigned char checksum;
+    char oem_id[6];
+    unsigned char revision;
+    unsigned int rsdt_address;
+} __attribute__((packed));
+
+struct acpi_sdt_header {
+    char signature[4];
+    unsigned int length;            /* whole table, header included */
+    unsigned char revision;
+    unsigned char checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    unsigned int oem_revision;
+    unsigned int creator_id;
+    unsigned int creator_revision;
+} __attribute__((packed));
+
+/* MADT: header, then variable-length entries of (type, length, ...) */
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    unsigned int lapic_address;
+    unsigned int flags;
+} __attribute__((packed));
+
+#define ACPI_MADT_LOCAL_APIC        0
+#define ACPI_MADT_CPU_ENABLED       (1 << 0)
+
+struct acpi_madt_local_apic {
+    unsigned char type;
+    unsigned char length;
+    unsigned char acpi_processor_id;
+    unsigned char apic_id;
+    unsigned int flags;
+} __attribute__((packed));
+
+/* Intel MultiProcessor Specification 1.4 */
+struct mp_float {
+    char signature[4];
+    unsigned int config;            /* physical address of the config table, 0: default config */
+    unsigned char length;           /* in 16-byte units */
+    unsigned char revision;
+    unsigned char checksum;
+    unsigned char features[5];
+} __attribute__((packed));
+
+struct mp_config {
+    char signature[4];
+    unsigned short length;          /* base table, header included */
+    unsigned char revision;
+    unsigned char checksum;
+    char oem_id[8];
+    char product_id[12];
+    unsigned int oem_table;
+    unsigned short oem_table_size;
+    unsigned short entry_count;
+    unsigned int lapic_address;
+    unsigned short ext_length;
+    unsigned char ext_checksum;
+    unsigned char reserved;
+} __attribute__((packed));
+
+#define MP_ENTRY_PROCESSOR          0
+#define MP_PROCESSOR_ENTRY_SIZE     20
+#define MP_OTHER_ENTRY_SIZE         8
+#define MP_PROCESSOR_ENABLED        (1 << 0)
+
+/* BIOS data area word holding the EBDA segment */
+#define BDA_EBDA_SEGMENT            0x40E
+
+/* Filled in for each CPU before its start-up IPI, see asm/ap_trampoline.s */
+struct ap_trampoline_params {
+    unsigned int cr3;
+    unsigned int cr4;
+    unsigned int stack;
+    unsigned int entry;
+};
+
+extern const unsigned char ap_trampoline_start[];
+extern const unsigned char ap_trampoline_params[];
+extern const unsigned char ap_trampoline_end[];
+
+static unsigned char smp_stacks[SMP_MAX_CPUS - 1][SMP_AP_STACK_SIZE] __attribute__((aligned(16)));
+
+/* Discovered processors, before any is started */
+static unsigned int smp_apic_ids[SMP_MAX_CPUS];
+static unsigned int smp_found;
+static unsigned int smp_lapic_phys = LAPIC_DEFAULT_BASE;
+
+static unsigned int smp_online = 1;
+static struct cpu *volatile smp_booting;   /* the CPU the trampoline is starting */
+static volatile unsigned int smp_released; /* the identity mapping is gone */
+
+
+static int smp_checksum_ok(const void *table, unsigned int len)
+{
+    const unsigned char *p = table;
+    unsigned char sum = 0;
+
+    for (unsigned int i = 0; i < len; i++) {
+        sum += p[i];
+    }
+    return sum == 0;
+}
+
+
+/* A 16-byte aligned structure in low memory whose first bytes are sig */
+static const void *smp_scan(unsigned int start, unsigned int len, const char *sig,
+                            unsigned int sig_len, unsigned int check_len)
+{
+    for (unsigned int addr = start; addr + check_len <= start + len; addr += 16) {
+        const void *p = phys_to_virt(addr);
+
+        if (memcmp(p, sig, sig_len) == 0 && smp_checksum_ok(p, check_len)) {
+            return p;
+        }
+    }
+    return 0;
+}
+
+
+/* The EBDA, then the BIOS ROM, as both the ACPI and the MP specification ask */
+static const void *smp_scan_bios(const char *sig, unsigned int sig_len, unsigned int check_len)
+{
+    unsigned int ebda = *(unsigned short *)phys_to_virt(BDA_EBDA_SEGMENT) << 4;
+    const void *p = 0;
+
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        p = smp_scan(ebda, 1024, sig, sig_len, check_len);
+    }
+    if (!p) {
+        p = smp_scan(0xE0000, 0x20000, sig, sig_len, check_len);
+    }
+    return p;
+}
+
+
+static void smp_add_cpu(unsigned int apic_id)
+{
+    if (smp_found < SMP_MAX_CPUS) {
+        smp_apic_ids[smp_found] = apic_id;
+    }
+    smp_found++;
+}
+
+
+/* An ACPI table by physical address, mapped in full, or 0 if broken */
+static const struct acpi_sdt_header *smp_map_acpi_table(unsigned int phys)
+{
+    const struct acpi_sdt_header *header = paging_map_mmio(phys, sizeof(*header));
+
+    if (!header || header->length < sizeof(*header)) {
+        return 0;
+    }
+    header = paging_map_mmio(phys, header->length);
+    if (!header || !smp_checksum_ok(header, header->length)) {
+        return 0;
+    }
+    return header;
+}
+
+
+static int smp_parse_madt(void)
+{
+    const struct acpi_rsdp *rsdp = smp_scan_bios(ACPI_RSDP_SIGNATURE, 8, sizeof(*rsdp));
+    const struct acpi_sdt_header *rsdt, *table = 0;
+    const struct acpi_madt *madt;
+    const unsigned char *entry, *end;
+    unsigned int count;
+
+    if (!rsdp || !(rsdt = smp_map_acpi_table(rsdp->rsdt_address))) {
+        return -1;
+    }
+    count = (rsdt->length - sizeof(*rsdt)) / 4;
+    for (unsigned int i = 0; i < count && !table; i++) {
+        const unsigned int *pointers = (const unsigned int *)(rsdt + 1);
+        const struct acpi_sdt_header *t = smp_map_acpi_table(pointers[i]);
+
+        if (t && memcmp(t->signature, ACPI_MADT_SIGNATURE, 4) == 0) {
+            table = t;
+        }
+    }
+    if (!table || table->length < sizeof(*madt)) {
+        return -1;
+    }
+
+    madt = (const struct acpi_madt *)table;
+    smp_lapic_phys = madt->lapic_address;
+    end = (const unsigned char *)madt + madt->header.length;
+    for (entry = (const unsigned char *)(madt + 1); entry + 2 <= end && entry[1] >= 2;
+         entry += entry[1]) {
+        const struct acpi_madt_local_apic *lapic = (const void *)entry;
+
+        if (lapic->type == ACPI_MADT_LOCAL_APIC && lapic->length >= sizeof(*lapic) &&
+            (lapic->flags & ACPI_MADT_CPU_ENABLED)) {
+            smp_add_cpu(lapic->apic_id);
+        }
+    }
+    return 0;
+}
+
+
+static int smp_parse_mp_table(void)
+{
+    const struct mp_float *mpf = smp_scan_bios(MP_FLOAT_SIGNATURE, 4, sizeof(*mpf));
+    const struct mp_config *config;
+    const unsigned char *entry;
+
+    /* The default configurations (no table) predate anything QEMU or Bochs emulate */
+    if (!mpf || !mpf->config) {
+        return -1;
+    }
+    config = paging_map_mmio(mpf->config, sizeof(*config));
+    if (!config || memcmp(config->signature, MP_CONFIG_SIGNATURE, 4) != 0 ||
+        !(config = paging_map_mmio(mpf->config, config->length)) ||
+        !smp_checksum_ok(config, config->length)) {
+        return -1;
+    }
+
+    smp_lapic_phys = config->lapic_address;
+    entry = (const unsigned char *)(config + 1);
+    for (unsigned int i = 0; i < config->entry_count; i++) {
+        if (entry[0] != MP_ENTRY_PROCESSOR) {
+            entry += MP_OTHER_ENTRY_SIZE;
+            continue;
+        }
+        if (entry[3] & MP_PROCESSOR_ENABLED) {
+            smp_add_cpu(entry[1]);
+        }
+        entry += MP_PROCESSOR_ENTRY_SIZE;
+    }
+    return 0;
+}
+
+
+/* At least ticks whole PIT periods */
+static void smp_delay(unsigned int ticks)
+{
+    unsigned int start = pit_ticks();
+
+    while (pit_ticks() - start <= ticks) {
+        __asm__ volatile("hlt");
+    }
+}
+
+
+/* Application processors wait here for smp_call work, with interrupts off */
+static void smp_ap_loop(struct cpu *cpu)
+{
+    for (;;) {
+        smp_fn_t fn = cpu->work_fn;
+
+        if (!fn) {
+            __asm__ volatile("pause" : : : "memory");
+            continue;
+        }
+        fn(cpu->work_arg);
+        cpu->work_fn = 0;
+    }
+}
+
+
+/* Where asm/ap_trampoline.s jumps, on the CPU's own stack with paging on */
+static void smp_ap_entry(void)
+{
+    struct cpu *cpu = smp_booting;
+
+    gdt_init_cpu(cpu);
+    idt_load();
+    cpu_enable_sse();
+    cpu->online = 1;
+
+    /* Drop the identity mapping from this CPU's TLB once it is gone */
+    while (!smp_released) {
+        __asm__ volatile("pause" : : : "memory");
+    }
+    write_cr3(read_cr3());
+    smp_ap_loop(cpu);
+}
+
+
+static int smp_start_cpu(struct cpu *cpu)
+{
+    struct ap_trampoline_params *params = phys_to_virt(AP_TRAMPOLINE_ADDR +
+                                          (ap_trampoline_params - ap_trampoline_start));
+
+    params->cr3 = read_cr3();
+    params->cr4 = read_cr4();
+    params->stack = (unsigned int)cpu->stack_top;
+    params->entry = (unsigned int)smp_ap_entry;
+    smp_booting = cpu;
+
+    /* Intel's sequence: INIT, 10 ms, SIPI, 200 us, a second SIPI if needed */
+    lapic_send_init(cpu->apic_id);
+    smp_delay(10);
+    lapic_send_startup(cpu->apic_id, AP_TRAMPOLINE_ADDR >> 12);
+    smp_delay(1);
+    if (!cpu->online) {
+        lapic_send_startup(cpu->apic_id, AP_TRAMPOLINE_ADDR >> 12);
+        for (unsigned int i = 0; i < 100 && !cpu->online; i++) {
+            smp_delay(1);
+        }
+    }
+    return cpu->online ? 0 : -1;
+}
+
+
+unsigned int __init smp_init(void)
+{
+    unsigned int bsp;
+
+    cpus[0].online = 1;
+    if (smp_parse_madt() < 0 && smp_parse_mp_table() < 0) {
+        log_info("smp: no ACPI MADT or MP table, 1 CPU");
+        return smp_online;
+    }
+    if (smp_found > SMP_MAX_CPUS) {
+        log_warning("smp: %u CPUs found, using %u", smp_found, SMP_MAX_CPUS);
+        smp_found = SMP_MAX_CPUS;
+    }
+    if (smp_found < 2 || lapic_init(smp_lapic_phys) < 0) {
+        return smp_online;
+    }
+
+    bsp = lapic_id();
+    cpus[0].apic_id = bsp;
+    cpus[0].online = 1;
+
+    memcpy(phys_to_virt(AP_TRAMPOLINE_ADDR), ap_trampoline_start,
+           ap_trampoline_end - ap_trampoline_start);
+    paging_identity_map_low(1);
+
+    for (unsigned int i = 0; i < smp_found; i++) {
+        struct cpu *cpu = &cpus[smp_online];
+
+        if (smp_apic_ids[i] == bsp) {
+            continue;
+        }
+        cpu->id = smp_online;
+        cpu->apic_id = smp_apic_ids[i];
+        cpu->stack_top = smp_stacks[smp_online - 1] + SMP_AP_STACK_SIZE;
+        if (smp_start_cpu(cpu) < 0) {
+            /* Park it again, so a late start cannot pick up the next CPU's parameters */
+            lapic_send_init(cpu->apic_id);
+            log_warning("smp: CPU with APIC ID %u did not start", cpu->apic_id);
+            continue;
+        }
+        smp_online++;
+    }
+
+    paging_identity_map_low(0);
+    smp_released = 1;
+    log_info("smp: %u of %u CPUs online", smp_online, smp_found);
+    return smp_online;
+}
+
+
+unsigned int smp_num_cpus(void)
+{
+    return smp_online;
+}
+
+
+int smp_call(unsigned int cpu, smp_fn_t fn, void *arg)
+{
+    if (cpu == 0 || cpu >= smp_online || cpus[cpu].work_fn) {
+        return -1;
+    }
+    cpus[cpu].work_arg = arg;
+    /* x86 keeps stores in order, so the CPU sees arg before fn */
+    __asm__ volatile("" : : : "memory");
+    cpus[cpu].work_fn = fn;
+    return 0;
+}
+
+
+void smp_wait(unsigned int cpu)
+{
+    if (cpu >= smp_online) {
+        return;
+    }
+    while (cpus[cpu].work_fn) {
+        sched_yield();
+        __asm__ volatile("pause");
+    }
+}
@@ -1,72 +1,411 @@
 #include "stdio.h"
+#include "string.h"
+#include "paging.h"
+#include "fbcon.h"
+#include "cpu.h"
 
-volatile unsigned char *framebuffer = (unsigned char *) 0x000B8000;
-static unsigned short cursor_pos = 0;
+volatile unsigned char *framebuffer = phys_to_virt(0x000B8000);
+
+/*
+ * The whole 32 KiB of text memory holds FB_TEXT_ROWS rows, split into
+ * FB_CONSOLES pages of FB_CONSOLE_ROWS rows, one per virtual console. Every
+ * console is always up to date in text memory, so showing another one is
+ * only a new CRTC start address.
+ *
+ * Within its page, a console's live screen is the FB_ROWS rows starting at
+ * top_row; scrolling only increments top_row and points the CRTC start
+ * address at it, so a new line costs one blank row instead of moving the
+ * screen. Rows above top_row are the scrollback. When the live screen
+ * reaches the end of the page, the newest rows are moved back to the start
+ * of the page in one bulk copy (see fb_scroll). Rows are page-relative.
+ */
+struct fb_console {
+    unsigned int top_row;       /* first row of the live screen */
+    unsigned int view_row;      /* first row on the monitor (< top_row while scrolled back) */
+    unsigned short cursor_pos;  /* byte offset (cell * 2) from the top-left of the live screen */
+    unsigned char attr;         /* colour of what putchar and puts write */
+    unsigned char ready;        /* page blanked since boot */
+};
+
+static struct fb_console fb_consoles[FB_CONSOLES] = {
+    [0 ... FB_CONSOLES - 1] = { .attr = FB_TEXT_COLOR },
+};
+static struct fb_console *fb_out = &fb_consoles[0];     /* where output goes */
+static struct fb_console *fb_shown = &fb_consoles[0];   /* on the monitor */
+
+/*
+ * RAM copy of text memory, one 16-bit cell (character | attribute << 8)
+ * per position. Output goes to these cached cells and fb_flush() copies the
+ * rows that changed to the framebuffer with 32-bit stores. For every dirty
+ * row the touched columns are kept as [fb_dirty_lo, fb_dirty_hi], so a
+ * single character does not cost a whole row.
+ */
+#define FB_DIRTY_WORDS ((FB_TEXT_ROWS + 31) / 32)
+
+static unsigned short fb_shadow[FB_TEXT_ROWS * FB_COLUMNS];
+static unsigned int   fb_dirty_rows[FB_DIRTY_WORDS];    /* bit n: row n needs flushing */
+static unsigned char  fb_dirty_lo[FB_TEXT_ROWS];
+static unsigned char  fb_dirty_hi[FB_TEXT_ROWS];
+
+/*
+ * Guards everything above and below: the consoles, the shadow buffer and
+ * its dirty rows, the CRTC state and (through fb_flush) fbcon's glyph
+ * cache. klogd writes to its console while any thread may be in putchar,
+ * either one preempting the other. Every public function takes it with
+ * interrupts off; the static helpers expect it held.
+ */
+static struct spinlock fb_lock = SPINLOCK_INIT;
+
+/* CRTC state last programmed, in cells; 0xFFFF forces the first write */
+static unsigned short fb_hw_cursor = 0xFFFF;
+static unsigned short fb_hw_start = 0xFFFF;
+
+/* Two cells read or written as one 32-bit word */
+typedef unsigned int __attribute__((may_alias)) fb_cell_pair;
+
+#define FB_BLANK_CELL (FB_EMPTY_CELL | (FB_DEFAULT_COLOR << 8))
+
+/* First row of a console's page in text memory */
+static unsigned int fb_page_row(const struct fb_console *con)
+{
+    return (con - fb_consoles) * FB_CONSOLE_ROWS;
+}
+
+
+static void fb_mark_dirty_span(unsigned int row, unsigned int lo, unsigned int hi)
+{
+    unsigned int *word = &fb_dirty_rows[row / 32];
+    unsigned int bit = 1u << (row % 32);
+
+    if (!(*word & bit)) {
+        *word |= bit;
+        fb_dirty_lo[row] = lo;
+        fb_dirty_hi[row] = hi;
+        return;
+    }
+    if (lo < fb_dirty_lo[row]) fb_dirty_lo[row] = lo;
+    if (hi > fb_dirty_hi[row]) fb_dirty_hi[row] = hi;
+}
+
+static void fb_clear_row(unsigned int row)
+{
+    unsigned short *cell = &fb_shadow[row * FB_COLUMNS];
+
+    for (unsigned int col = 0; col < FB_COLUMNS; col++) {
+        cell[col] = FB_BLANK_CELL;
+    }
+    fb_mark_dirty_span(row, 0, FB_COLUMNS - 1);
+}
+
+/* Blanks a console's screen and starts it over at the top of its page */
+static void fb_reset(struct fb_console *con)
+{
+    unsigned int page = fb_page_row(con);
+
+    /* Rows below the screen are blanked as they scroll in */
+    con->top_row = 0;
+    con->view_row = 0;
+    con->cursor_pos = 0;
+    con->ready = 1;
+    for (unsigned int row = 0; row < FB_ROWS; row++) {
+        fb_clear_row(page + row);
+    }
+}
+
+/** fb_scroll:
+ *  Scrolls a console's live screen up by one row and blanks the new bottom
+ *  row. Takes effect on the next fb_flush, which moves the CRTC start
+ *  address if the console is shown.
+ */
+static void fb_scroll(struct fb_console *con)
+{
+    unsigned int page = fb_page_row(con);
+
+    if (con->top_row + FB_ROWS == FB_CONSOLE_ROWS) {
+        /*
+         * Out of rows: keep the screen minus its top row (which is about
+         * to scroll off) and FB_SCROLLBACK_KEEP_ROWS of history, and
+         * restart from the top of the page. The rest of the page is
+         * blanked lazily as the screen scrolls into it again.
+         */
+        unsigned int keep = FB_SCROLLBACK_KEEP_ROWS + FB_ROWS - 1;
+        unsigned int first = FB_CONSOLE_ROWS - keep;
+
+        memmove(&fb_shadow[page * FB_COLUMNS], &fb_shadow[(page + first) * FB_COLUMNS],
+                keep * FB_COLUMNS * sizeof(fb_shadow[0]));
+        for (unsigned int row = 0; row < keep; row++) {
+            fb_mark_dirty_span(page + row, 0, FB_COLUMNS - 1);
+        }
+        con->top_row = FB_SCROLLBACK_KEEP_ROWS;
+    } else {
+        con->top_row++;
+    }
+    fb_clear_row(page + con->top_row + FB_ROWS - 1);
+}
+
+/* Writes a cell of a console's live screen, by cell index */
+static void fb_put_cell(struct fb_console *con, unsigned int cell, char c, unsigned char attr)
+{
+    unsigned int row;
+
+    if (cell >= FB_ROWS * FB_COLUMNS) {
+        return;
+    }
+    row = fb_page_row(con) + con->top_row + cell / FB_COLUMNS;
+    fb_shadow[row * FB_COLUMNS + cell % FB_COLUMNS] = (unsigned char)c | (attr << 8);
+    fb_mark_dirty_span(row, cell % FB_COLUMNS, cell % FB_COLUMNS);
+}
 
 void fb_write_cell(unsigned int i, char c, unsigned char fg, unsigned char bg)
 {
-    framebuffer[i] = c;
-    framebuffer[i + 1] = ((fg & 0x0F) << 4) | (bg & 0x0F);
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+
+    fb_put_cell(fb_out, i / 2, c, ((fg & 0x0F) << 4) | (bg & 0x0F));
+    spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+/*
+ * The CRTC index and data ports are adjacent, so a single outw writes the
+ * register number to FB_COMMAND_PORT and the value to FB_DATA_PORT.
+ */
+static void fb_set_crtc(unsigned char high_command, unsigned char low_command,
+                        unsigned short value)
+{
+    outw(FB_COMMAND_PORT, (value & 0xFF00) | high_command);
+    outw(FB_COMMAND_PORT, ((value & 0x00FF) << 8) | low_command);
+}
+
+/* Text memory cell of the shown console's cursor */
+static unsigned short fb_cursor_cell(void)
+{
+    return (fb_page_row(fb_shown) + fb_shown->top_row) * FB_COLUMNS + fb_shown->cursor_pos / 2;
+}
+
+/* Puts the hardware (or fbcon) cursor where the shown console's cursor is */
+static void fb_show_cursor(void)
+{
+    unsigned short cell = fb_cursor_cell();
+
+    if (fbcon_active()) {
+        /* Hidden (row out of range) while the view is scrolled away from it */
+        fbcon_set_cursor(cell % FB_COLUMNS,
+                         cell / FB_COLUMNS - (fb_page_row(fb_shown) + fb_shown->view_row));
+    } else {
+        fb_set_crtc(FB_HIGH_BYTE_COMMAND, FB_LOW_BYTE_COMMAND, cell);
+    }
+    fb_hw_cursor = cell;
+}
+
+static void fb_move_cursor_locked(unsigned short pos)
+{
+    fb_out->cursor_pos = pos * 2;
+    if (fb_out == fb_shown) {
+        fb_show_cursor();
+    }
 }
 
 void fb_move_cursor(unsigned short pos)
 {
-    outb(FB_COMMAND_PORT, FB_HIGH_BYTE_COMMAND);
-    outb(FB_DATA_PORT,    ((pos >> 8) & 0x00FF));
-    outb(FB_COMMAND_PORT, FB_LOW_BYTE_COMMAND);
-    outb(FB_DATA_PORT,    pos & 0x00FF);
-    cursor_pos = pos * 2;
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+
+    fb_move_cursor_locked(pos);
+    spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+/** fb_flush_fbcon:
+ *  fb_flush for the framebuffer console: draws the dirty cells that are
+ *  in view, or every cell in view when the view moved. fbcon skips the
+ *  cells it already shows, so a scroll costs only the cells that differ.
+ */
+static void fb_flush_fbcon(void)
+{
+    unsigned int view = fb_page_row(fb_shown) + fb_shown->view_row;
+    unsigned short start = view * FB_COLUMNS;
+
+    if (start != fb_hw_start) {
+        for (unsigned int row = 0; row < FB_ROWS; row++) {
+            for (unsigned int col = 0; col < FB_COLUMNS; col++) {
+                fbcon_draw_cell(col, row, fb_shadow[start + row * FB_COLUMNS + col]);
+            }
+        }
+        fb_hw_start = start;
+        for (unsigned int w = 0; w < FB_DIRTY_WORDS; w++) {
+            fb_dirty_rows[w] = 0;
+        }
+    }
+
+    for (unsigned int w = 0; w < FB_DIRTY_WORDS; w++) {
+        while (fb_dirty_rows[w]) {
+            unsigned int row = w * 32 + __builtin_ctz(fb_dirty_rows[w]);
+
+            if (row >= view && row < view + FB_ROWS) {
+                for (unsigned int col = fb_dirty_lo[row]; col <= fb_dirty_hi[row]; col++) {
+                    fbcon_draw_cell(col, row - view, fb_shadow[row * FB_COLUMNS + col]);
+                }
+            }
+            fb_dirty_rows[w] &= fb_dirty_rows[w] - 1;
+        }
+    }
+
+    fb_show_cursor();
+}
+
+static void fb_flush_locked(void)
+{
+    volatile fb_cell_pair *fb = (volatile fb_cell_pair *)framebuffer;
+    const fb_cell_pair *shadow = (const fb_cell_pair *)fb_shadow;
+    unsigned short start;
+
+    if (fbcon_active()) {
+        fb_flush_fbcon();
+        return;
+    }
+
+    for (unsigned int w = 0; w < FB_DIRTY_WORDS; w++) {
+        while (fb_dirty_rows[w]) {
+            unsigned int row = w * 32 + __builtin_ctz(fb_dirty_rows[w]);
+            unsigned int pair = (row * FB_COLUMNS + fb_dirty_lo[row]) / 2;
+            unsigned int end  = (row * FB_COLUMNS + fb_dirty_hi[row]) / 2;
+
+            for (; pair <= end; pair++) {
+                fb[pair] = shadow[pair];
+            }
+            fb_dirty_rows[w] &= fb_dirty_rows[w] - 1;
+        }
+    }
+
+    /* Every console is current in text memory; the CRTC picks which one is shown */
+    start = (fb_page_row(fb_shown) + fb_shown->view_row) * FB_COLUMNS;
+    if (start != fb_hw_start) {
+        fb_set_crtc(FB_START_ADDRESS_HIGH_COMMAND, FB_START_ADDRESS_LOW_COMMAND, start);
+        fb_hw_start = start;
+    }
+    if (fb_cursor_cell() != fb_hw_cursor) {
+        fb_show_cursor();
+    }
+}
+
+void fb_flush(void)
+{
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+
+    fb_flush_locked();
+    spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+/** fb_newline / fb_advance:
+ *  Move a console's cursor to the next line, or one cell on, scrolling
+ *  when it leaves the screen. Shadow buffer only; callers flush.
+ */
+static void fb_newline(struct fb_console *con)
+{
+    con->cursor_pos += (FB_COLUMNS - (con->cursor_pos / 2) % FB_COLUMNS) * 2;
+    if (con->cursor_pos >= FB_ROWS * FB_COLUMNS * 2) {
+        fb_scroll(con);
+        con->cursor_pos -= FB_COLUMNS * 2;
+    }
+}
+
+static void fb_advance(struct fb_console *con)
+{
+    con->cursor_pos += 2;
+    if (con->cursor_pos >= FB_ROWS * FB_COLUMNS * 2) {
+        fb_scroll(con);
+        con->cursor_pos -= FB_COLUMNS * 2;
+    }
 }
 
 void cursor_move_home(void)
 {
-    cursor_pos = 0;
     fb_move_cursor(0);
 }
 
 void cursor_move_newline(void)
 {
-    cursor_pos += (FB_COLUMNS - (cursor_pos / 2) % FB_COLUMNS) * 2;
-    fb_move_cursor(cursor_pos / 2);
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+
+    fb_newline(fb_out);
+    fb_flush_locked();
+    spin_unlock_irqrestore(&fb_lock, flags);
 }
 
 void cursor_move_back(void)
 {
-    if (cursor_pos >= 2) {
-        cursor_pos -= 2;
-        fb_move_cursor(cursor_pos / 2);
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+
+    if (fb_out->cursor_pos >= 2) {
+        fb_move_cursor_locked(fb_out->cursor_pos / 2 - 1);
     }
+    spin_unlock_irqrestore(&fb_lock, flags);
 }
 
 void cursor_move_forward(void)
 {
-    cursor_pos += 2;
-    fb_move_cursor(cursor_pos / 2);
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+
+    fb_advance(fb_out);
+    fb_flush_locked();
+    spin_unlock_irqrestore(&fb_lock, flags);
 }
 
-int putchar(char c)
+/** fb_putc:
+ *  Puts a character at a console's cursor and advances it, touching only
+ *  the shadow buffer. Callers flush once when they are done.
+ */
+static void fb_putc(struct fb_console *con, char c)
 {
     if (c == '\n') {
-        cursor_move_newline();
+        fb_newline(con);
     } else {
-        fb_write_cell(cursor_pos, c, COLOR_BLACK, COLOR_WHITE);
-        cursor_move_forward();
+        fb_put_cell(con, con->cursor_pos / 2, c, con->attr);
+        fb_advance(con);
     }
-    return 0;
 }
 
-int puts(char *buf)
+/** fb_puts_on / fb_putchar_on:
+ *  puts and putchar on the given console, fb_lock held. Everything below
+ *  takes the console as an argument, so writing to another console never
+ *  touches fb_out, which a preempting thread may be using meanwhile.
+ */
+static void fb_puts_on(struct fb_console *con, const char *buf)
 {
     while (*buf != '\0') {
-        putchar(*buf);
+        fb_putc(con, *buf);
         buf++;
     }
+    con->view_row = con->top_row;
+    fb_flush_locked();
+}
+
+static void fb_putchar_on(struct fb_console *con, char c)
+{
+    fb_putc(con, c);
+    con->view_row = con->top_row;
+    fb_flush_locked();
+}
+
+int putchar(char c)
+{
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+
+    fb_putchar_on(fb_out, c);
+    spin_unlock_irqrestore(&fb_lock, flags);
+    return 0;
+}
+
+int puts(char *buf)
+{
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+
+    fb_puts_on(fb_out, buf);
+    spin_unlock_irqrestore(&fb_lock, flags);
     return 0;
 }
 
 int putchar_at(char c, unsigned short pos)
 {
     fb_write_cell(pos, c, COLOR_BLACK, COLOR_WHITE);
+    fb_flush();
     return 0;
 }
 
@@ -74,27 +413,144 @@ int puts_at(char *buf)
 {
     unsigned int i = 0;
     while (*buf != '\0') {
-        putchar_at(*buf, i * 2);
+        fb_write_cell(i * 2, *buf, COLOR_BLACK, COLOR_WHITE);
         buf++;
         i++;
     }
+    fb_flush();
     return 0;
 }
 
 int write(char *buf, unsigned int len)
 {
     for (unsigned int i = 0; i < len; i++) {
-        putchar_at(buf[i], i * 2);
+        fb_write_cell(i * 2, buf[i], COLOR_BLACK, COLOR_WHITE);
     }
+    fb_flush();
     return len;
 }
 
+void fb_scroll_view(int rows)
+{
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+    int row = (int)fb_shown->view_row + rows;
+
+    if (row < 0) {
+        row = 0;
+    }
+    if (row > (int)fb_shown->top_row) {
+        row = fb_shown->top_row;
+    }
+    fb_shown->view_row = row;
+    fb_flush_locked();
+    spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+void fb_scroll_view_reset(void)
+{
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+
+    fb_shown->view_row = fb_shown->top_row;
+    fb_flush_locked();
+    spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+void fb_redraw(void)
+{
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+    unsigned int view = fb_page_row(fb_shown) + fb_shown->view_row;
+
+    for (unsigned int row = view; row < view + FB_ROWS; row++) {
+        fb_mark_dirty_span(row, 0, FB_COLUMNS - 1);
+    }
+    /* Reprogram the CRTC too; in fbcon mode this redraws the whole view */
+    fb_hw_start = 0xFFFF;
+    fb_hw_cursor = 0xFFFF;
+    fb_flush_locked();
+    spin_unlock_irqrestore(&fb_lock, flags);
+}
+
 void fb_clear(void)
 {
-    for (unsigned int i = 0; i < FB_COLUMNS * FB_ROWS * 2; i += 2) {
-        framebuffer[i] = FB_EMPTY_CELL;
-        framebuffer[i + 1] = FB_DEFAULT_COLOR;
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+
+    fb_reset(fb_out);
+    fb_flush_locked();
+    fb_move_cursor_locked(0);
+    spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+/* The console, reset on first use, or 0 for a bad number; fb_lock held */
+static struct fb_console *fb_console_get(unsigned int n)
+{
+    struct fb_console *con;
+
+    if (n >= FB_CONSOLES) {
+        return 0;
+    }
+    con = &fb_consoles[n];
+    if (!con->ready) {
+        fb_reset(con);
+    }
+    return con;
+}
+
+unsigned int fb_console_select(unsigned int n)
+{
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+    unsigned int old = fb_out - fb_consoles;
+
+    if (n < FB_CONSOLES) {
+        fb_out = fb_console_get(n);
     }
-    cursor_move_home();
+    spin_unlock_irqrestore(&fb_lock, flags);
+    return old;
 }
 
+void fb_console_show(unsigned int n)
+{
+    unsigned int flags;
+
+    if (n >= FB_CONSOLES) {
+        return;
+    }
+    flags = spin_lock_irqsave(&fb_lock);
+    fb_shown = fb_console_get(n);
+    /* Text mode: one CRTC start address write. fbcon: the cells that differ */
+    fb_flush_locked();
+    spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+unsigned int fb_console_shown(void)
+{
+    return fb_shown - fb_consoles;
+}
+
+void fb_console_set_color(unsigned char fg, unsigned char bg)
+{
+    fb_out->attr = ((bg & 0x0F) << 4) | (fg & 0x0F);
+}
+
+int fb_console_puts(unsigned int n, char *buf)
+{
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+    struct fb_console *con = fb_console_get(n);
+
+    if (con) {
+        fb_puts_on(con, buf);
+    }
+    spin_unlock_irqrestore(&fb_lock, flags);
+    return 0;
+}
+
+int fb_console_putchar(unsigned int n, char c)
+{
+    unsigned int flags = spin_lock_irqsave(&fb_lock);
+    struct fb_console *con = fb_console_get(n);
+
+    if (con) {
+        fb_putchar_on(con, c);
+    }
+    spin_unlock_irqrestore(&fb_lock, flags);
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "string.h"
+#include "cpu.h"
 
 unsigned int strlen(const char *str)
 {
@@ -77,7 +78,14 @@ int strncmp(const char *str1, const char *str2, unsigned int n)
     return *(unsigned char *)str1 - *(unsigned char *)str2;
 }
 
-void *memset(void *dest, int val, unsigned int n)
+/* Machine word used by the word-wide loops; may_alias lets it read any buffer */
+typedef unsigned long __attribute__((may_alias)) mem_word_t;
+
+/* Below this size the setup cost of rep/SSE outweighs the byte loop */
+#define MEM_SMALL_SIZE  16
+
+
+static void *memset_byte(void *dest, int val, unsigned int n)
 {
     unsigned char *ptr = (unsigned char *)dest;
     while (n-- > 0) {
@@ -86,7 +94,7 @@ void *memset(void *dest, int val, unsigned int n)
     return dest;
 }
 
-void *memcpy(void *dest, const void *src, unsigned int n)
+static void *memcpy_byte(void *dest, const void *src, unsigned int n)
 {
     unsigned char *d = (unsigned char *)dest;
     const unsigned char *s = (const unsigned char *)src;
@@ -96,10 +104,270 @@ void *memcpy(void *dest, const void *src, unsigned int n)
     return dest;
 }
 
+
+/* rep movsd / rep stosd: align dest to 4 bytes, move dwords, finish the tail */
+static void *memset_rep(void *dest, int val, unsigned int n)
+{
+    void *d = dest;
+    unsigned int pattern = (unsigned char)val * 0x01010101u;
+    unsigned long head = (-(unsigned long)dest) & 3;
+    unsigned long words = (n - head) >> 2;
+    unsigned long tail = (n - head) & 3;
+
+    __asm__ volatile("rep stosb" : "+D"(d), "+c"(head) : "a"(pattern) : "memory");
+    __asm__ volatile("rep stosl" : "+D"(d), "+c"(words) : "a"(pattern) : "memory");
+    __asm__ volatile("rep stosb" : "+D"(d), "+c"(tail) : "a"(pattern) : "memory");
+    return dest;
+}
+
+static void *memcpy_rep(void *dest, const void *src, unsigned int n)
+{
+    void *d = dest;
+    unsigned long head = (-(unsigned long)dest) & 3;
+    unsigned long words = (n - head) >> 2;
+    unsigned long tail = (n - head) & 3;
+
+    __asm__ volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(head) : : "memory");
+    __asm__ volatile("rep movsl" : "+D"(d), "+S"(src), "+c"(words) : : "memory");
+    __asm__ volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(tail) : : "memory");
+    return dest;
+}
+
+
+/* ERMS: the microcode picks the widest moves itself, so a single rep movsb wins */
+static void *memset_erms(void *dest, int val, unsigned int n)
+{
+    void *d = dest;
+    unsigned long count = n;
+
+    __asm__ volatile("rep stosb" : "+D"(d), "+c"(count) : "a"(val) : "memory");
+    return dest;
+}
+
+static void *memcpy_erms(void *dest, const void *src, unsigned int n)
+{
+    void *d = dest;
+    unsigned long count = n;
+
+    __asm__ volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(count) : : "memory");
+    return dest;
+}
+
+
+/*
+ * SSE2: align dest to 16 bytes, then move 64 bytes per iteration with
+ * unaligned loads and aligned stores. Only selected once SSE is enabled.
+ * Callers guarantee n >= MEM_SMALL_SIZE, so the head always fits.
+ *
+ * Interrupt entry does not save xmm registers, so while mem_simd_disabled
+ * is set (inside handlers) these use the rep versions instead.
+ */
+volatile unsigned int mem_simd_disabled;
+
+__attribute__((target("sse2")))
+static void *memset_sse2(void *dest, int val, unsigned int n)
+{
+    unsigned char *d = (unsigned char *)dest;
+    unsigned int pattern = (unsigned char)val * 0x01010101u;
+    unsigned int head = (-(unsigned long)d) & 15;
+    unsigned long blocks;
+
+    if (mem_simd_disabled) {
+        return memset_rep(dest, val, n);
+    }
+    memset_byte(d, val, head);
+    d += head;
+    n -= head;
+
+    blocks = n >> 6;
+    if (blocks) {
+        __asm__ volatile(
+            "movd %2, %%xmm0\n\t"
+            "pshufd $0, %%xmm0, %%xmm0\n\t"
+            "1:\n\t"
+            "movdqa %%xmm0,   (%0)\n\t"
+            "movdqa %%xmm0, 16(%0)\n\t"
+            "movdqa %%xmm0, 32(%0)\n\t"
+            "movdqa %%xmm0, 48(%0)\n\t"
+            "add $64, %0\n\t"
+            "dec %1\n\t"
+            "jnz 1b"
+            : "+r"(d), "+r"(blocks)
+            : "r"(pattern)
+            : "memory", "cc", "xmm0");
+    }
+
+    memset_byte(d, val, n & 63);
+    return dest;
+}
+
+__attribute__((target("sse2")))
+static void *memcpy_sse2(void *dest, const void *src, unsigned int n)
+{
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+    unsigned int head = (-(unsigned long)d) & 15;
+    unsigned long blocks;
+
+    if (mem_simd_disabled) {
+        return memcpy_rep(dest, src, n);
+    }
+    memcpy_byte(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    blocks = n >> 6;
+    if (blocks) {
+        __asm__ volatile(
+            "1:\n\t"
+            "movdqu   (%1), %%xmm0\n\t"
+            "movdqu 16(%1), %%xmm1\n\t"
+            "movdqu 32(%1), %%xmm2\n\t"
+            "movdqu 48(%1), %%xmm3\n\t"
+            "movdqa %%xmm0,   (%0)\n\t"
+            "movdqa %%xmm1, 16(%0)\n\t"
+            "movdqa %%xmm2, 32(%0)\n\t"
+            "movdqa %%xmm3, 48(%0)\n\t"
+            "add $64, %1\n\t"
+            "add $64, %0\n\t"
+            "dec %2\n\t"
+            "jnz 1b"
+            : "+r"(d), "+r"(s), "+r"(blocks)
+            :
+            : "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3");
+    }
+
+    memcpy_byte(d, s, n & 63);
+    return dest;
+}
+
+
+/* One entry per MEM_IMPL_* value */
+struct mem_ops {
+    void *(*copy)(void *dest, const void *src, unsigned int n);
+    void *(*set)(void *dest, int val, unsigned int n);
+};
+
+static const struct mem_ops mem_impls[] = {
+    [MEM_IMPL_BYTE] = { memcpy_byte, memset_byte },
+    [MEM_IMPL_REP]  = { memcpy_rep,  memset_rep  },
+    [MEM_IMPL_ERMS] = { memcpy_erms, memset_erms },
+    [MEM_IMPL_SSE2] = { memcpy_sse2, memset_sse2 },
+};
+
+/* Byte loops until mem_init() runs, so early boot code is always safe */
+static int mem_impl = MEM_IMPL_BYTE;
+static const struct mem_ops *mem_ops = &mem_impls[MEM_IMPL_BYTE];
+
+
+int mem_set_impl(int impl)
+{
+    int prev = mem_impl;
+
+    if (impl < MEM_IMPL_BYTE || impl > MEM_IMPL_SSE2) {
+        return -1;
+    }
+    if (impl == MEM_IMPL_SSE2 && !cpu_sse_enabled()) {
+        return -1;
+    }
+    mem_impl = impl;
+    mem_ops = &mem_impls[impl];
+    return prev;
+}
+
+
+int mem_get_impl(void)
+{
+    return mem_impl;
+}
+
+
+void mem_init(void)
+{
+    unsigned int max_leaf, a, b, c, d;
+    int impl = MEM_IMPL_REP;    /* rep movsd/stosd exist on every x86 */
+
+    if (cpu_has_cpuid()) {
+        cpuid(0, 0, &max_leaf, &b, &c, &d);
+
+        cpuid(1, 0, &a, &b, &c, &d);
+        if ((d & CPUID_1_EDX_SSE2) && cpu_sse_enabled()) {
+            impl = MEM_IMPL_SSE2;
+        }
+
+        if (max_leaf >= 7) {
+            cpuid(7, 0, &a, &b, &c, &d);
+            if (b & CPUID_7_EBX_ERMS) {
+                impl = MEM_IMPL_ERMS;
+            }
+        }
+    }
+
+    mem_set_impl(impl);
+}
+
+
+void *memset(void *dest, int val, unsigned int n)
+{
+    if (n < MEM_SMALL_SIZE) {
+        return memset_byte(dest, val, n);
+    }
+    return mem_ops->set(dest, val, n);
+}
+
+void *memcpy(void *dest, const void *src, unsigned int n)
+{
+    if (n < MEM_SMALL_SIZE) {
+        return memcpy_byte(dest, src, n);
+    }
+    return mem_ops->copy(dest, src, n);
+}
+
+void *memmove(void *dest, const void *src, unsigned int n)
+{
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+
+    /*
+     * Every memcpy variant copies front to back and reads each chunk before
+     * storing it, so it is safe whenever dest does not start inside src.
+     */
+    if (d <= s || d >= s + n) {
+        return memcpy(dest, src, n);
+    }
+
+    /* dest overlaps the end of src: copy back to front, a word at a time */
+    d += n;
+    s += n;
+    while (n > 0 && ((unsigned long)d & (sizeof(mem_word_t) - 1))) {
+        *--d = *--s;
+        n--;
+    }
+    while (n >= sizeof(mem_word_t)) {
+        d -= sizeof(mem_word_t);
+        s -= sizeof(mem_word_t);
+        *(mem_word_t *)d = *(const mem_word_t *)s;
+        n -= sizeof(mem_word_t);
+    }
+    while (n-- > 0) {
+        *--d = *--s;
+    }
+    return dest;
+}
+
 int memcmp(const void *ptr1, const void *ptr2, unsigned int n)
 {
     const unsigned char *p1 = (const unsigned char *)ptr1;
     const unsigned char *p2 = (const unsigned char *)ptr2;
+
+    /* Skip equal words, then let the byte loop locate the first difference */
+    while (n >= sizeof(mem_word_t) &&
+           *(const mem_word_t *)p1 == *(const mem_word_t *)p2) {
+        p1 += sizeof(mem_word_t);
+        p2 += sizeof(mem_word_t);
+        n -= sizeof(mem_word_t);
+    }
     while (n-- > 0) {
         if (*p1 != *p2) {
             return *p1 - *p2;
@@ -164,75 +432,312 @@ char *itoa(int value, char *str, int base)
     return rc;
 }
 
-/* va_list support using GCC built-ins */
-typedef __builtin_va_list va_list;
-#define va_start(ap, last) __builtin_va_start(ap, last)
-#define va_arg(ap, type) __builtin_va_arg(ap, type)
-#define va_end(ap) __builtin_va_end(ap)
+const char *fmt_parse(const char *f, struct fmt_spec *spec)
+{
+    spec->flags = 0;
+    spec->is_long_long = 0;
+    spec->width = 0;
+    spec->precision = FMT_NONE;
 
-/* sprintf: Implementation supporting %s, %d, %x, and %c */
-int sprintf(char *str, const char *format, ...)
+    for (;; f++) {
+        if (*f == '-')      spec->flags |= FMT_LEFT;
+        else if (*f == '0') spec->flags |= FMT_ZERO;
+        else if (*f == '+') spec->flags |= FMT_PLUS;
+        else if (*f == ' ') spec->flags |= FMT_SPACE;
+        else break;
+    }
+
+    if (*f == '*') {
+        spec->width = FMT_STAR;
+        f++;
+    } else {
+        while (*f >= '0' && *f <= '9') {
+            spec->width = spec->width * 10 + (*f++ - '0');
+        }
+    }
+
+    if (*f == '.') {
+        f++;
+        if (*f == '*') {
+            spec->precision = FMT_STAR;
+            f++;
+        } else {
+            spec->precision = 0;
+            while (*f >= '0' && *f <= '9') {
+                spec->precision = spec->precision * 10 + (*f++ - '0');
+            }
+        }
+    }
+
+    /* int, long and size_t are all 32 bits wide here; only ll differs */
+    while (*f == 'h' || *f == 'l' || *f == 'z') {
+        if (f[0] == 'l' && f[1] == 'l') {
+            spec->is_long_long = 1;
+            f++;
+        }
+        f++;
+    }
+
+    spec->conv = *f;
+    return *f ? f + 1 : f;
+}
+
+
+/** fmt_divmod:
+ *  Divides *n by base in place and returns the remainder, without
+ *  libgcc's 64-bit division (the kernel does not link libgcc).
+ */
+static unsigned int fmt_divmod(unsigned long long *n, unsigned int base)
 {
-    va_list ap;
-    va_start(ap, format);
+    unsigned int hi = (unsigned int)(*n >> 32);
+    unsigned int lo = (unsigned int)*n;
+    unsigned int rem;
+
+    if (hi == 0) {
+        *n = lo / base;
+        return lo % base;
+    }
+    /* hi % base < base, so the 64 by 32 bit divl cannot overflow */
+    rem = hi % base;
+    hi /= base;
+    __asm__("divl %4" : "=a"(lo), "=d"(rem) : "a"(lo), "d"(rem), "rm"(base));
+    *n = ((unsigned long long)hi << 32) | lo;
+    return rem;
+}
+
+
+/* Emits count copies of c, in pieces of up to 16 */
+static void fmt_pad(fmt_sink_t sink, void *ctx, char c, int count)
+{
+    static const char spaces[16] = "                ";
+    static const char zeros[16]  = "0000000000000000";
+
+    while (count > 0) {
+        int n = count > 16 ? 16 : count;
+        sink(ctx, c == '0' ? zeros : spaces, n);
+        count -= n;
+    }
+}
+
+
+/*
+ * Emits one field: sign/prefix, leading zeros, body, padded to the width.
+ * Returns its length.
+ */
+static int fmt_field(fmt_sink_t sink, void *ctx, const struct fmt_spec *spec,
+                     const char *prefix, int prefix_len, int zeros,
+                     const char *body, int body_len)
+{
+    int len = prefix_len + zeros + body_len;
+    int pad = spec->width > len ? spec->width - len : 0;
+
+    if (pad && !(spec->flags & FMT_LEFT) && (spec->flags & FMT_ZERO) &&
+        spec->precision == FMT_NONE && spec->conv != 's' && spec->conv != 'c') {
+        /* Zero padding goes between the sign and the digits */
+        zeros += pad;
+        pad = 0;
+    }
+
+    if (pad && !(spec->flags & FMT_LEFT)) fmt_pad(sink, ctx, ' ', pad);
+    if (prefix_len) sink(ctx, prefix, prefix_len);
+    if (zeros) fmt_pad(sink, ctx, '0', zeros);
+    if (body_len) sink(ctx, body, body_len);
+    if (pad && (spec->flags & FMT_LEFT)) fmt_pad(sink, ctx, ' ', pad);
 
-    char *p = str;
+    return len + pad;
+}
+
+
+static int fmt_number(fmt_sink_t sink, void *ctx, const struct fmt_spec *spec,
+                      unsigned long long value, int negative)
+{
+    const char *digits = spec->conv == 'X' ? "0123456789ABCDEF" : "0123456789abcdef";
+    unsigned int base = 10;
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    char prefix[2];
+    int prefix_len = 0;
+    int len, zeros = 0;
+
+    if (spec->conv == 'x' || spec->conv == 'X' || spec->conv == 'p') {
+        base = 16;
+    } else if (spec->conv == 'o') {
+        base = 8;
+    }
+
+    /* Precision 0 with value 0 prints no digits, as in C */
+    if (value != 0 || spec->precision != 0) {
+        do {
+            *--p = digits[fmt_divmod(&value, base)];
+        } while (value != 0);
+    }
+    len = buf + sizeof(buf) - p;
+
+    if (negative) {
+        prefix[prefix_len++] = '-';
+    } else if (spec->flags & FMT_PLUS) {
+        prefix[prefix_len++] = '+';
+    } else if (spec->flags & FMT_SPACE) {
+        prefix[prefix_len++] = ' ';
+    }
+    if (spec->conv == 'p') {
+        prefix[0] = '0';
+        prefix[1] = 'x';
+        prefix_len = 2;
+    }
+
+    if (spec->precision > len) {
+        zeros = spec->precision - len;
+    }
+    return fmt_field(sink, ctx, spec, prefix, prefix_len, zeros, p, len);
+}
+
+
+int vformat(fmt_sink_t sink, void *ctx, const char *format, va_list ap)
+{
     const char *f = format;
+    int count = 0;
 
     while (*f != '\0') {
-        if (*f == '%') {
+        struct fmt_spec spec;
+        const char *run = f;
+
+        /* Literal text up to the next conversion goes out in one piece */
+        while (*f != '\0' && *f != '%') {
             f++;
-            switch (*f) {
-                case 'c': {
-                    char c = (char)va_arg(ap, int);
-                    *p++ = c;
-                    break;
-                }
-                case 'd': {
-                    int d = va_arg(ap, int);
-                    char buf[12];
-                    itoa(d, buf, 10);
-                    char *b = buf;
-                    while (*b != '\0') {
-                        *p++ = *b++;
-                    }
-                    break;
-                }
-                case 'x': {
-                    int x = va_arg(ap, int);
-                    char buf[12];
-                    itoa(x, buf, 16);
-                    char *b = buf;
-                    while (*b != '\0') {
-                        *p++ = *b++;
-                    }
-                    break;
-                }
-                case 's': {
-                    char *s = va_arg(ap, char *);
-                    if (!s) s = "(null)";
-                    while (*s != '\0') {
-                        *p++ = *s++;
-                    }
-                    break;
+        }
+        if (f != run) {
+            sink(ctx, run, f - run);
+            count += f - run;
+        }
+        if (*f == '\0') {
+            break;
+        }
+
+        f = fmt_parse(f + 1, &spec);
+        if (spec.width == FMT_STAR) {
+            spec.width = va_arg(ap, int);
+            if (spec.width < 0) {
+                spec.flags |= FMT_LEFT;
+                spec.width = -spec.width;
+            }
+        }
+        if (spec.precision == FMT_STAR) {
+            spec.precision = va_arg(ap, int);
+            if (spec.precision < 0) {
+                spec.precision = FMT_NONE;
+            }
+        }
+
+        switch (spec.conv) {
+            case 'c': {
+                char c = (char)va_arg(ap, int);
+                count += fmt_field(sink, ctx, &spec, 0, 0, 0, &c, 1);
+                break;
+            }
+            case 's': {
+                const char *s = va_arg(ap, const char *);
+                int len = 0;
+                if (!s) s = "(null)";
+                while (s[len] != '\0' && (spec.precision == FMT_NONE || len < spec.precision)) {
+                    len++;
                 }
-                case '%': {
-                    *p++ = '%';
-                    break;
+                count += fmt_field(sink, ctx, &spec, 0, 0, 0, s, len);
+                break;
+            }
+            case 'd':
+            case 'i': {
+                long long v = spec.is_long_long ? va_arg(ap, long long) : va_arg(ap, int);
+                unsigned long long magnitude = v < 0 ? -(unsigned long long)v : (unsigned long long)v;
+                count += fmt_number(sink, ctx, &spec, magnitude, v < 0);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o': {
+                unsigned long long v = spec.is_long_long ? va_arg(ap, unsigned long long)
+                                                         : va_arg(ap, unsigned int);
+                count += fmt_number(sink, ctx, &spec, v, 0);
+                break;
+            }
+            case 'p': {
+                unsigned long v = (unsigned long)va_arg(ap, void *);
+                if (spec.precision == FMT_NONE) {
+                    spec.precision = 2 * sizeof(void *);
                 }
-                default:
-                    *p++ = '%';
-                    *p++ = *f;
-                    break;
+                count += fmt_number(sink, ctx, &spec, v, 0);
+                break;
             }
-        } else {
-            *p++ = *f;
+            case '%':
+                sink(ctx, "%", 1);
+                count++;
+                break;
+            case '\0':
+                /* Lone '%' at the end of the format */
+                sink(ctx, "%", 1);
+                count++;
+                break;
+            default:
+                /* Unknown conversion: print it as it was written */
+                sink(ctx, "%", 1);
+                sink(ctx, &spec.conv, 1);
+                count += 2;
+                break;
         }
-        f++;
     }
 
-    *p = '\0';
+    return count;
+}
+
+
+/* vsnprintf's sink: copies what fits, counts everything */
+struct fmt_buf {
+    char *str;
+    unsigned int size;      /* bytes available, including the NUL */
+    unsigned int len;       /* bytes produced so far */
+};
+
+static void fmt_buf_sink(void *ctx, const char *s, unsigned int len)
+{
+    struct fmt_buf *b = (struct fmt_buf *)ctx;
+
+    if (b->len + 1 < b->size) {
+        unsigned int room = b->size - 1 - b->len;
+        memcpy(b->str + b->len, s, len < room ? len : room);
+    }
+    b->len += len;
+}
+
+int vsnprintf(char *str, unsigned int size, const char *format, va_list ap)
+{
+    struct fmt_buf b = { str, size, 0 };
+
+    vformat(fmt_buf_sink, &b, format, ap);
+    if (size > 0) {
+        str[b.len < size ? b.len : size - 1] = '\0';
+    }
+    return (int)b.len;
+}
+
+int snprintf(char *str, unsigned int size, const char *format, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, format);
+    len = vsnprintf(str, size, format, ap);
     va_end(ap);
+    return len;
+}
+
+int sprintf(char *str, const char *format, ...)
+{
+    va_list ap;
+    int len;
 
-    return (int)(p - str);
+    va_start(ap, format);
+    len = vsnprintf(str, (unsigned int)-1, format, ap);
+    va_end(ap);
+    return len;
 }
@@ -0,0 +1,132 @@
+"""Just enough ELF32 to read kernel.elf from the host tools.
+
+Shared by klog_decode.py (format strings), kprof.py (symbols),
+ksyms.py (symbols, and patching the table into the file) and ksize.py
+(section sizes).
+"""
+
+import bisect
+import struct
+
+
+class Elf32:
+    """Sections of a little-endian ELF32 file, its bytes and its symbols."""
+
+    SHF_ALLOC = 0x2
+    SHF_EXECINSTR = 0x4
+    SHT_SYMTAB = 2
+    SHT_NOBITS = 8
+    STT_NOTYPE = 0
+    STT_FUNC = 2
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            raise ValueError("%s is not an ELF32 file" % path)
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.headers = []
+        for i in range(shnum):
+            self.headers.append(struct.unpack_from(
+                "<IIIIIIIIII", self.data, shoff + i * shentsize))
+        # (addr, offset, size) of every loaded section with contents
+        self.sections = [(addr, offset, size)
+                         for (_, sh_type, flags, addr, offset, size, _, _, _, _)
+                         in self.headers
+                         if flags & self.SHF_ALLOC and sh_type != self.SHT_NOBITS and size]
+        self._symbols = None
+
+    def cstring(self, addr):
+        """The NUL-terminated string at a virtual address, or None."""
+        for base, offset, size in self.sections:
+            if base <= addr < base + size:
+                start = offset + addr - base
+                end = self.data.index(b"\0", start, offset + size)
+                return self.data[start:end].decode("latin-1")
+        return None
+
+    def file_offset(self, addr):
+        """Offset in the file of a virtual address in a loaded section, or None."""
+        for base, offset, size in self.sections:
+            if base <= addr < base + size:
+                return offset + addr - base
+        return None
+
+    def section_list(self):
+        """(name, address, size, nobits) of every loaded section, in address order."""
+        shstrndx, = struct.unpack_from("<H", self.data, 0x32)
+        names_offset = self.headers[shstrndx][4]
+        out = []
+        for (name, sh_type, flags, addr, _, size, _, _, _, _) in self.headers:
+            if not flags & self.SHF_ALLOC or not size:
+                continue
+            end = self.data.index(b"\0", names_offset + name)
+            out.append((self.data[names_offset + name:end].decode("latin-1"),
+                        addr, size, sh_type == self.SHT_NOBITS))
+        return sorted(out, key=lambda s: s[1])
+
+    def text_end(self):
+        """One past the last byte of executable code."""
+        return max(addr + size
+                   for (_, _, flags, addr, _, size, _, _, _, _) in self.headers
+                   if flags & self.SHF_ALLOC and flags & self.SHF_EXECINSTR)
+
+    def symbol(self, wanted):
+        """(address, size) of a symbol of any type, or None."""
+        for (_, sh_type, _, _, offset, size, link, _, _, entsize) in self.headers:
+            if sh_type != self.SHT_SYMTAB:
+                continue
+            strtab_offset = self.headers[link][4]
+            for pos in range(offset, offset + size, entsize):
+                name, value, sym_size, _, _, shndx = struct.unpack_from(
+                    "<IIIBBH", self.data, pos)
+                if not name or shndx == 0:
+                    continue
+                end = self.data.index(b"\0", strtab_offset + name)
+                if self.data[strtab_offset + name:end].decode("latin-1") == wanted:
+                    return value, sym_size
+        return None
+
+    def symbols(self):
+        """Code symbols as a sorted list of (address, size, name).
+
+        Functions from C, and untyped labels from the nasm sources (their
+        size is 0 and they extend to the next symbol).
+        """
+        if self._symbols is not None:
+            return self._symbols
+        syms = {}
+        for (_, sh_type, _, _, offset, size, link, _, _, entsize) in self.headers:
+            if sh_type != self.SHT_SYMTAB:
+                continue
+            strtab_offset = self.headers[link][4]
+            for pos in range(offset, offset + size, entsize):
+                name, value, sym_size, info, _, shndx = struct.unpack_from(
+                    "<IIIBBH", self.data, pos)
+                if shndx == 0 or shndx >= 0xFF00 or not name:
+                    continue
+                if info & 0xF not in (self.STT_FUNC, self.STT_NOTYPE):
+                    continue
+                flags = self.headers[shndx][2]
+                if not flags & self.SHF_EXECINSTR:
+                    continue
+                end = self.data.index(b"\0", strtab_offset + name)
+                label = self.data[strtab_offset + name:end].decode("latin-1")
+                # Prefer a sized function over a label at the same address
+                if value not in syms or sym_size > syms[value][1]:
+                    syms[value] = (value, sym_size, label)
+        self._symbols = sorted(syms.values())
+        self._addresses = [s[0] for s in self._symbols]
+        return self._symbols
+
+    def lookup(self, addr):
+        """(name, offset) of the symbol containing addr, or (None, 0)."""
+        symbols = self.symbols()
+        i = bisect.bisect_right(self._addresses, addr) - 1
+        if i < 0:
+            return None, 0
+        base, size, name = symbols[i]
+        if size and addr >= base + size:
+            return None, 0
+        return name, addr - base
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""Boot kernel_bench.elf under QEMU and check its results (see bench/kbench.h).
+
+The benchmark kernel reports one line per case over COM1 and leaves QEMU
+through the isa-debug-exit device. This tool boots the image headless,
+parses the report and compares every median with a baseline file:
+
+    tools/kbench.py --baseline bench/kbench_baseline.txt build/kernel_bench.iso
+
+A case fails when its median is more than --tolerance above the baseline.
+--update writes the new results as the baseline instead. Exits 1 on a
+regression, a missing case or a kernel that did not finish. Without a
+baseline file (and --update) it exits KBENCH_SKIPPED, which CTest reports
+as skipped: a run that compared nothing never passes.
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+
+KBENCH_EXIT_PORT = 0xF4
+# isa-debug-exit turns the value written (KBENCH_EXIT_DONE, 0) into (0 << 1) | 1
+QEMU_EXIT_DONE = 1
+# The kernel_bench test's SKIP_RETURN_CODE
+KBENCH_SKIPPED = 77
+
+RESULT = re.compile(r"^kbench (\S+) calls=(\d+) min=(\d+) median=(\d+)\s*$")
+
+
+def run_qemu(iso, args):
+    """Everything the kernel wrote to COM1, and QEMU's exit status."""
+    cmd = [args.qemu, "-cdrom", iso, "-m", str(args.memory), "-boot", "d",
+           "-nographic", "-no-reboot",
+           "-device", "isa-debug-exit,iobase=0x%x,iosize=0x04" % KBENCH_EXIT_PORT]
+    if args.icount:
+        # Cycles become instructions: slower, but the same on every host
+        cmd += ["-icount", "shift=0"]
+    try:
+        proc = subprocess.run(cmd, stdin=subprocess.DEVNULL, stdout=subprocess.PIPE,
+                              timeout=args.timeout)
+    except subprocess.TimeoutExpired as e:
+        return (e.stdout or b"").decode("latin-1"), None
+    return proc.stdout.decode("latin-1"), proc.returncode
+
+
+def parse(output):
+    """{case: (calls, min, median)} in report order, and whether the end line came."""
+    results = {}
+    done = False
+    for line in output.splitlines():
+        line = line.strip("\r")
+        m = RESULT.match(line)
+        if m:
+            results[m.group(1)] = tuple(int(v) for v in m.groups()[1:])
+        elif line.startswith("kbench end"):
+            done = True
+    return results, done
+
+
+def read_baseline(path):
+    """{case: median cycles}; '#' starts a comment."""
+    baseline = {}
+    with open(path) as f:
+        for line in f:
+            fields = line.split("#", 1)[0].split()
+            if len(fields) == 2:
+                baseline[fields[0]] = int(fields[1])
+    return baseline
+
+
+def write_baseline(path, results):
+    with open(path, "w") as f:
+        f.write("# kernel_bench.elf median cycles per call (tools/kbench.py --update)\n")
+        for name, (_, _, median) in results.items():
+            f.write("%-24s %u\n" % (name, median))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("iso", help="kernel_bench.iso")
+    parser.add_argument("--baseline", required=True, help="baseline file, one 'case median' per line")
+    parser.add_argument("--tolerance", type=float, default=0.25,
+                        help="allowed slowdown of a median, as a fraction (default 0.25)")
+    parser.add_argument("--update", action="store_true", help="write the results as the new baseline")
+    parser.add_argument("--output", help="also save the raw COM1 output here")
+    parser.add_argument("--qemu", default="qemu-system-i386")
+    parser.add_argument("--memory", type=int, default=32, help="guest RAM in MiB")
+    parser.add_argument("--icount", action="store_true", help="count instructions instead of cycles")
+    parser.add_argument("--timeout", type=int, default=120, help="seconds before QEMU is killed")
+    args = parser.parse_args()
+
+    output, status = run_qemu(args.iso, args)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(output)
+    results, done = parse(output)
+    if status is None:
+        print("kbench: QEMU did not exit within %d s" % args.timeout, file=sys.stderr)
+        return 1
+    if not done or status != QEMU_EXIT_DONE:
+        print("kbench: kernel did not finish (QEMU exit status %d)" % status, file=sys.stderr)
+        return 1
+
+    if args.update:
+        write_baseline(args.baseline, results)
+        print("kbench: %d cases written to %s" % (len(results), args.baseline))
+        return 0
+    try:
+        baseline = read_baseline(args.baseline)
+    except FileNotFoundError:
+        print("kbench: no baseline %s; record one with --update" % args.baseline, file=sys.stderr)
+        return KBENCH_SKIPPED
+
+    failed = 0
+    print("%-24s %10s %10s %10s %8s" % ("case", "min", "median", "baseline", "change"))
+    for name, (_, low, median) in results.items():
+        base = baseline.get(name)
+        if base is None:
+            print("%-24s %10u %10u %10s %8s" % (name, low, median, "-", "new"))
+            continue
+        change = (median - base) / base if base else 0.0
+        verdict = ""
+        if change > args.tolerance:
+            verdict = "  SLOWER"
+            failed += 1
+        print("%-24s %10u %10u %10u %+7.1f%%%s" % (name, low, median, base, change * 100, verdict))
+    for name in baseline:
+        if name not in results:
+            print("%-24s missing from the report" % name)
+            failed += 1
+    if failed:
+        print("kbench: %d of %d cases failed" % (failed, len(baseline)), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""Decode binary log records (LOG_BINARY) dumped over serial.
+
+The kernel stores only the address of each format string, a TSC value and
+the raw argument words (see log_dump_records in c_files/src/log.c). This tool
+finds the dump in a serial capture, reads the format strings back out of
+kernel.elf and prints the formatted lines:
+
+    qemu-system-i386 -cdrom os.iso -serial file:com1.out
+    tools/klog_decode.py build/kernel.elf com1.out
+
+The capture may contain ordinary text around the dump; every dump found in
+the file is decoded in order.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+from elf32 import Elf32
+
+LOG_DUMP_MAGIC = 0x474F4C4B
+LOG_RECORD_HEADER_WORDS = 4
+LOG_RECORD_NO_LEVEL = 0xFF
+
+LEVEL_PREFIX = {
+    0: "[DEBUG]   ",
+    1: "[INFO]    ",
+    2: "[WARNING] ",
+    3: "[ERROR]   ",
+    LOG_RECORD_NO_LEVEL: "",
+}
+
+# Conversions as the kernel parses them (fmt_parse in c_files/src/string.c),
+# in the same order it walks them: flags, width, precision, length, conversion
+CONVERSION = re.compile(
+    r"%([-0+ ]*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|z)?(.|$)", re.DOTALL)
+# The ones that take an argument; vformat prints any other as written
+ARG_CONVERSIONS = "cdiuxXops"
+
+
+def format_record(fmt, args):
+    """Apply the kernel's printf semantics to the recorded argument words."""
+    out = []
+    pos = 0
+    i = 0
+    for m in CONVERSION.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, precision, length, conv = m.groups()
+
+        def take():
+            nonlocal i
+            if i >= len(args):
+                raise IndexError
+            i += 1
+            return args[i - 1]
+
+        try:
+            if width == "*":
+                width = take()
+                width = width - (1 << 32) if width & 0x80000000 else width
+                if width < 0:
+                    flags += "-"
+                    width = -width
+                width = str(width)
+            if precision == "*":
+                precision = take()
+                precision = None if precision & 0x80000000 else str(precision)
+            elif precision == "":
+                precision = "0"
+
+            # The '*' arguments were recorded, but nothing for the conversion
+            if conv == "" or conv not in ARG_CONVERSIONS:
+                out.append("%" if conv in ("%", "") else "%" + conv)
+                continue
+            if conv == "s":
+                nbytes = take()
+                nwords = (nbytes + 3) // 4
+                if i + nwords > len(args):
+                    raise IndexError
+                raw = struct.pack("<%dI" % nwords, *args[i:i + nwords])
+                value = raw[:nbytes].decode("latin-1")
+                i += nwords
+            elif length == "ll" and conv not in "cp":
+                value = take()
+                value |= take() << 32
+                if conv in "di" and value & (1 << 63):
+                    value -= 1 << 64
+            else:
+                value = take()
+                if conv in "di" and value & 0x80000000:
+                    value -= 1 << 32
+        except IndexError:
+            out.append("<missing>")
+            continue
+
+        spec = "%" + flags + (width or "")
+        if precision is not None:
+            spec += "." + precision
+        if conv == "c":
+            out.append((spec + "c") % chr(value & 0xFF))
+        elif conv == "p":
+            out.append((spec + "s") % ("0x%08x" % value))
+        elif conv == "i":
+            out.append((spec + "d") % value)
+        else:
+            out.append((spec + conv) % value)
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def decode_dump(elf, words, tsc_hz):
+    first_tsc = None
+    i = 0
+    while i + LOG_RECORD_HEADER_WORDS <= len(words):
+        fmt_addr, tsc_lo, tsc_hi, info = words[i:i + LOG_RECORD_HEADER_WORDS]
+        length = info & 0xFF
+        level = (info >> 8) & 0xFF
+        if length < LOG_RECORD_HEADER_WORDS or i + length > len(words):
+            print("# truncated record at word %d" % i)
+            return
+        args = words[i + LOG_RECORD_HEADER_WORDS:i + length]
+        i += length
+
+        tsc = (tsc_hi << 32) | tsc_lo
+        if first_tsc is None:
+            first_tsc = tsc
+        delta = tsc - first_tsc
+        stamp = ("%12.6f" % (delta / tsc_hz)) if tsc_hz else ("%14d" % delta)
+
+        fmt = elf.cstring(fmt_addr)
+        if fmt is None:
+            text = "<unknown format 0x%08x> %s" % (
+                fmt_addr, " ".join("%08x" % a for a in args))
+        else:
+            text = format_record(fmt, args)
+        sys.stdout.write("%s %s%s" % (stamp, LEVEL_PREFIX.get(level, ""), text))
+        if level != LOG_RECORD_NO_LEVEL:
+            sys.stdout.write("\n")
+    sys.stdout.write("\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("kernel", help="kernel.elf the records came from")
+    parser.add_argument("capture", help="serial capture containing the dump")
+    parser.add_argument("--tsc-hz", type=float, default=0,
+                        help="TSC frequency; timestamps in seconds instead of cycles")
+    args = parser.parse_args()
+
+    elf = Elf32(args.kernel)
+    with open(args.capture, "rb") as f:
+        data = f.read()
+
+    magic = struct.pack("<I", LOG_DUMP_MAGIC)
+    pos = data.find(magic)
+    if pos < 0:
+        sys.exit("no log dump found in %s" % args.capture)
+    while pos >= 0:
+        if pos + 12 > len(data):
+            break
+        _, count, overwritten = struct.unpack_from("<III", data, pos)
+        body = data[pos + 12:pos + 12 + count * 4]
+        count = len(body) // 4
+        print("# dump: %d words, %d records overwritten" % (count, overwritten))
+        decode_dump(elf, list(struct.unpack("<%dI" % count, body[:count * 4])),
+                    args.tsc_hz)
+        pos = data.find(magic, pos + 12 + count * 4)
+
+
+if __name__ == "__main__":
+    main()
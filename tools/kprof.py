@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Resolve sampling profiler dumps (profile_dump) against kernel.elf.
+
+The kernel records the interrupted eip and a few return addresses per PIT
+tick (see c_files/src/profile.c). This tool finds the dumps in a serial
+capture, resolves the addresses to functions and prints a flat profile:
+
+    qemu-system-i386 -cdrom os.iso -serial file:com1.out
+    tools/kprof.py build/kernel.elf com1.out
+
+With --folded it prints one line per distinct stack instead, outermost
+function first, in the format flamegraph.pl and speedscope read.
+"""
+
+import argparse
+import collections
+import struct
+import sys
+
+from elf32 import Elf32
+
+PROFILE_DUMP_MAGIC = 0x464F5250
+PROFILE_HEADER_WORDS = 4
+
+
+def read_dumps(data):
+    """Every dump in the capture as (samples, dropped, rate_hz, stacks).
+
+    Each stack is a list of addresses, innermost first.
+    """
+    magic = struct.pack("<I", PROFILE_DUMP_MAGIC)
+    dumps = []
+    pos = data.find(magic)
+    while pos >= 0 and pos + PROFILE_HEADER_WORDS * 4 <= len(data):
+        _, samples, dropped, rate = struct.unpack_from("<IIII", data, pos)
+        pos += PROFILE_HEADER_WORDS * 4
+        stacks = []
+        while len(stacks) < samples and pos + 8 <= len(data):
+            depth, eip = struct.unpack_from("<II", data, pos)
+            if pos + 8 + depth * 4 > len(data):
+                break
+            callers = struct.unpack_from("<%dI" % depth, data, pos + 8)
+            stacks.append([eip] + list(callers))
+            pos += 8 + depth * 4
+        if len(stacks) < samples:
+            print("# dump truncated after %d of %d samples" % (len(stacks), samples),
+                  file=sys.stderr)
+        dumps.append((samples, dropped, rate, stacks))
+        pos = data.find(magic, pos)
+    return dumps
+
+
+def resolve(elf, stack):
+    """Function names of a stack, innermost first.
+
+    Return addresses point after the call, which may already be the next
+    function, so they are looked up one byte earlier.
+    """
+    names = []
+    for depth, addr in enumerate(stack):
+        name, _ = elf.lookup(addr if depth == 0 else addr - 1)
+        names.append(name or "0x%08x" % addr)
+    return names
+
+
+def print_flat(stacks, total):
+    self_count = collections.Counter()
+    incl_count = collections.Counter()
+    for names in stacks:
+        self_count[names[0]] += 1
+        # Recursion would count a function more than once per sample
+        for name in set(names):
+            incl_count[name] += 1
+
+    print("%8s %7s %8s %7s  %s" % ("self", "%", "total", "%", "function"))
+    for name, count in sorted(incl_count.items(), key=lambda kv: (-self_count[kv[0]], -kv[1], kv[0])):
+        print("%8d %6.2f%% %8d %6.2f%%  %s" % (
+            self_count[name], 100.0 * self_count[name] / total,
+            count, 100.0 * count / total, name))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("kernel", help="kernel.elf the samples came from")
+    parser.add_argument("capture", help="serial capture containing the dumps")
+    parser.add_argument("--folded", action="store_true",
+                        help="print folded stacks for a flame graph")
+    args = parser.parse_args()
+
+    elf = Elf32(args.kernel)
+    with open(args.capture, "rb") as f:
+        dumps = read_dumps(f.read())
+    if not dumps:
+        sys.exit("no profile dump found in %s" % args.capture)
+
+    # All dumps of a capture are merged into one profile
+    stacks = [resolve(elf, stack) for _, _, _, s in dumps for stack in s]
+    dropped = sum(d[1] for d in dumps)
+    rates = sorted(set(d[2] for d in dumps))
+
+    if args.folded:
+        folded = collections.Counter(";".join(reversed(names)) for names in stacks)
+        for line, count in sorted(folded.items()):
+            print("%s %d" % (line, count))
+        return
+
+    print("# %d samples at %s Hz, %d dropped" % (
+        len(stacks), "/".join(str(r) for r in rates), dropped))
+    if stacks:
+        print_flat(stacks, len(stacks))
+
+
+if __name__ == "__main__":
+    main()
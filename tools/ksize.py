@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+"""Print the size of each part of kernel.elf (see linker/link.ld).
+
+Runs after every link (CMakeLists.txt), so growth shows up in the build
+log: every loaded section, the hot, cold and init groups link.ld makes
+inside .text, and the total the boot loader has to load.
+
+    tools/ksize.py build/kernel.elf
+"""
+
+import argparse
+import sys
+
+from elf32 import Elf32
+
+# (label, start symbol, end symbol) of the groups link.ld marks in .text
+TEXT_GROUPS = [
+    ("cold", "__text_unlikely_start", "__text_unlikely_end"),
+    ("hot", "__text_hot_start", "__text_hot_end"),
+    ("init", "__init_start", "__init_end"),
+]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("kernel", help="kernel.elf")
+    args = parser.parse_args()
+
+    elf = Elf32(args.kernel)
+    loaded = 0
+    print("%-12s %10s %10s" % ("section", "address", "bytes"))
+    for name, addr, size, nobits in elf.section_list():
+        print("%-12s 0x%08x %10u" % (name, addr, size))
+        if not nobits:
+            loaded += size
+        if name == ".text":
+            for label, start, end in TEXT_GROUPS:
+                first, last = elf.symbol(start), elf.symbol(end)
+                if first is not None and last is not None:
+                    print("  %-10s 0x%08x %10u" % (label, first[0], last[0] - first[0]))
+    print("%-12s %10s %10u" % ("loaded", "", loaded))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Write the kernel's own symbol table into kernel.elf (see ksyms.h).
+
+The kernel reserves a zero-filled array, ksyms_table, in its .ksyms
+section. This tool runs after every link (CMakeLists.txt) and fills that
+array in place with the code symbols of the same file, so addresses
+resolve without a second link and without moving anything:
+
+    tools/ksyms.py build/kernel.elf
+"""
+
+import argparse
+import struct
+import sys
+
+from elf32 import Elf32
+
+KSYMS_MAGIC = 0x4D59534B
+KSYMS_NO_NAME = 0xFFFF
+TABLE_SYMBOL = "ksyms_table"
+
+
+def entries(elf):
+    """(address, name or None) in address order.
+
+    A None entry starts a gap: padding after a sized function, and
+    everything past the end of the code.
+    """
+    syms = elf.symbols()
+    out = []
+    for i, (addr, size, name) in enumerate(syms):
+        out.append((addr, name))
+        next_addr = syms[i + 1][0] if i + 1 < len(syms) else None
+        if size and (next_addr is None or addr + size < next_addr):
+            out.append((addr + size, None))
+    text_end = elf.text_end()
+    if out and out[-1][1] is not None and out[-1][0] < text_end:
+        out.append((text_end, None))
+    return out
+
+
+def string_pool(names):
+    """(pool bytes, offset of each name); a name that ends another shares its bytes."""
+    pool = bytearray()
+    offsets = {}
+    prev = None
+    # Reversed-string order puts every name right after the longer names it ends
+    for name in sorted(set(names), key=lambda n: n[::-1], reverse=True):
+        if prev is not None and prev.endswith(name):
+            offsets[name] = offsets[prev] + len(prev) - len(name)
+        else:
+            offsets[name] = len(pool)
+            pool += name.encode("latin-1") + b"\0"
+            prev = name
+    return bytes(pool), offsets
+
+
+def build_table(elf):
+    table = entries(elf)
+    pool, offsets = string_pool(name for _, name in table if name is not None)
+    if len(pool) >= KSYMS_NO_NAME:
+        raise ValueError("symbol names take %d bytes, more than 16-bit offsets reach" % len(pool))
+    blob = struct.pack("<III", KSYMS_MAGIC, len(table), len(pool))
+    blob += struct.pack("<%dI" % len(table), *(addr for addr, _ in table))
+    blob += struct.pack("<%dH" % len(table),
+                        *(offsets[name] if name is not None else KSYMS_NO_NAME
+                          for _, name in table))
+    return blob + pool, len(table), len(pool)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("kernel", help="kernel.elf, patched in place")
+    args = parser.parse_args()
+
+    elf = Elf32(args.kernel)
+    found = elf.symbol(TABLE_SYMBOL)
+    if found is None:
+        print("%s: no %s symbol" % (args.kernel, TABLE_SYMBOL), file=sys.stderr)
+        return 1
+    addr, capacity = found
+    offset = elf.file_offset(addr)
+    if offset is None:
+        print("%s: %s has no contents in the file" % (args.kernel, TABLE_SYMBOL), file=sys.stderr)
+        return 1
+
+    blob, count, pool_size = build_table(elf)
+    if len(blob) > capacity:
+        print("%s: symbol table needs %d bytes, only %d reserved; raise KSYMS_MAX_SIZE"
+              % (args.kernel, len(blob), capacity), file=sys.stderr)
+        return 1
+    with open(args.kernel, "r+b") as f:
+        f.seek(offset)
+        f.write(blob + bytes(capacity - len(blob)))
+    print("ksyms: %d entries, %d bytes of names, %d of %d bytes used"
+          % (count, pool_size, len(blob), capacity))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+"""Receive framed binary data sent with serial_send_frame / serial_send_data.
+
+Frames are COBS-encoded between 0x00 delimiters and carry a header, the
+(optionally LZ4-compressed) payload and a CRC32 (see
+c_files/includes/serial_frame.h). This tool picks them out of a serial
+capture, a FIFO or a serial device, checks them and writes each stream to
+OUTDIR/stream-<id>.bin at the offsets the frames name:
+
+    qemu-system-i386 -cdrom os.iso -serial file:com1.out
+    tools/serial_recv.py com1.out dumps/
+
+The byte ranges received so far are kept next to the data in
+stream-<id>.ranges, so running the tool again on a capture of a repeated
+dump only fills in the holes. Text between frames is dropped, or printed
+with --text.
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import zlib
+
+FRAME_VERSION = 1
+FLAG_LZ = 0x01
+FLAG_END = 0x02
+HEADER = struct.Struct("<BBHIIHH")      # struct serial_frame_header
+CRC_SIZE = 4
+
+
+def cobs_decode(data):
+    """Bytes of one COBS-encoded frame, or None if it is not valid COBS."""
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        code = data[pos]
+        if code == 0 or pos + code > len(data):
+            return None
+        out += data[pos + 1:pos + code]
+        pos += code
+        if code < 0xFF and pos < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def lz4_decompress(data, size):
+    """Decode an LZ4 block that expands to exactly size bytes."""
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        token = data[pos]
+        pos += 1
+        lits = token >> 4
+        if lits == 15:
+            while True:
+                n = data[pos]
+                pos += 1
+                lits += n
+                if n != 255:
+                    break
+        out += data[pos:pos + lits]
+        pos += lits
+        if pos >= len(data):
+            break
+        offset = data[pos] | (data[pos + 1] << 8)
+        pos += 2
+        mlen = token & 15
+        if mlen == 15:
+            while True:
+                n = data[pos]
+                pos += 1
+                mlen += n
+                if n != 255:
+                    break
+        mlen += 4
+        if offset == 0 or offset > len(out):
+            raise ValueError("bad match offset")
+        # Byte by byte: a match may overlap the bytes it produces
+        for _ in range(mlen):
+            out.append(out[-offset])
+    if len(out) != size:
+        raise ValueError("expanded to %d bytes, expected %d" % (len(out), size))
+    return bytes(out)
+
+
+def parse_frame(raw):
+    """(header fields, data) of a decoded frame.
+
+    Returns None for something that is not a frame at all, and raises
+    ValueError for a frame that was damaged on the way.
+    """
+    if len(raw) < HEADER.size + CRC_SIZE or raw[0] != FRAME_VERSION:
+        return None
+    body, crc = raw[:-CRC_SIZE], struct.unpack("<I", raw[-CRC_SIZE:])[0]
+    if zlib.crc32(body) != crc:
+        raise ValueError("CRC mismatch")
+    _, flags, stream, seq, offset, length, _ = HEADER.unpack_from(body)
+    payload = body[HEADER.size:]
+    if flags & FLAG_LZ:
+        data = lz4_decompress(payload, length)
+    elif len(payload) == length:
+        data = payload
+    else:
+        raise ValueError("length mismatch")
+    return (flags, stream, seq, offset), data
+
+
+def merge_ranges(ranges):
+    merged = []
+    for start, end in sorted(ranges):
+        if merged and start <= merged[-1][1]:
+            merged[-1][1] = max(merged[-1][1], end)
+        else:
+            merged.append([start, end])
+    return merged
+
+
+class Stream:
+    """One output file and the byte ranges of it that are known."""
+
+    def __init__(self, outdir, stream_id):
+        base = os.path.join(outdir, "stream-%d" % stream_id)
+        self.bin_path = base + ".bin"
+        self.meta_path = base + ".ranges"
+        self.ranges = []
+        self.size = None
+        if os.path.exists(self.meta_path):
+            with open(self.meta_path) as f:
+                meta = json.load(f)
+            self.ranges = meta["ranges"]
+            self.size = meta["size"]
+        self.file = open(self.bin_path, "r+b" if os.path.exists(self.bin_path) else "w+b")
+
+    def write(self, offset, data, end):
+        self.file.seek(offset)
+        self.file.write(data)
+        if data:
+            self.ranges = merge_ranges(self.ranges + [[offset, offset + len(data)]])
+        if end:
+            self.size = offset + len(data)
+
+    def missing(self):
+        """Holes up to the stream size, or up to the last byte seen."""
+        holes = []
+        pos = 0
+        for start, end in self.ranges:
+            if start > pos:
+                holes.append((pos, start))
+            pos = end
+        if self.size is not None and pos < self.size:
+            holes.append((pos, self.size))
+        return holes
+
+    def close(self):
+        self.file.close()
+        with open(self.meta_path, "w") as f:
+            json.dump({"ranges": self.ranges, "size": self.size}, f)
+
+
+class Receiver:
+    def __init__(self, outdir, text_out):
+        self.outdir = outdir
+        self.text_out = text_out
+        self.streams = {}
+        self.pending = bytearray()
+        self.frames = 0
+        self.damaged = 0
+        self.lost = 0
+        self.last_seq = None
+
+    def feed(self, chunk):
+        self.pending += chunk
+        while True:
+            end = self.pending.find(b"\0")
+            if end < 0:
+                return
+            self.handle(bytes(self.pending[:end]))
+            del self.pending[:end + 1]
+
+    def handle(self, encoded):
+        if not encoded:
+            return
+        raw = cobs_decode(encoded)
+        try:
+            frame = parse_frame(raw) if raw is not None else None
+        except ValueError as e:
+            self.damaged += 1
+            print("# damaged frame: %s" % e, file=sys.stderr)
+            return
+        if frame is None:
+            if self.text_out:
+                self.text_out.write(encoded.decode("latin-1"))
+            return
+
+        (flags, stream_id, seq, offset), data = frame
+        self.frames += 1
+        if self.last_seq is not None and seq != (self.last_seq + 1) & 0xFFFFFFFF:
+            gap = (seq - self.last_seq - 1) & 0xFFFFFFFF
+            # A restarted kernel starts over at 0
+            if gap < 0x80000000:
+                self.lost += gap
+                print("# %d frame(s) lost before seq %d" % (gap, seq), file=sys.stderr)
+        self.last_seq = seq
+        if stream_id not in self.streams:
+            self.streams[stream_id] = Stream(self.outdir, stream_id)
+        self.streams[stream_id].write(offset, data, flags & FLAG_END)
+
+    def finish(self):
+        self.handle(bytes(self.pending))
+        print("%d frames, %d damaged, %d lost" % (self.frames, self.damaged, self.lost))
+        status = 0
+        for stream_id, stream in sorted(self.streams.items()):
+            stream.close()
+            holes = stream.missing()
+            size = "%d bytes" % stream.size if stream.size is not None else "size unknown (no end frame)"
+            print("stream %d: %s -> %s" % (stream_id, size, stream.bin_path))
+            for start, end in holes:
+                print("  missing %d..%d" % (start, end))
+            if holes or stream.size is None:
+                status = 1
+        return status
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("input", help="serial capture, FIFO or device ('-' for stdin)")
+    parser.add_argument("outdir", help="directory for stream-<id>.bin files")
+    parser.add_argument("--text", action="store_true",
+                        help="print the text between frames to stdout")
+    args = parser.parse_args()
+
+    os.makedirs(args.outdir, exist_ok=True)
+    receiver = Receiver(args.outdir, sys.stdout if args.text else None)
+    source = sys.stdin.buffer if args.input == "-" else open(args.input, "rb", buffering=0)
+    try:
+        while True:
+            chunk = source.read(4096)
+            if not chunk:
+                break
+            receiver.feed(chunk)
+    except KeyboardInterrupt:
+        pass
+    return receiver.finish()
+
+
+if __name__ == "__main__":
+    sys.exit(main())